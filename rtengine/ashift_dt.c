@@ -1610,6 +1610,83 @@ static void shuffle(int *a, const int N)
 // factorial function
 static int fact(const int n) { return (n == 1 ? 1 : n * fact(n - 1)); }
 
+// evaluate the model built out of the first two lines of set: returns the
+// summed quality of the lines within the model (or -1 if no valid model can be
+// built), marks the good/bad lines in inout, and counts the bad ones in
+// eliminated
+static float ransac_run(const dt_iop_ashift_line_t *lines, const int *set,
+                        int *inout, const int set_count,
+                        const float total_weight, const float epsilon,
+                        const int xmin, const int xmax, const int ymin,
+                        const int ymax, int *eliminated)
+{
+    // summed quality evaluation of this run
+    float quality = 0.0f;
+
+    // we build a model ouf of the first two lines
+    const float *L1 = lines[set[0]].L;
+    const float *L2 = lines[set[1]].L;
+
+    // get intersection point (ideally a vantage point)
+    float V[3];
+    vec3prodn(V, L1, L2);
+
+    // catch special cases:
+    // a) L1 and L2 are identical -> V is NULL -> no valid vantage point
+    // b) vantage point lies inside image frame (no chance to correct for
+    // this case)
+    if (vec3isnull(V) ||
+        (fabs(V[2]) > 0.0f && V[0] / V[2] >= xmin && V[1] / V[2] >= ymin &&
+         V[0] / V[2] <= xmax && V[1] / V[2] <= ymax)) {
+        // no valid model
+        return -1.0f;
+    }
+
+    // normalize V so that x^2 + y^2 + z^2 = 1
+    vec3norm(V, V);
+
+    // the two lines constituting the model are part of the set
+    inout[0] = 1;
+    inout[1] = 1;
+
+    // go through all remaining lines, check if they are within the model, and
+    // mark that fact in inout[]. summarize a quality parameter for all lines
+    // within the model
+    for (int n = 2; n < set_count; n++) {
+        // L is normalized so that x^2 + y^2 = 1
+        const float *L3 = lines[set[n]].L;
+
+        // we take the absolute value of the dot product of V and L as a
+        // measure of the "distance" between point and line. Note that this is
+        // not the real euclidian distance but - with the given normalization -
+        // just a pragmatically selected number that goes to zero if V lies on
+        // L and increases the more V and L are apart
+        const float d = fabs(vec3scalar(V, L3));
+
+        // depending on d we either include or exclude the point from the set
+        inout[n] = (d < epsilon) ? 1 : 0;
+
+        float q;
+
+        if (inout[n] == 1) {
+            // a quality parameter that depends 1/3 on the number of lines
+            // within the model, 1/3 on their weight, and 1/3 on their weighted
+            // distance d to the vantage point
+            q = 0.33f / (float)set_count +
+                0.33f * lines[set[n]].weight / total_weight +
+                0.33f * (1.0f - d / epsilon) * (float)set_count *
+                    lines[set[n]].weight / total_weight;
+        } else {
+            q = 0.0f;
+            (*eliminated)++;
+        }
+
+        quality += q;
+    }
+
+    return quality;
+}
+
 // We use a pseudo-RANSAC algorithm to elminiate ouliers from our set of lines.
 // The original RANSAC works on linear optimization problems. Our model is
 // nonlinear. We take advantage of the fact that lines interesting for our model
@@ -1627,6 +1704,11 @@ static int fact(const int n) { return (n == 1 ? 1 : n * fact(n - 1)); }
 // outliers removed in the final run will be lower because we will finally look
 // for the best quality model with the optimized epsilon and that quality value
 // also encloses the number of good lines
+// (RT) the variations of the index set are generated sequentially, so that
+// the sequence of rand() calls is the same as in the original implementation,
+// and are then evaluated in parallel. The best model is the first one with
+// the highest quality, as before, so the result does not depend on the number
+// of threads
 static void ransac(const dt_iop_ashift_line_t *lines, int *index_set,
                    int *inout_set, const int set_count,
                    const float total_weight, const int xmin, const int xmax,
@@ -1636,11 +1718,9 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set,
         return;
 
     const size_t set_size = set_count * sizeof(int);
-    int *best_set = (int *)malloc(set_size);
-    memcpy(best_set, index_set, set_size);
-    int *best_inout = (int *)calloc(1, set_size);
-
-    float best_quality = 0.0f;
+    // returned as is if no valid model is found
+    int *orig_set = (int *)malloc(set_size);
+    memcpy(orig_set, index_set, set_size);
 
     // hurdle value epsilon for rejecting a line as an outlier will be
     // self-tuning in a number of dry runs
@@ -1650,9 +1730,6 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set,
     int lines_eliminated = 0;
     int valid_runs = 0;
 
-    // number of runs to optimize epsilon
-    const int optiruns =
-        RANSAC_OPTIMIZATION_STEPS * RANSAC_OPTIMIZATION_DRY_RUNS;
     // go for complete permutations on small set sizes, else for random sample
     // consensus
     const int riter =
@@ -1664,141 +1741,132 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set,
         perm[n] = n;
     int piter = 1;
 
-    // inout holds good/bad qualification for each line
-    int *inout = (int *)malloc(set_size);
+    // the variations of the index set evaluated in one go
+    const int max_runs =
+        (riter > RANSAC_OPTIMIZATION_DRY_RUNS) ? riter
+                                               : RANSAC_OPTIMIZATION_DRY_RUNS;
+    int *sets = (int *)malloc((size_t)max_runs * set_size);
 
-    for (int r = 0; r < optiruns + riter; r++) {
-        // get random or systematic variation of index set
-        if (set_count > RANSAC_HURDLE || r < optiruns)
+    for (int s = 0; s < RANSAC_OPTIMIZATION_STEPS; s++) {
+        // get random variations of index set
+        for (int r = 0; r < RANSAC_OPTIMIZATION_DRY_RUNS; r++) {
             shuffle(index_set, set_count);
-        else
-            (void)quickperm(index_set, perm, set_count, &piter);
+            memcpy(sets + (size_t)r * set_count, index_set, set_size);
+        }
 
-        // summed quality evaluation of this run
-        float quality = 0.0f;
-
-        // we build a model ouf of the first two lines
-        const float *L1 = lines[index_set[0]].L;
-        const float *L2 = lines[index_set[1]].L;
-
-        // get intersection point (ideally a vantage point)
-        float V[3];
-        vec3prodn(V, L1, L2);
-
-        // catch special cases:
-        // a) L1 and L2 are identical -> V is NULL -> no valid vantage point
-        // b) vantage point lies inside image frame (no chance to correct for
-        // this case)
-        if (vec3isnull(V) ||
-            (fabs(V[2]) > 0.0f && V[0] / V[2] >= xmin && V[1] / V[2] >= ymin &&
-             V[0] / V[2] <= xmax && V[1] / V[2] <= ymax)) {
-            // no valid model
-            quality = 0.0f;
-        } else {
-            // valid model
-
-            // normalize V so that x^2 + y^2 + z^2 = 1
-            vec3norm(V, V);
-
-            // the two lines constituting the model are part of the set
-            inout[0] = 1;
-            inout[1] = 1;
-
-            // go through all remaining lines, check if they are within the
-            // model, and mark that fact in inout[]. summarize a quality
-            // parameter for all lines within the model
-            for (int n = 2; n < set_count; n++) {
-                // L is normalized so that x^2 + y^2 = 1
-                const float *L3 = lines[index_set[n]].L;
-
-                // we take the absolute value of the dot product of V and L as a
-                // measure of the "distance" between point and line. Note that
-                // this is not the real euclidian distance but - with the given
-                // normalization - just a pragmatically selected number that
-                // goes to zero if V lies on L and increases the more V and L
-                // are apart
-                const float d = fabs(vec3scalar(V, L3));
-
-                // depending on d we either include or exclude the point from
-                // the set
-                inout[n] = (d < epsilon) ? 1 : 0;
-
-                float q;
-
-                if (inout[n] == 1) {
-                    // a quality parameter that depends 1/3 on the number of
-                    // lines within the model, 1/3 on their weight, and 1/3 on
-                    // their weighted distance d to the vantage point
-                    q = 0.33f / (float)set_count +
-                        0.33f * lines[index_set[n]].weight / total_weight +
-                        0.33f * (1.0f - d / epsilon) * (float)set_count *
-                            lines[index_set[n]].weight / total_weight;
-                } else {
-                    q = 0.0f;
-                    lines_eliminated++;
+#ifdef _OPENMP
+#pragma omp parallel reduction(+ : lines_eliminated, valid_runs)
+#endif
+        {
+            // inout holds good/bad qualification for each line
+            int *inout = (int *)malloc(set_size);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+            for (int r = 0; r < RANSAC_OPTIMIZATION_DRY_RUNS; r++) {
+                int eliminated = 0;
+                const float quality = ransac_run(
+                    lines, sets + (size_t)r * set_count, inout, set_count,
+                    total_weight, epsilon, xmin, xmax, ymin, ymax, &eliminated);
+                if (quality >= 0.0f) {
+                    lines_eliminated += eliminated;
+                    valid_runs++;
                 }
-
-                quality += q;
             }
-            valid_runs++;
+            free(inout);
         }
 
-        if (r < optiruns) {
-            // on last run of each self-tuning step
-            if ((r % RANSAC_OPTIMIZATION_DRY_RUNS) ==
-                    (RANSAC_OPTIMIZATION_DRY_RUNS - 1) &&
-                (valid_runs > 0)) {
+        // at the end of each self-tuning step
+        if (valid_runs > 0) {
 #ifdef ASHIFT_DEBUG
-                printf("ransac self-tuning (run %d): epsilon %f", r, epsilon);
+            printf("ransac self-tuning (step %d): epsilon %f", s, epsilon);
 #endif
-                // average ratio of lines that we eliminated with the given
-                // epsilon
-                float ratio = 100.0f * (float)lines_eliminated /
-                              ((float)set_count * valid_runs);
-                // adjust epsilon accordingly
-                if (ratio < RANSAC_ELIMINATION_RATIO)
-                    epsilon = pow(10.0f, log10(epsilon) - epsilon_step);
-                else if (ratio > RANSAC_ELIMINATION_RATIO)
-                    epsilon = pow(10.0f, log10(epsilon) + epsilon_step);
+            // average ratio of lines that we eliminated with the given
+            // epsilon
+            float ratio = 100.0f * (float)lines_eliminated /
+                          ((float)set_count * valid_runs);
+            // adjust epsilon accordingly
+            if (ratio < RANSAC_ELIMINATION_RATIO)
+                epsilon = pow(10.0f, log10(epsilon) - epsilon_step);
+            else if (ratio > RANSAC_ELIMINATION_RATIO)
+                epsilon = pow(10.0f, log10(epsilon) + epsilon_step);
 #ifdef ASHIFT_DEBUG
-                printf(" (elimination ratio %f) -> %f\n", ratio, epsilon);
+            printf(" (elimination ratio %f) -> %f\n", ratio, epsilon);
 #endif
-                // reduce step-size for next optimization round
-                epsilon_step /= 2.0f;
-                lines_eliminated = 0;
-                valid_runs = 0;
-            }
-        } else {
-            // in the "real" runs check against the best model found so far
-            if (quality > best_quality) {
-                memcpy(best_set, index_set, set_size);
-                memcpy(best_inout, inout, set_size);
-                best_quality = quality;
+            // reduce step-size for next optimization round
+            epsilon_step /= 2.0f;
+            lines_eliminated = 0;
+            valid_runs = 0;
+        }
+    }
+
+    // get random or systematic variations of index set for the "real" runs
+    for (int r = 0; r < riter; r++) {
+        if (set_count > RANSAC_HURDLE)
+            shuffle(index_set, set_count);
+        else
+            (void)quickperm(index_set, perm, set_count, &piter);
+        memcpy(sets + (size_t)r * set_count, index_set, set_size);
+    }
+
+    // in the "real" runs look for the best model
+    float best_quality = 0.0f;
+    int best_run = -1;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        int *inout = (int *)malloc(set_size);
+        float thread_quality = 0.0f;
+        int thread_run = -1;
+#ifdef _OPENMP
+#pragma omp for schedule(static) nowait
+#endif
+        for (int r = 0; r < riter; r++) {
+            int eliminated = 0;
+            const float quality = ransac_run(
+                lines, sets + (size_t)r * set_count, inout, set_count,
+                total_weight, epsilon, xmin, xmax, ymin, ymax, &eliminated);
+            if (quality > thread_quality) {
+                thread_quality = quality;
+                thread_run = r;
             }
         }
+        free(inout);
 
-#ifdef ASHIFT_DEBUG
-        // report some statistics
-        int count = 0, lastcount = 0;
-        for (int n = 0; n < set_count; n++)
-            count += best_inout[n];
-        for (int n = 0; n < set_count; n++)
-            lastcount += inout[n];
-        printf("ransac run %d: best qual %.6f, eps %.6f, line count %d of %d "
-               "(this run: qual %.5f, count %d (%2f%%))\n",
-               r, best_quality, epsilon, count, set_count, quality, lastcount,
-               100.0f * lastcount / (float)set_count);
+#ifdef _OPENMP
+#pragma omp critical
 #endif
+        {
+            if (thread_run >= 0 &&
+                (thread_quality > best_quality ||
+                 (thread_quality == best_quality && thread_run < best_run))) {
+                best_quality = thread_quality;
+                best_run = thread_run;
+            }
+        }
     }
 
     // store back best set
-    memcpy(index_set, best_set, set_size);
-    memcpy(inout_set, best_inout, set_size);
+    if (best_run >= 0) {
+        int eliminated = 0;
+        memcpy(index_set, sets + (size_t)best_run * set_count, set_size);
+        (void)ransac_run(lines, index_set, inout_set, set_count, total_weight,
+                         epsilon, xmin, xmax, ymin, ymax, &eliminated);
+#ifdef ASHIFT_DEBUG
+        printf("ransac: best run %d of %d, qual %.6f, eps %.6f, %d of %d "
+               "lines eliminated\n",
+               best_run, riter, best_quality, epsilon, eliminated, set_count);
+#endif
+    } else {
+        memcpy(index_set, orig_set, set_size);
+        memset(inout_set, 0, set_size);
+    }
 
-    free(inout);
+    free(sets);
+    free(orig_set);
     free(perm);
-    free(best_inout);
-    free(best_set);
 }
 
 // try to clean up structural data by eliminating outliers and thereby
@@ -2175,10 +2243,29 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module,
         return NMS_NOT_ENOUGH_LINES;
     }
 
+    // (RT) the lines used for the fit do not change during the optimization,
+    // so they are collected once here instead of being filtered again at
+    // every evaluation of model_fitness()
+    dt_iop_ashift_line_t *fit_lines = (dt_iop_ashift_line_t *)malloc(
+        g->lines_count * sizeof(dt_iop_ashift_line_t));
+    int fit_count = 0;
+    for (int n = 0; n < g->lines_count; n++) {
+        if ((g->lines[n].type & fit.linemask) == fit.linetype)
+            fit_lines[fit_count++] = g->lines[n];
+    }
+    fit.lines = fit_lines;
+    fit.lines_count = fit_count;
+    fit.linetype = 0;
+    fit.linemask = 0;
+
     // start the simplex fit
     int iter = simplex(model_fitness, params, fit.params_count, NMS_EPSILON,
                        NMS_SCALE, NMS_ITERATIONS, NULL, (void *)&fit);
 
+    free(fit_lines);
+    fit.lines = NULL;
+    fit.lines_count = 0;
+
     // error case: the fit did not converge
     if (iter >= NMS_ITERATIONS) {
 #ifdef ASHIFT_DEBUG
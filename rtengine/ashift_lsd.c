@@ -655,10 +655,9 @@ static image_double gaussian_sampler( image_double in, double scale,
                                       double sigma_scale )
 {
   image_double aux,out;
-  ntuple_list kernel;
-  unsigned int N,M,h,n,x,y,i;
-  int xc,yc,j,double_x_size,double_y_size;
-  double sigma,xx,yy,sum,prec;
+  unsigned int N,M,h,n;
+  int double_x_size,double_y_size;
+  double sigma,prec;
 
   /* check parameters */
   if( in == NULL || in->data == NULL || in->xsize == 0 || in->ysize == 0 )
@@ -689,82 +688,98 @@ static image_double gaussian_sampler( image_double in, double scale,
   prec = 3.0;
   h = (unsigned int) ceil( sigma * sqrt( 2.0 * prec * log(10.0) ) );
   n = 1+2*h; /* kernel size */
-  kernel = new_ntuple_list(n);
 
   /* auxiliary double image size variables */
   double_x_size = (int) (2 * in->xsize);
   double_y_size = (int) (2 * in->ysize);
 
+  /* both passes are parallel over the output columns/rows; the kernel
+     depends on the position, so each thread uses its own (RT) */
+
   /* First subsampling: x axis */
-  for(x=0;x<aux->xsize;x++)
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+  ntuple_list tkernel = new_ntuple_list(n);
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+  for(unsigned int x=0;x<aux->xsize;x++)
     {
       /*
          x   is the coordinate in the new image.
          xx  is the corresponding x-value in the original size image.
          xc  is the integer value, the pixel coordinate of xx.
        */
-      xx = (double) x / scale;
+      double xx = (double) x / scale;
       /* coordinate (0.0,0.0) is in the center of pixel (0,0),
          so the pixel with xc=0 get the values of xx from -0.5 to 0.5 */
-      xc = (int) floor( xx + 0.5 );
-      gaussian_kernel( kernel, sigma, (double) h + xx - (double) xc );
+      int xc = (int) floor( xx + 0.5 );
+      gaussian_kernel( tkernel, sigma, (double) h + xx - (double) xc );
       /* the kernel must be computed for each x because the fine
          offset xx-xc is different in each case */
 
-      for(y=0;y<aux->ysize;y++)
+      for(unsigned int y=0;y<aux->ysize;y++)
         {
-          sum = 0.0;
-          for(i=0;i<kernel->dim;i++)
+          double sum = 0.0;
+          for(unsigned int i=0;i<tkernel->dim;i++)
             {
-              j = xc - h + i;
+              int j = xc - h + i;
 
               /* symmetry boundary condition */
               while( j < 0 ) j += double_x_size;
               while( j >= double_x_size ) j -= double_x_size;
               if( j >= (int) in->xsize ) j = double_x_size-1-j;
 
-              sum += in->data[ j + y * in->xsize ] * kernel->values[i];
+              sum += in->data[ j + y * in->xsize ] * tkernel->values[i];
             }
           aux->data[ x + y * aux->xsize ] = sum;
         }
     }
 
   /* Second subsampling: y axis */
-  for(y=0;y<out->ysize;y++)
+#ifdef _OPENMP
+#pragma omp for
+#endif
+  for(unsigned int y=0;y<out->ysize;y++)
     {
       /*
          y   is the coordinate in the new image.
          yy  is the corresponding x-value in the original size image.
          yc  is the integer value, the pixel coordinate of xx.
        */
-      yy = (double) y / scale;
+      double yy = (double) y / scale;
       /* coordinate (0.0,0.0) is in the center of pixel (0,0),
          so the pixel with yc=0 get the values of yy from -0.5 to 0.5 */
-      yc = (int) floor( yy + 0.5 );
-      gaussian_kernel( kernel, sigma, (double) h + yy - (double) yc );
+      int yc = (int) floor( yy + 0.5 );
+      gaussian_kernel( tkernel, sigma, (double) h + yy - (double) yc );
       /* the kernel must be computed for each y because the fine
          offset yy-yc is different in each case */
 
-      for(x=0;x<out->xsize;x++)
+      for(unsigned int x=0;x<out->xsize;x++)
         {
-          sum = 0.0;
-          for(i=0;i<kernel->dim;i++)
+          double sum = 0.0;
+          for(unsigned int i=0;i<tkernel->dim;i++)
             {
-              j = yc - h + i;
+              int j = yc - h + i;
 
               /* symmetry boundary condition */
               while( j < 0 ) j += double_y_size;
               while( j >= double_y_size ) j -= double_y_size;
               if( j >= (int) in->ysize ) j = double_y_size-1-j;
 
-              sum += aux->data[ x + j * aux->xsize ] * kernel->values[i];
+              sum += aux->data[ x + j * aux->xsize ] * tkernel->values[i];
             }
           out->data[ x + y * out->xsize ] = sum;
         }
     }
 
+  free_ntuple_list(tkernel);
+  }
+
   /* free memory */
-  free_ntuple_list(kernel);
   free_image_double(aux);
 
   return out;
@@ -797,8 +812,8 @@ static image_double ll_angle( image_double in, double threshold,
                               image_double * modgrad, unsigned int n_bins )
 {
   image_double g;
-  unsigned int n,p,x,y,adr,i;
-  double com1,com2,gx,gy,norm,norm2;
+  unsigned int n,p,x,y,i;
+  double norm;
   /* the rest of the variables are used for pseudo-ordering
      the gradient magnitude values */
   int list_count = 0;
@@ -843,11 +858,15 @@ static image_double ll_angle( image_double in, double threshold,
   for(x=0;x<p;x++) g->data[(n-1)*p+x] = NOTDEF;
   for(y=0;y<n;y++) g->data[p*y+p-1]   = NOTDEF;
 
-  /* compute gradient on the remaining pixels */
-  for(x=0;x<p-1;x++)
-    for(y=0;y<n-1;y++)
+  /* compute gradient on the remaining pixels (in parallel over the rows,
+     the results do not depend on the order -- RT) */
+#ifdef _OPENMP
+#pragma omp parallel for reduction(max : max_grad)
+#endif
+  for(int yy=0;yy<(int)n-1;yy++)
+    for(unsigned int xx=0;xx<p-1;xx++)
       {
-        adr = y*p+x;
+        const unsigned int adr = yy*p+xx;
 
         /*
            Norm 2 computation using 2x2 pixel window:
@@ -860,17 +879,17 @@ static image_double ll_angle( image_double in, double threshold,
              gy = C+D - (A+B)   vertical difference
            com1 and com2 are just to avoid 2 additions.
          */
-        com1 = in->data[adr+p+1] - in->data[adr];
-        com2 = in->data[adr+1]   - in->data[adr+p];
+        const double com1 = in->data[adr+p+1] - in->data[adr];
+        const double com2 = in->data[adr+1]   - in->data[adr+p];
 
-        gx = com1+com2; /* gradient x component */
-        gy = com1-com2; /* gradient y component */
-        norm2 = gx*gx+gy*gy;
-        norm = sqrt( norm2 / 4.0 ); /* gradient norm */
+        const double gx = com1+com2; /* gradient x component */
+        const double gy = com1-com2; /* gradient y component */
+        const double norm2 = gx*gx+gy*gy;
+        const double gnorm = sqrt( norm2 / 4.0 ); /* gradient norm */
 
-        (*modgrad)->data[adr] = norm; /* store gradient norm */
+        (*modgrad)->data[adr] = gnorm; /* store gradient norm */
 
-        if( norm <= threshold ) /* norm too small, gradient no defined */
+        if( gnorm <= threshold ) /* norm too small, gradient no defined */
           g->data[adr] = NOTDEF; /* gradient angle not defined */
         else
           {
@@ -878,7 +897,7 @@ static image_double ll_angle( image_double in, double threshold,
             g->data[adr] = atan2(gx,-gy);
 
             /* look for the maximum of the gradient */
-            if( norm > max_grad ) max_grad = norm;
+            if( gnorm > max_grad ) max_grad = gnorm;
           }
       }
 
@@ -2,10 +2,12 @@
  *  This file is part of RawTherapee.
  */
 #include "camconst.h"
+#include "../rtgui/options.h"
 #include "rt_math.h"
 #include "settings.h"
 #include <cstdio>
 #include <cstring>
+#include <glib/gstdio.h>
 
 // cJSON is a very minimal JSON parser lib in C, not for threaded stuff etc, so
 // if we're going to use JSON more than just here we should probably replace
@@ -767,7 +769,8 @@ void CameraConst::update_globalGreenEquilibration(bool other)
     globalGreenEquilibration = (other ? 1 : 0);
 }
 
-bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
+bool CameraConstantsStore::parse_camera_constants_file(
+    Glib::ustring filename_, EntryTexts<std::string> *texts)
 {
     // read the file into a single long string
     const char *filename = filename_.c_str();
@@ -868,6 +871,7 @@ bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
         }
 
         bool is_array = false;
+        char *text = texts ? cJSON_PrintUnformatted(js) : nullptr;
 
         if (ji->type == cJSON_Array) {
             ji = ji->child;
@@ -879,6 +883,7 @@ bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
                 fprintf(
                     stderr,
                     "\"make_model\" must be a string or an array of strings\n");
+                free(text);
                 goto parse_error;
             }
 
@@ -886,43 +891,16 @@ bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
                 CameraConst::parseEntry((void *)js, ji->valuestring);
 
             if (!cc) {
+                free(text);
                 goto parse_error;
             }
 
             Glib::ustring make_model(ji->valuestring);
             make_model = make_model.uppercase();
+            add(make_model, cc);
 
-            const auto ret = mCameraConstants.emplace(make_model, cc);
-
-            if (ret.second) { // entry inserted into map
-                if (settings->verbose > 1) {
-                    printf("Add camera constants for \"%s\"\n",
-                           make_model.c_str());
-                }
-            } else {
-                // The CameraConst already exist for this camera make/model ->
-                // we merge the values
-                CameraConst *existingcc = ret.first->second;
-
-                // updating the dcraw matrix
-                existingcc->update_dcrawMatrix(cc->get_dcrawMatrix());
-                // deleting all the existing levels, replaced by the new ones
-                existingcc->update_Levels(cc);
-                existingcc->update_Crop(cc);
-                existingcc->update_rawMask(cc);
-                existingcc->update_pdafPattern(cc->get_pdafPattern());
-                existingcc->update_pdafOffset(cc->get_pdafOffset());
-                if (cc->has_globalGreenEquilibration()) {
-                    existingcc->update_globalGreenEquilibration(
-                        cc->get_globalGreenEquilibration());
-                }
-
-                if (settings->verbose > 1) {
-                    printf("Merging camera constants for \"%s\"\n",
-                           make_model.c_str());
-                }
-
-                delete cc;
+            if (text) {
+                (*texts)[make_model].emplace_back(ji->valuestring, text);
             }
 
             if (is_array) {
@@ -931,6 +909,8 @@ bool CameraConstantsStore::parse_camera_constants_file(Glib::ustring filename_)
                 ji = nullptr;
             }
         }
+
+        free(text);
     }
 
     cJSON_Delete(jsroot);
@@ -943,13 +923,273 @@ parse_error:
     return false;
 }
 
-CameraConstantsStore::CameraConstantsStore() {}
+void CameraConstantsStore::add(const std::string &make_model, CameraConst *cc)
+{
+    const auto ret = mCameraConstants.emplace(make_model, cc);
+
+    if (ret.second) { // entry inserted into map
+        if (settings->verbose > 1) {
+            printf("Add camera constants for \"%s\"\n", make_model.c_str());
+        }
+    } else {
+        // The CameraConst already exist for this camera make/model ->
+        // we merge the values
+        CameraConst *existingcc = ret.first->second;
+
+        // updating the dcraw matrix
+        existingcc->update_dcrawMatrix(cc->get_dcrawMatrix());
+        // deleting all the existing levels, replaced by the new ones
+        existingcc->update_Levels(cc);
+        existingcc->update_Crop(cc);
+        existingcc->update_rawMask(cc);
+        existingcc->update_pdafPattern(cc->get_pdafPattern());
+        existingcc->update_pdafOffset(cc->get_pdafOffset());
+        if (cc->has_globalGreenEquilibration()) {
+            existingcc->update_globalGreenEquilibration(
+                cc->get_globalGreenEquilibration());
+        }
+
+        if (settings->verbose > 1) {
+            printf("Merging camera constants for \"%s\"\n",
+                   make_model.c_str());
+        }
+
+        delete cc;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// startup cache
+//
+// Parsing all the JSON files takes a good fraction of the startup time, while
+// a session typically needs the constants of just a handful of cameras. So
+// the first time the files are parsed, the JSON text of each entry is saved
+// (minified) into a binary index in the cache dir, validated by the size and
+// modification time of the source files. Later sessions just map the index,
+// and parse the entries of a camera only when they are requested.
+//
+// Layout (native byte order, all sizes uint32):
+//   magic, version, number of sources,
+//   for each source: path, size (int64), mtime (int64),
+//   number of cameras,
+//   for each camera: key, number of entries,
+//     for each entry: make_model, JSON text (NUL-terminated)
+// where strings are stored as their size followed by their bytes.
+//-----------------------------------------------------------------------------
+
+namespace {
+
+constexpr uint32_t CACHE_MAGIC = 0x41524343; // "ARCC"
+constexpr uint32_t CACHE_VERSION = 1;
+
+bool get_stamp(const Glib::ustring &fname, int64_t &size, int64_t &mtime)
+{
+    GStatBuf st;
+    if (g_stat(fname.c_str(), &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+class CacheReader {
+public:
+    CacheReader(const char *data, size_t size): pos_(data), end_(data + size)
+    {
+    }
+
+    template <class T> bool get(T &out)
+    {
+        if (size_t(end_ - pos_) < sizeof(T)) {
+            return false;
+        }
+        memcpy(&out, pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+
+    // returns a pointer into the mapped data, the string is NUL-terminated
+    // only if it was written so
+    const char *get_str(uint32_t &len)
+    {
+        if (!get(len) || size_t(end_ - pos_) < len) {
+            return nullptr;
+        }
+        const char *ret = pos_;
+        pos_ += len;
+        return ret;
+    }
+
+    bool get_str(std::string &out)
+    {
+        uint32_t len;
+        const char *s = get_str(len);
+        if (s) {
+            out.assign(s, len);
+        }
+        return s != nullptr;
+    }
+
+private:
+    const char *pos_;
+    const char *end_;
+};
+
+void put_str(std::string &buf, const char *s, uint32_t len)
+{
+    buf.append(reinterpret_cast<const char *>(&len), sizeof(len));
+    buf.append(s, len);
+}
+
+template <class T> void put(std::string &buf, T val)
+{
+    buf.append(reinterpret_cast<const char *>(&val), sizeof(T));
+}
+
+Glib::ustring get_cache_filename()
+{
+    if (Options::cacheBaseDir.empty()) {
+        return "";
+    }
+    return Glib::build_filename(Options::cacheBaseDir, "camconst.cache");
+}
+
+} // namespace
+
+bool CameraConstantsStore::load_cache(const Glib::ustring &fname,
+                                      const std::vector<Glib::ustring> &sources)
+{
+    if (!Glib::file_test(fname, Glib::FILE_TEST_IS_REGULAR)) {
+        return false;
+    }
+
+    GMappedFile *f = g_mapped_file_new(fname.c_str(), FALSE, nullptr);
+    if (!f) {
+        return false;
+    }
+
+    CacheReader rd(g_mapped_file_get_contents(f), g_mapped_file_get_length(f));
+    EntryTexts<const char *> pending;
+
+    const auto check = [&]() -> bool {
+        uint32_t magic, version, n;
+        if (!rd.get(magic) || magic != CACHE_MAGIC || !rd.get(version) ||
+            version != CACHE_VERSION || !rd.get(n) || n != sources.size()) {
+            return false;
+        }
+        for (auto &src : sources) {
+            std::string path;
+            int64_t size, mtime, cur_size, cur_mtime;
+            if (!rd.get_str(path) || path != src.raw() || !rd.get(size) ||
+                !rd.get(mtime) || !get_stamp(src, cur_size, cur_mtime) ||
+                size != cur_size || mtime != cur_mtime) {
+                return false;
+            }
+        }
+        if (!rd.get(n)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            std::string key;
+            uint32_t m;
+            if (!rd.get_str(key) || !rd.get(m)) {
+                return false;
+            }
+            auto &entries = pending[key];
+            for (uint32_t j = 0; j < m; ++j) {
+                std::string make_model;
+                uint32_t len;
+                if (!rd.get_str(make_model)) {
+                    return false;
+                }
+                const char *text = rd.get_str(len);
+                if (!text || len == 0 || text[len - 1] != '\0') {
+                    return false;
+                }
+                entries.emplace_back(make_model, text);
+            }
+        }
+        return true;
+    };
+
+    if (!check()) {
+        g_mapped_file_unref(f);
+        return false;
+    }
+
+    mCacheFile = f;
+    mPending.swap(pending);
+
+    if (settings->verbose) {
+        printf("Camera constants: %d cameras indexed from %s\n",
+               int(mPending.size()), fname.c_str());
+    }
+
+    return true;
+}
+
+void CameraConstantsStore::save_cache(const Glib::ustring &fname,
+                                      const std::vector<Glib::ustring> &sources,
+                                      const EntryTexts<std::string> &texts)
+{
+    std::string buf;
+    put(buf, CACHE_MAGIC);
+    put(buf, CACHE_VERSION);
+    put(buf, uint32_t(sources.size()));
+    for (auto &src : sources) {
+        int64_t size, mtime;
+        if (!get_stamp(src, size, mtime)) {
+            return;
+        }
+        put_str(buf, src.c_str(), src.bytes());
+        put(buf, size);
+        put(buf, mtime);
+    }
+    put(buf, uint32_t(texts.size()));
+    for (auto &p : texts) {
+        put_str(buf, p.first.c_str(), p.first.size());
+        put(buf, uint32_t(p.second.size()));
+        for (auto &e : p.second) {
+            put_str(buf, e.first.c_str(), e.first.size());
+            put_str(buf, e.second.c_str(), e.second.size() + 1);
+        }
+    }
+
+    // write to a temporary file first, so that concurrent sessions never see
+    // a partial cache
+    g_mkdir_with_parents(Glib::path_get_dirname(fname).c_str(), 0777);
+    std::string tmpl = fname.raw() + ".XXXXXX";
+    const int fd = g_mkstemp(&tmpl[0]);
+    if (fd < 0) {
+        return;
+    }
+    g_close(fd, nullptr);
+    FILE *out = g_fopen(tmpl.c_str(), "wb");
+    if (!out) {
+        g_remove(tmpl.c_str());
+        return;
+    }
+    const bool ok = fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+    if (fclose(out) == 0 && ok) {
+        g_remove(fname.c_str());
+        if (g_rename(tmpl.c_str(), fname.c_str()) == 0) {
+            return;
+        }
+    }
+    g_remove(tmpl.c_str());
+}
+
+CameraConstantsStore::CameraConstantsStore(): mCacheFile(nullptr) {}
 
 CameraConstantsStore::~CameraConstantsStore()
 {
     for (auto &p : mCameraConstants) {
         delete p.second;
     }
+    if (mCacheFile) {
+        g_mapped_file_unref(mCacheFile);
+    }
 }
 
 void CameraConstantsStore::init(Glib::ustring baseDir,
@@ -968,10 +1208,11 @@ void CameraConstantsStore::init(Glib::ustring baseDir,
     // note that the order is relevant, later files ones override earlier ones
     static const char *builtin_files[] = {"dcraw.json", "rt.json",
                                           "camconst.json", "cammatrices.json"};
+    std::vector<Glib::ustring> sources;
     for (size_t i = 0; i < sizeof(builtin_files) / sizeof(const char *); ++i) {
         Glib::ustring f(Glib::build_filename(baseDir, builtin_files[i]));
         if (Glib::file_test(f, Glib::FILE_TEST_EXISTS)) {
-            parse_camera_constants_file(f);
+            sources.push_back(f);
         }
     }
 
@@ -979,7 +1220,26 @@ void CameraConstantsStore::init(Glib::ustring baseDir,
         Glib::build_filename(userSettingsDir, "camconst.json"));
 
     if (Glib::file_test(userFile, Glib::FILE_TEST_EXISTS)) {
-        parse_camera_constants_file(userFile);
+        sources.push_back(userFile);
+    }
+
+    MyMutex::MyLock lock(mMutex);
+
+    const Glib::ustring cache_fname = get_cache_filename();
+    if (!cache_fname.empty() && load_cache(cache_fname, sources)) {
+        return;
+    }
+
+    EntryTexts<std::string> texts;
+    bool ok = true;
+    for (auto &f : sources) {
+        ok = parse_camera_constants_file(f, cache_fname.empty() ? nullptr
+                                                                : &texts) &&
+             ok;
+    }
+
+    if (ok && !cache_fname.empty()) {
+        save_cache(cache_fname, sources, texts);
     }
 }
 
@@ -995,14 +1255,35 @@ CameraConst *CameraConstantsStore::get(const char make[], const char model[])
     key += " ";
     key += model;
     key = key.uppercase();
+
+    MyMutex::MyLock lock(mMutex);
+
     std::map<std::string, CameraConst *>::iterator it;
     it = mCameraConstants.find(key);
 
-    if (it == mCameraConstants.end()) {
+    if (it != mCameraConstants.end()) {
+        return it->second;
+    }
+
+    const auto p = mPending.find(key);
+    if (p == mPending.end()) {
         return nullptr;
     }
 
-    return it->second;
+    for (auto &e : p->second) {
+        cJSON *js = cJSON_Parse(e.second);
+        CameraConst *cc =
+            js ? CameraConst::parseEntry((void *)js, e.first.c_str())
+               : nullptr;
+        cJSON_Delete(js);
+        if (cc) {
+            add(key, cc);
+        }
+    }
+    mPending.erase(p);
+
+    it = mCameraConstants.find(key);
+    return it != mCameraConstants.end() ? it->second : nullptr;
 }
 
 } // namespace rtengine
@@ -4,9 +4,13 @@
  */
 #pragma once
 
+#include "../rtgui/threadutils.h"
 #include <array>
 #include <glibmm.h>
 #include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace rtengine {
 
@@ -62,10 +66,27 @@ public:
 
 class CameraConstantsStore {
 private:
+    // for each camera, the make_model and the JSON text of each of its
+    // entries, in the order in which they must be merged
+    template <class T>
+    using EntryTexts =
+        std::map<std::string, std::vector<std::pair<std::string, T>>>;
+
     std::map<std::string, CameraConst *> mCameraConstants;
+    // entries read from the startup cache, parsed only when first requested
+    EntryTexts<const char *> mPending;
+    GMappedFile *mCacheFile;
+    MyMutex mMutex;
 
     CameraConstantsStore();
-    bool parse_camera_constants_file(Glib::ustring filename);
+    bool parse_camera_constants_file(Glib::ustring filename,
+                                     EntryTexts<std::string> *texts);
+    void add(const std::string &make_model, CameraConst *cc);
+    bool load_cache(const Glib::ustring &fname,
+                    const std::vector<Glib::ustring> &sources);
+    void save_cache(const Glib::ustring &fname,
+                    const std::vector<Glib::ustring> &sources,
+                    const EntryTexts<std::string> &texts);
 
 public:
     ~CameraConstantsStore();
@@ -35,6 +35,16 @@ extern const Settings *settings;
 
 namespace {
 
+// options.clutCacheSize counts CLUTs, the cache budget allows for that many
+// level 12 ones (the most common size)
+constexpr std::size_t HALDCLUT_REFERENCE_COST = 144 * 144 * 144 * 4 * 2;
+
+#ifdef ART_USE_CTL
+// the memory used by a CTL interpreter can't be measured, scripts are
+// counted as 1 MiB each
+constexpr std::size_t CTL_ENTRY_COST = 1 << 20;
+#endif // ART_USE_CTL
+
 bool loadFile(const Glib::ustring &filename,
               const Glib::ustring &working_color_space,
               AlignedBuffer<std::uint16_t> &clut_image,
@@ -164,6 +174,13 @@ Glib::ustring rtengine::HaldCLUT::getFilename() const { return clut_filename; }
 
 Glib::ustring rtengine::HaldCLUT::getProfile() const { return clut_profile; }
 
+std::size_t rtengine::HaldCLUT::getMemoryUsage() const
+{
+    // clut_level is already squared by load(), see loadFile() for the layout
+    const std::size_t l = clut_level;
+    return (l * l * l * 4 + 4) * sizeof(std::uint16_t);
+}
+
 void rtengine::HaldCLUT::getRGB(float strength, std::size_t line_size,
                                 const float *r, const float *g, const float *b,
                                 float *out_rgbx) const
@@ -436,7 +453,6 @@ rtengine::CLUTStore &rtengine::CLUTStore::getInstance()
 std::shared_ptr<rtengine::HaldCLUT>
 rtengine::CLUTStore::getHaldClut(const Glib::ustring &filename) const
 {
-    MyMutex::MyLock lock(mutex_);
     std::shared_ptr<rtengine::HaldCLUT> result;
 
     const Glib::ustring full_filename =
@@ -444,12 +460,19 @@ rtengine::CLUTStore::getHaldClut(const Glib::ustring &filename) const
             ? Glib::ustring(Glib::build_filename(options.clutsDir, filename))
             : filename;
 
+    if (cache.get(full_filename, result)) {
+        return result;
+    }
+
+    // check again under the lock, so that the same CLUT is loaded only once
+    MyMutex::MyLock lock(mutex_);
     if (!cache.get(full_filename, result)) {
         std::unique_ptr<rtengine::HaldCLUT> clut(new rtengine::HaldCLUT);
 
         if (clut->load(full_filename)) {
+            const std::size_t cost = clut->getMemoryUsage();
             result = std::move(clut);
-            cache.insert(full_filename, result);
+            cache.insert(full_filename, result, cost);
         }
     }
 
@@ -970,7 +993,7 @@ rtengine::CLUTStore::getCTLLut(const Glib::ustring &filename, int num_threads,
             result.params = params;
             result.colorspace = colorspace;
             result.lut_dim = lut_dim;
-            ctl_cache_.set(key, result);
+            ctl_cache_.set(key, result, CTL_ENTRY_COST);
         } else {
             intp = result.intp;
             params = result.params;
@@ -1034,14 +1057,14 @@ inline float CTL_shaper_func(float a, bool inv)
 } // namespace
 
 rtengine::CLUTStore::CLUTStore()
-    : cache(options.clutCacheSize)
+    : cache(options.clutCacheSize * HALDCLUT_REFERENCE_COST)
 #ifdef ART_USE_OCIO
       ,
       ocio_cache_(options.clutCacheSize)
 #endif // ART_USE_OCIO
 #ifdef ART_USE_CTL
       ,
-      ctl_cache_(options.clutCacheSize * 4)
+      ctl_cache_(options.clutCacheSize * 4 * CTL_ENTRY_COST)
 #endif // ART_USE_CTL
 {
 #ifdef ART_USE_CTL
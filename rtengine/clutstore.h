@@ -25,6 +25,7 @@
 
 #include "alignedbuffer.h"
 #include "cache.h"
+#include "concurrentcache.h"
 #include "clutparams.h"
 #include "iccstore.h"
 #include "imagefloat.h"
@@ -54,6 +55,7 @@ public:
 
     Glib::ustring getFilename() const;
     Glib::ustring getProfile() const;
+    std::size_t getMemoryUsage() const;
 
     void getRGB(float strength, std::size_t line_size, const float *r,
                 const float *g, const float *b, float *out_rgbx) const;
@@ -112,7 +114,7 @@ public:
 private:
     CLUTStore();
 
-    mutable Cache<Glib::ustring, std::shared_ptr<HaldCLUT>> cache;
+    mutable ConcurrentCache<Glib::ustring, std::shared_ptr<HaldCLUT>> cache;
 #ifdef ART_USE_OCIO
     typedef std::pair<OCIO::ConstProcessorRcPtr, std::string> OCIOCacheEntry;
     mutable Cache<Glib::ustring, OCIOCacheEntry> ocio_cache_;
@@ -126,7 +128,7 @@ private:
         Glib::ustring colorspace;
         int lut_dim;
     };
-    mutable Cache<std::string, CTLCacheEntry> ctl_cache_;
+    mutable ConcurrentCache<std::string, CTLCacheEntry> ctl_cache_;
     LUTf ctl_shaper_lut_;
     LUTf ctl_shaper_lut_inv_;
 #endif // ART_USE_CTL
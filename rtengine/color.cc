@@ -20,6 +20,7 @@
 #include "color.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
+#include "lcmstransform.h"
 #include "linalgebra.h"
 #include "mytime.h"
 #include "opthelper.h"
@@ -364,19 +365,21 @@ void Color::rgb2lab01(const Glib::ustring &profile,
         return;
     }
 
-    lcmsMutex->lock();
     cmsHPROFILE labprof = cmsCreateLab4Profile(nullptr);
-    cmsHTRANSFORM hTransform = cmsCreateTransform(
+    LCMSTransform hTransform = LCMSTransform::create(
         oprof, TYPE_RGB_FLT, labprof, TYPE_Lab_DBL,
-        INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
+        INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
     cmsCloseProfile(labprof);
-    lcmsMutex->unlock();
+
+    if (!hTransform) {
+        LAB_l = LAB_a = LAB_b = 0.f;
+        return;
+    }
 
     float inbuf[3] = {r, g, b};
     double outbuf[3];
 
-    cmsDoTransform(hTransform, inbuf, outbuf, 1);
-    cmsDeleteTransform(hTransform);
+    hTransform(inbuf, outbuf, 1);
 
     LAB_l = outbuf[0];
     LAB_a = outbuf[1];
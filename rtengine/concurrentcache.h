@@ -0,0 +1,255 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "../rtgui/threadutils.h"
+#include "cache.h"
+#include "noncopyable.h"
+
+namespace rtengine {
+
+namespace cache_helper {
+
+template <class K>
+inline std::size_t shard_hash(const K &key, std::true_type, std::false_type)
+{
+    return std::hash<K>()(key);
+}
+
+// e.g. Glib::ustring
+template <class K>
+inline std::size_t shard_hash(const K &key, std::false_type, std::true_type)
+{
+    return std::hash<std::string>()(static_cast<std::string>(key));
+}
+
+template <class K>
+inline std::size_t shard_hash(const K &, std::false_type, std::false_type)
+{
+    return 0;
+}
+
+template <class K> inline std::size_t shard_hash(const K &key)
+{
+    return shard_hash(
+        key, has_hash<K>(),
+        std::integral_constant<bool, !has_hash<K>::value &&
+                                         std::is_convertible<
+                                             K, std::string>::value>());
+}
+
+} // namespace cache_helper
+
+/**
+ * Cache for data shared by concurrent pipelines (e.g. during parallel batch
+ * export), limited by the total cost of the entries (usually the memory they
+ * use, in bytes) instead of their number.
+ *
+ * The keys are spread over independent shards. Each shard publishes an
+ * immutable snapshot of its entries, which set()/remove() replace
+ * (copy-on-write), so get() never waits for other readers or for writers:
+ * it only loads the current snapshot and stamps the entry as used. Writers
+ * to the same shard are serialized, which is fine since the entries are
+ * expensive to build and updates are rare.
+ *
+ * When the total cost exceeds the capacity, the least recently used entries
+ * are evicted. The entry just added is always kept, even if its cost alone
+ * exceeds the capacity.
+ */
+template <class K, class V> class ConcurrentCache: public NonCopyable {
+public:
+    explicit ConcurrentCache(std::size_t capacity, unsigned num_shards = 8)
+        : capacity_(capacity), cost_(0), clock_(0),
+          shards_(std::max(num_shards, 1u))
+    {
+        for (auto &s : shards_) {
+            s.data = std::make_shared<const Map>();
+        }
+    }
+
+    bool get(const K &key, V &value) const
+    {
+        const std::shared_ptr<const Map> data =
+            std::atomic_load(&shard(key).data);
+        const auto it = data->find(key);
+        if (it == data->end()) {
+            return false;
+        }
+        it->second->stamp.store(++clock_, std::memory_order_relaxed);
+        value = it->second->value;
+        return true;
+    }
+
+    /** adds or replaces the entry for key */
+    void set(const K &key, const V &value, std::size_t cost)
+    {
+        update(key, value, cost, true);
+    }
+
+    /** adds the entry only if key is not present, returns true if added */
+    bool insert(const K &key, const V &value, std::size_t cost)
+    {
+        return update(key, value, cost, false);
+    }
+
+    bool remove(const K &key)
+    {
+        Shard &s = shard(key);
+        MyMutex::MyLock lock(s.mutex);
+        std::shared_ptr<Map> data(new Map(*s.data));
+        const auto it = data->find(key);
+        if (it == data->end()) {
+            return false;
+        }
+        cost_ -= it->second->cost;
+        data->erase(it);
+        std::atomic_store(&s.data, std::shared_ptr<const Map>(data));
+        return true;
+    }
+
+    void clear()
+    {
+        for (auto &s : shards_) {
+            MyMutex::MyLock lock(s.mutex);
+            for (const auto &entry : *s.data) {
+                cost_ -= entry.second->cost;
+            }
+            std::atomic_store(&s.data, std::make_shared<const Map>());
+        }
+    }
+
+    void setCapacity(std::size_t capacity)
+    {
+        capacity_ = capacity;
+        trim(nullptr);
+    }
+
+    std::size_t getCost() const { return cost_; }
+
+private:
+    struct Entry {
+        Entry(const V &v, std::size_t c, std::uint64_t s)
+            : value(v), cost(c), stamp(s)
+        {
+        }
+
+        const V value;
+        const std::size_t cost;
+        mutable std::atomic<std::uint64_t> stamp;
+    };
+
+    using Map = typename std::conditional<
+        cache_helper::has_hash<K>::value,
+        std::unordered_map<K, std::shared_ptr<const Entry>>,
+        std::map<K, std::shared_ptr<const Entry>>>::type;
+
+    struct Shard {
+        MyMutex mutex;
+        std::shared_ptr<const Map> data;
+    };
+
+    Shard &shard(const K &key) const
+    {
+        return shards_[cache_helper::shard_hash(key) % shards_.size()];
+    }
+
+    bool update(const K &key, const V &value, std::size_t cost, bool replace)
+    {
+        std::shared_ptr<const Entry> entry;
+        {
+            Shard &s = shard(key);
+            MyMutex::MyLock lock(s.mutex);
+            std::shared_ptr<Map> data(new Map(*s.data));
+            auto it = data->find(key);
+            if (it != data->end()) {
+                if (!replace) {
+                    return false;
+                }
+                cost_ -= it->second->cost;
+            }
+            entry = std::make_shared<const Entry>(value, cost, ++clock_);
+            (*data)[key] = entry;
+            cost_ += cost;
+            std::atomic_store(&s.data, std::shared_ptr<const Map>(data));
+        }
+        trim(entry.get());
+        return true;
+    }
+
+    // evicts the least recently used entries (other than keep) until the
+    // total cost fits in the capacity
+    void trim(const Entry *keep)
+    {
+        while (cost_ > capacity_) {
+            Shard *victim_shard = nullptr;
+            const K *victim_key = nullptr;
+            std::shared_ptr<const Entry> victim;
+            std::vector<std::shared_ptr<const Map>> snapshots;
+            snapshots.reserve(shards_.size());
+
+            for (auto &s : shards_) {
+                snapshots.push_back(std::atomic_load(&s.data));
+                for (const auto &entry : *snapshots.back()) {
+                    const Entry *e = entry.second.get();
+                    if (e != keep &&
+                        (!victim || e->stamp.load(std::memory_order_relaxed) <
+                                        victim->stamp.load(
+                                            std::memory_order_relaxed))) {
+                        victim_shard = &s;
+                        victim_key = &entry.first;
+                        victim = entry.second;
+                    }
+                }
+            }
+            if (!victim) {
+                break;
+            }
+
+            MyMutex::MyLock lock(victim_shard->mutex);
+            std::shared_ptr<Map> data(new Map(*victim_shard->data));
+            const auto it = data->find(*victim_key);
+            // skip if somebody else already replaced or removed it
+            if (it != data->end() && it->second == victim) {
+                cost_ -= victim->cost;
+                data->erase(it);
+                std::atomic_store(&victim_shard->data,
+                                  std::shared_ptr<const Map>(data));
+            }
+        }
+    }
+
+    std::atomic<std::size_t> capacity_;
+    std::atomic<std::size_t> cost_;
+    mutable std::atomic<std::uint64_t> clock_;
+    mutable std::vector<Shard> shards_;
+};
+
+} // namespace rtengine
@@ -19,9 +19,90 @@
  */
 
 #include "cplx_wavelet_dec.h"
+#include "../rtgui/threadutils.h"
+#include <map>
+#include <unordered_map>
 
 namespace rtengine {
 
+namespace {
+
+class BufferPool {
+public:
+    // smaller buffers are not worth recycling
+    static constexpr size_t MIN_SIZE = 64 * 1024;
+    // maximum number of floats kept in unused buffers
+    static constexpr size_t MAX_FREE = 32 * 1024 * 1024;
+
+    ~BufferPool()
+    {
+        for (auto &p : free_) {
+            delete[] p.second;
+        }
+    }
+
+    float *acquire(size_t n)
+    {
+        if (n < MIN_SIZE) {
+            return new float[n];
+        }
+
+        MyMutex::MyLock lock(mutex_);
+        float *ret = nullptr;
+        size_t size = n;
+        auto it = free_.lower_bound(n);
+        if (it != free_.end() && it->first <= n + n / 4) {
+            size = it->first;
+            ret = it->second;
+            free_.erase(it);
+            free_size_ -= size;
+        } else {
+            ret = new float[n];
+        }
+        in_use_[ret] = size;
+        return ret;
+    }
+
+    void release(float *data)
+    {
+        if (!data) {
+            return;
+        }
+
+        MyMutex::MyLock lock(mutex_);
+        auto it = in_use_.find(data);
+        if (it == in_use_.end()) {
+            delete[] data;
+            return;
+        }
+        const size_t size = it->second;
+        in_use_.erase(it);
+        free_.emplace(size, data);
+        free_size_ += size;
+
+        while (free_size_ > MAX_FREE) {
+            auto largest = std::prev(free_.end());
+            free_size_ -= largest->first;
+            delete[] largest->second;
+            free_.erase(largest);
+        }
+    }
+
+private:
+    MyMutex mutex_;
+    std::multimap<size_t, float *> free_;
+    std::unordered_map<float *, size_t> in_use_;
+    size_t free_size_ = 0;
+};
+
+BufferPool buffer_pool;
+
+} // namespace
+
+float *WaveletBufferPool::acquire(size_t n) { return buffer_pool.acquire(n); }
+
+void WaveletBufferPool::release(float *data) { buffer_pool.release(data); }
+
 wavelet_decomposition::~wavelet_decomposition()
 {
     // for(int i = 0; i <= lvltot; i++) {
@@ -35,7 +116,7 @@ wavelet_decomposition::~wavelet_decomposition()
     delete[] wavfilt_synth;
 
     if (coeff0) {
-        delete[] coeff0;
+        wavelet_free(coeff0);
     }
 }
 
@@ -149,14 +149,14 @@ wavelet_decomposition::wavelet_decomposition(E *src, int width, int height,
 
     lvltot = 0;
     E *buffer[2];
-    buffer[0] = new /*(std::nothrow)*/ E[(m_w / 2 + 1) * (m_h / 2 + 1)];
+    buffer[0] = wavelet_alloc<E>((m_w / 2 + 1) * (m_h / 2 + 1));
 
     // if(buffer[0] == nullptr) {
     //     memoryAllocationFailed = true;
     //     return;
     // }
 
-    buffer[1] = new /*(std::nothrow)*/ E[(m_w / 2 + 1) * (m_h / 2 + 1)];
+    buffer[1] = wavelet_alloc<E>((m_w / 2 + 1) * (m_h / 2 + 1));
 
     // if(buffer[1] == nullptr) {
     //     memoryAllocationFailed = true;
@@ -192,7 +192,7 @@ wavelet_decomposition::wavelet_decomposition(E *src, int width, int height,
     }
 
     coeff0 = buffer[bufferindex ^ 1];
-    delete[] buffer[bufferindex];
+    wavelet_free(buffer[bufferindex]);
 }
 
 template <typename E>
@@ -209,7 +209,7 @@ void wavelet_decomposition::reconstruct(E *dst, const float blend)
         int width = wavelet_decomp[1]->m_w;
         int height = wavelet_decomp[1]->m_h;
 
-        E *tmpHi = new /*(std::nothrow)*/ E[width * height];
+        E *tmpHi = wavelet_alloc<E>(width * height);
 
         // if(tmpHi == nullptr) {
         //     memoryAllocationFailed = true;
@@ -226,7 +226,7 @@ void wavelet_decomposition::reconstruct(E *dst, const float blend)
             wavelet_decomp[lvl] = nullptr;
         }
 
-        delete[] tmpHi;
+        wavelet_free(tmpHi);
     }
 
     int width = wavelet_decomp[0]->m_w;
@@ -247,7 +247,7 @@ void wavelet_decomposition::reconstruct(E *dst, const float blend)
     //     }
     // }
 
-    E *tmpHi = new /*(std::nothrow)*/ E[width * height];
+    E *tmpHi = wavelet_alloc<E>(width * height);
 
     // if(tmpHi == nullptr) {
     //     memoryAllocationFailed = true;
@@ -267,10 +267,10 @@ void wavelet_decomposition::reconstruct(E *dst, const float blend)
     //     delete[] tmpLo;
     // }
 
-    delete[] tmpHi;
+    wavelet_free(tmpHi);
     delete wavelet_decomp[0];
     wavelet_decomp[0] = nullptr;
-    delete[] coeff0;
+    wavelet_free(coeff0);
     coeff0 = nullptr;
 }
 
@@ -30,6 +30,32 @@
 
 namespace rtengine {
 
+/**
+ * Pool of the buffers used by the wavelet decompositions. Denoise and local
+ * contrast build and destroy decompositions of the same sizes over and over
+ * (e.g. once per tile and channel), so recycling the large buffers saves the
+ * cost of the allocations and of the page faults on fresh memory.
+ */
+class WaveletBufferPool {
+public:
+    static float *acquire(size_t n);
+    static void release(float *data);
+};
+
+template <typename T> T *wavelet_alloc(size_t n) { return new T[n]; }
+
+template <typename T> void wavelet_free(T *data) { delete[] data; }
+
+template <> inline float *wavelet_alloc<float>(size_t n)
+{
+    return WaveletBufferPool::acquire(n);
+}
+
+template <> inline void wavelet_free<float>(float *data)
+{
+    WaveletBufferPool::release(data);
+}
+
 template <typename T> class wavelet_level {
 
     // level of decomposition
@@ -170,7 +196,7 @@ public:
 
 template <typename T> T **wavelet_level<T>::create(int n)
 {
-    T *data = new /*(std::nothrow)*/ T[3 * n];
+    T *data = wavelet_alloc<T>(3 * n);
 
     // if(data == nullptr) {
     //     bigBlockOfMemory = false;
@@ -199,7 +225,7 @@ template <typename T> void wavelet_level<T>::destroy(T **subbands)
 {
     if (subbands) {
         // if(bigBlockOfMemory) {
-        delete[] subbands[1];
+        wavelet_free(subbands[1]);
         // } else {
         //     for(int j = 1; j < 4; j++) {
         //         if(subbands[j] != nullptr) {
@@ -339,8 +365,7 @@ void wavelet_level<T>::AnalysisFilterSubsampHorizontal(
      * the input pixel, and skipping 'skip' pixels between taps
      * Output is subsampled by two
      */
-    // calculate coefficients
-    for (int i = 0; i < srcwidth; i += 2) {
+    const auto coeffs = [&](int i) -> void {
         float lo = 0.f, hi = 0.f;
 
         if (LIKELY(i > skip * taps && i < srcwidth - skip * taps)) { // bulk
@@ -360,6 +385,31 @@ void wavelet_level<T>::AnalysisFilterSubsampHorizontal(
 
         dstLo[row * dstwidth + ((i / 2))] = lo;
         dstHi[row * dstwidth + ((i / 2))] = hi;
+    };
+
+    // calculate coefficients
+    int i = 0;
+#ifdef ART_SIMD
+    for (; i <= skip * taps && i < srcwidth; i += 2) {
+        coeffs(i);
+    }
+    // bulk, 4 output coefficients at a time (reading every other pixel)
+    for (; i + 7 < srcwidth - skip * taps; i += 8) {
+        vfloat lov = ZEROV;
+        vfloat hiv = ZEROV;
+
+        for (int j = 0; j < taps; j++) {
+            vfloat srcv = LC2VFU(srcbuffer[i + skip * (offset - j)]);
+            lov += F2V(filterLo[j]) * srcv; // lopass channel
+            hiv += F2V(filterHi[j]) * srcv; // hipass channel
+        }
+
+        STVFU(dstLo[row * dstwidth + i / 2], lov);
+        STVFU(dstHi[row * dstwidth + i / 2], hiv);
+    }
+#endif
+    for (; i < srcwidth; i += 2) {
+        coeffs(i);
     }
 }
 
@@ -535,6 +585,42 @@ void wavelet_level<T>::SynthesisFilterSubsampHorizontal(
             dst[k * dstwidth + i] = tot;
         }
 
+#ifdef ART_SIMD
+        // bulk, 8 output pixels at a time: the even and odd ones use
+        // alternate filter taps on the same 4 consecutive source pixels
+        if (i < dstwidth - skip * taps && ((i + shift) & 1)) {
+            float tot = 0.f;
+            int i_src = (i + shift) / 2;
+
+            for (int j = 1, l = 0; j < taps; j += 2, l += skip) {
+                tot += ((filterLo[j] * srcLo[k * srcwidth + i_src - l] +
+                         filterHi[j] * srcHi[k * srcwidth + i_src - l]));
+            }
+
+            dst[k * dstwidth + i] = tot;
+            ++i;
+        }
+
+        for (; i + 7 < dstwidth - skip * taps; i += 8) {
+            const int i_src = k * srcwidth + (i + shift) / 2;
+            vfloat evenv = ZEROV;
+            vfloat oddv = ZEROV;
+
+            for (int j = 0, l = 0; j < taps; j += 2, l += skip) {
+                evenv += F2V(filterLo[j]) * LVFU(srcLo[i_src - l]) +
+                         F2V(filterHi[j]) * LVFU(srcHi[i_src - l]);
+            }
+
+            for (int j = 1, l = 0; j < taps; j += 2, l += skip) {
+                oddv += F2V(filterLo[j]) * LVFU(srcLo[i_src - l]) +
+                        F2V(filterHi[j]) * LVFU(srcHi[i_src - l]);
+            }
+
+            STVFU(dst[k * dstwidth + i], _mm_unpacklo_ps(evenv, oddv));
+            STVFU(dst[k * dstwidth + i + 4], _mm_unpackhi_ps(evenv, oddv));
+        }
+#endif
+
         for (; i < min(dstwidth - skip * taps, dstwidth); i++) {
             float tot = 0.f;
             // TODO: this is correct only if skip=1; otherwise, want to work
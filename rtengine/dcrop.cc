@@ -188,6 +188,7 @@ void Crop::update(int todo)
     parent->ipf.setViewport(0, 0, -1, -1);
     parent->ipf.setOutputHistograms(nullptr, nullptr, nullptr);
     parent->ipf.setShowSharpeningMask(parent->sharpMask);
+    parent->ipf.setCheckpoints(&checkpoints_);
 
     Imagefloat *baseCrop = origCrop;
 
@@ -44,6 +44,7 @@ protected:
     Imagefloat *denoiseCrop;
     Imagefloat *bufs_[3];
     std::array<bool, 4> pipeline_stop_;
+    PipelineCheckpoints checkpoints_;
     Image8
         *cropImg; // "one chunk" allocation ; displayed image in monitor color
                   // space, showing the output profile as well (soft-proofing
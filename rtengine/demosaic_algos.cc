@@ -1805,6 +1805,51 @@ void RawImageSource::igv_interpolate(int winw, int winh)
 }
 #endif
 
+// Superpixel binning for previews: one RGB value per 2x2 Bayer or 3x3
+// X-Trans block (both contain all three colours), averaging the sites of each
+// colour. The full resolution demosaic is deferred until something needs it,
+// see demosaic_full().
+void RawImageSource::bin_demosaic()
+{
+    const bool xtrans = ri->getSensorType() == ST_FUJI_XTRANS;
+    const int f = xtrans ? 3 : 2;
+    const int bw = W / f;
+    const int bh = H / f;
+
+    bin_red(bw, bh);
+    bin_green(bw, bh);
+    bin_blue(bw, bh);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < bh; ++i) {
+        for (int j = 0; j < bw; ++j) {
+            float sum[3] = {0.f, 0.f, 0.f};
+            int cnt[3] = {0, 0, 0};
+
+            for (int y = i * f; y < (i + 1) * f; ++y) {
+                for (int x = j * f; x < (j + 1) * f; ++x) {
+                    unsigned c = xtrans ? ri->XTRANSFC(y, x) : FC(y, x);
+                    if (c == 3) { // second green
+                        c = 1;
+                    }
+                    sum[c] += rawData[y][x];
+                    ++cnt[c];
+                }
+            }
+
+            bin_red[i][j] = cnt[0] ? sum[0] / cnt[0] : 0.f;
+            bin_green[i][j] = cnt[1] ? sum[1] / cnt[1] : 0.f;
+            bin_blue[i][j] = cnt[2] ? sum[2] / cnt[2] : 0.f;
+        }
+    }
+
+    MyMutex::MyLock lock(lazyDemosaicMutex);
+    bin_factor = f;
+    bin_pending = true;
+}
+
 void RawImageSource::nodemosaic(bool bw)
 {
     red(W, H);
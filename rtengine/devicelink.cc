@@ -0,0 +1,205 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "devicelink.h"
+#include "concurrentcache.h"
+#include "opthelper.h"
+#include "rt_math.h"
+#include "settings.h"
+#include <cmath>
+#include <utility>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+// Each node holds 4 floats (r, g, b and padding), so that it can be fetched
+// with a single vector load. With 49 nodes per side the error of the
+// interpolation stays below 8-bit precision for the usual printer profiles.
+constexpr int LUT_SIZE = 49;
+constexpr int LUT_DR = 4;
+constexpr int LUT_DG = 4 * LUT_SIZE;
+constexpr int LUT_DB = 4 * LUT_SIZE * LUT_SIZE;
+
+// pixels going through the original transform are collected in chunks of
+// this size
+constexpr int FALLBACK_CHUNK = 64;
+
+constexpr size_t LUT_BYTES =
+    4 * LUT_SIZE * LUT_SIZE * LUT_SIZE * sizeof(float);
+
+// total size of the cached tables, in bytes (about 1.8 MB each)
+constexpr size_t LUT_CACHE_SIZE = 16 << 20;
+
+ConcurrentCache<std::string, std::shared_ptr<const DeviceLinkLUT>>
+    lut_cache(LUT_CACHE_SIZE);
+
+// tetrahedral interpolation in the cell starting at p, with f the position
+// inside it
+inline void tetra_interpolate(const float *p, const float f[3], float *out)
+{
+    constexpr int step[3] = {LUT_DR, LUT_DG, LUT_DB};
+
+    // visit the axes from the largest to the smallest fractional part
+    int a0 = 0, a1 = 1, a2 = 2;
+    if (f[a0] < f[a1]) {
+        std::swap(a0, a1);
+    }
+    if (f[a1] < f[a2]) {
+        std::swap(a1, a2);
+    }
+    if (f[a0] < f[a1]) {
+        std::swap(a0, a1);
+    }
+    const float *p1 = p + step[a0];
+    const float *p2 = p1 + step[a1];
+    const float *p3 = p2 + step[a2];
+    const float w0 = 1.f - f[a0];
+    const float w1 = f[a0] - f[a1];
+    const float w2 = f[a1] - f[a2];
+    const float w3 = f[a2];
+
+#ifdef ART_SIMD
+    const vfloat res = F2V(w0) * LVF(p[0]) + F2V(w1) * LVF(p1[0]) +
+                       F2V(w2) * LVF(p2[0]) + F2V(w3) * LVF(p3[0]);
+    out[0] = res[0];
+    out[1] = res[1];
+    out[2] = res[2];
+#else
+    for (int c = 0; c < 3; ++c) {
+        out[c] = w0 * p[c] + w1 * p1[c] + w2 * p2[c] + w3 * p3[c];
+    }
+#endif
+}
+
+} // namespace
+
+std::shared_ptr<const DeviceLinkLUT>
+DeviceLinkLUT::get(const LCMSTransform &xform, bool linear_input)
+{
+    std::shared_ptr<const DeviceLinkLUT> ret;
+    if (!xform || xform.key().empty() || settings->proofing_exact_apply) {
+        return ret;
+    }
+
+    const std::string key = xform.key() + (linear_input ? "/lin" : "/std");
+    if (!lut_cache.get(key, ret)) {
+        DeviceLinkLUT *lut = new DeviceLinkLUT(xform, linear_input);
+        ret.reset(lut);
+        if (lut->lut_.isEmpty()) {
+            ret.reset();
+        } else {
+            lut_cache.set(key, ret, LUT_BYTES);
+        }
+    }
+    return ret;
+}
+
+DeviceLinkLUT::DeviceLinkLUT(const LCMSTransform &xform, bool linear_input)
+    : xform_(xform), linear_(linear_input)
+{
+    constexpr int N = LUT_SIZE;
+    if (!lut_.resize(4 * N * N * N)) {
+        return;
+    }
+
+    const auto node_value = [=](int i) -> float {
+        const float v = float(i) / (N - 1);
+        return linear_input ? SQR(v) : v;
+    };
+
+    // one row of nodes along r at a time
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
+    for (int ib = 0; ib < N; ++ib) {
+        for (int ig = 0; ig < N; ++ig) {
+            float in[3 * N];
+            float out[3 * N];
+            for (int ir = 0; ir < N; ++ir) {
+                in[3 * ir] = node_value(ir);
+                in[3 * ir + 1] = node_value(ig);
+                in[3 * ir + 2] = node_value(ib);
+            }
+            xform_(in, out, N);
+            float *p = lut_.data + 4 * ((ib * N + ig) * N);
+            for (int ir = 0; ir < N; ++ir, p += 4) {
+                p[0] = out[3 * ir];
+                p[1] = out[3 * ir + 1];
+                p[2] = out[3 * ir + 2];
+                p[3] = 0.f;
+            }
+        }
+    }
+}
+
+void DeviceLinkLUT::operator()(const float *in, float *out, int n) const
+{
+    constexpr float scale = LUT_SIZE - 1;
+
+    float fb_in[3 * FALLBACK_CHUNK];
+    float fb_out[3 * FALLBACK_CHUNK];
+    int fb_idx[FALLBACK_CHUNK];
+    int fb_n = 0;
+
+    const auto flush = [&]() -> void {
+        xform_(fb_in, fb_out, fb_n);
+        for (int k = 0; k < fb_n; ++k) {
+            float *o = out + 3 * fb_idx[k];
+            o[0] = fb_out[3 * k];
+            o[1] = fb_out[3 * k + 1];
+            o[2] = fb_out[3 * k + 2];
+        }
+        fb_n = 0;
+    };
+
+    for (int x = 0; x < n; ++x) {
+        const float *v = in + 3 * x;
+        // written so that NaNs are also out of range
+        if (!(v[0] >= 0.f && v[0] <= 1.f && v[1] >= 0.f && v[1] <= 1.f &&
+              v[2] >= 0.f && v[2] <= 1.f)) {
+            fb_in[3 * fb_n] = v[0];
+            fb_in[3 * fb_n + 1] = v[1];
+            fb_in[3 * fb_n + 2] = v[2];
+            fb_idx[fb_n] = x;
+            if (++fb_n == FALLBACK_CHUNK) {
+                flush();
+            }
+            continue;
+        }
+
+        int idx[3];
+        float f[3];
+        for (int c = 0; c < 3; ++c) {
+            const float pos = (linear_ ? std::sqrt(v[c]) : v[c]) * scale;
+            idx[c] = std::min(int(pos), LUT_SIZE - 2);
+            f[c] = pos - idx[c];
+        }
+        tetra_interpolate(
+            lut_.data + 4 * ((idx[2] * LUT_SIZE + idx[1]) * LUT_SIZE + idx[0]),
+            f, out + 3 * x);
+    }
+
+    if (fb_n) {
+        flush();
+    }
+}
+
+} // namespace rtengine
@@ -0,0 +1,62 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "alignedbuffer.h"
+#include "lcmstransform.h"
+#include "noncopyable.h"
+#include <memory>
+
+namespace rtengine {
+
+/**
+ * Device link table sampling an RGB float to RGB float transform (typically
+ * the soft-proofing monitor transform, which chains the output, the printer
+ * and the monitor profiles) on a lattice over [0,1]^3, applied with
+ * tetrahedral interpolation.
+ *
+ * The tables are kept in a process-wide cache keyed on
+ * LCMSTransform::key(), so they are built only once per combination of
+ * profiles, intents and flags. Pixels outside of [0,1]^3 go through the
+ * original transform.
+ */
+class DeviceLinkLUT: public NonCopyable {
+public:
+    /**
+     * Returns the table for xform, or nullptr if xform can't be shared or if
+     * Settings::proofing_exact_apply is set. If linear_input is true, the
+     * nodes are spaced evenly in sqrt(value) instead of value, to get denser
+     * samples in the shadows.
+     */
+    static std::shared_ptr<const DeviceLinkLUT> get(const LCMSTransform &xform,
+                                                     bool linear_input);
+
+    /** same as xform(in, out, n), on n interleaved RGB triplets */
+    void operator()(const float *in, float *out, int n) const;
+
+private:
+    DeviceLinkLUT(const LCMSTransform &xform, bool linear_input);
+
+    LCMSTransform xform_;
+    bool linear_;
+    AlignedBuffer<float> lut_;
+};
+
+} // namespace rtengine
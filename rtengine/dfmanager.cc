@@ -137,15 +137,24 @@ void DFInfo::updateRawImage()
     typedef unsigned int acc_t;
 
     if (!pathNames.empty()) {
+        // files are indexed from their Exif tags without decoding them, so
+        // skip the ones that turn out not to be loadable raws. The first one
+        // that loads is used also for extra pixels information
+        // (width,height, shutter, filters etc.. )
         std::list<Glib::ustring>::iterator iName = pathNames.begin();
-        ri = new RawImage(
-            *iName); // First file used also for extra pixels information
-                     // (width,height, shutter, filters etc.. )
 
-        if (ri->loadRaw(true)) {
+        for (; iName != pathNames.end(); ++iName) {
+            ri = new RawImage(*iName);
+
+            if (!ri->loadRaw(true)) {
+                break;
+            }
+
             delete ri;
             ri = nullptr;
-        } else {
+        }
+
+        if (ri) {
             int H = ri->get_height();
             int W = ri->get_width();
             ri->compress_image(0);
@@ -405,13 +414,6 @@ DFInfo *DFManager::addFileInfo(const Glib::ustring &filename, bool pool)
             return nullptr;
         }
 
-        RawImage ri(filename);
-        int res = ri.loadRaw(false); // Read information about shot
-
-        if (res != 0) {
-            return nullptr;
-        }
-
         dfList_t::iterator iter;
 
         if (!pool) {
@@ -420,7 +422,12 @@ DFInfo *DFManager::addFileInfo(const Glib::ustring &filename, bool pool)
             return &(iter->second);
         }
 
-        FramesData idata(filename);
+        FramesData idata(filename, FramesData::Tags::BASIC);
+
+        if (!idata.hasExif()) {
+            return nullptr;
+        }
+
         /* Files are added in the map, divided by same maker/model,ISO and
          * shutter*/
         std::string key(
@@ -132,29 +132,10 @@ void RawImageSource::dual_demosaic_RT(
         case procparams::RAWParams::BayerSensor::Method::DCBBILINEAR:
             bayer_bilinear_demosaic(blend, rawData, red, green, blue);
             break;
-        default: {
-            array2D<float> &redTmp = L; // L is not needed anymore => reuse it
-            array2D<float> greenTmp(winw, winh);
-            array2D<float> blueTmp(winw, winh);
-            vng4_demosaic(rawData, redTmp, greenTmp, blueTmp);
-#ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic, 16)
-#endif
-            for (int i = 0; i < winh; ++i) {
-                // the following is split into 3 loops intentionally to avoid
-                // cache conflicts on CPUs with only 4-way cache
-                for (int j = 0; j < winw; ++j) {
-                    red[i][j] = intp(blend[i][j], red[i][j], redTmp[i][j]);
-                }
-                for (int j = 0; j < winw; ++j) {
-                    green[i][j] =
-                        intp(blend[i][j], green[i][j], greenTmp[i][j]);
-                }
-                for (int j = 0; j < winw; ++j) {
-                    blue[i][j] = intp(blend[i][j], blue[i][j], blueTmp[i][j]);
-                }
-            }
-        } break;
+        default:
+            L.free(); // not needed anymore
+            vng4_demosaic_blend(blend, rawData, red, green, blue);
+            break;
         }
     } else {
         fast_xtrans_interpolate_blend(blend, rawData, red, green, blue);
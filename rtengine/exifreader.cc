@@ -0,0 +1,287 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "exifreader.h"
+#include <cstring>
+#include <glib/gstdio.h>
+
+namespace rtengine {
+
+namespace {
+
+constexpr uint16_t TIFF_ASCII = 2;
+constexpr uint16_t TIFF_SHORT = 3;
+constexpr uint16_t TIFF_LONG = 4;
+constexpr uint16_t TIFF_RATIONAL = 5;
+constexpr uint16_t TIFF_UNDEFINED = 7;
+constexpr uint16_t TIFF_SRATIONAL = 10;
+constexpr uint16_t TIFF_IFD = 13;
+constexpr size_t MAX_IFD_ENTRIES = 1024;
+constexpr size_t MAX_STRING_SIZE = 1024;
+constexpr int MAX_JPEG_SEGMENTS = 64;
+
+} // namespace
+
+ExifReader::ExifReader(const Glib::ustring &fname)
+    : f_(g_fopen(fname.c_str(), "rb")), tiff_base_(-1), big_endian_(false),
+      ifd0_offset_(0), ifd0_loaded_(false), exif_loaded_(false)
+{
+    if (f_ && !locate_tiff()) {
+        tiff_base_ = -1;
+    }
+}
+
+ExifReader::~ExifReader()
+{
+    if (f_) {
+        fclose(f_);
+    }
+}
+
+bool ExifReader::read_at(long off, void *buf, size_t sz)
+{
+    return off >= 0 && fseek(f_, off, SEEK_SET) == 0 &&
+           fread(buf, 1, sz, f_) == sz;
+}
+
+uint16_t ExifReader::get16(const uint8_t *p) const
+{
+    return big_endian_ ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+uint32_t ExifReader::get32(const uint8_t *p) const
+{
+    return big_endian_ ? (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+                             (uint32_t(p[2]) << 8) | p[3]
+                       : (uint32_t(p[3]) << 24) | (uint32_t(p[2]) << 16) |
+                             (uint32_t(p[1]) << 8) | p[0];
+}
+
+bool ExifReader::read_header(long base)
+{
+    uint8_t hdr[8];
+    if (!read_at(base, hdr, sizeof(hdr))) {
+        return false;
+    }
+    if (hdr[0] == 'I' && hdr[1] == 'I') {
+        big_endian_ = false;
+    } else if (hdr[0] == 'M' && hdr[1] == 'M') {
+        big_endian_ = true;
+    } else {
+        return false;
+    }
+    // the magic number is 42 for plain TIFF, but several raw formats use
+    // their own (e.g. "RO"/"RS" for ORF, 0x55 for RW2), so it is not checked
+    tiff_base_ = base;
+    ifd0_offset_ = get32(hdr + 4);
+    return ifd0_offset_ >= 8;
+}
+
+bool ExifReader::locate_tiff()
+{
+    uint8_t magic[16];
+    if (!read_at(0, magic, sizeof(magic))) {
+        return false;
+    }
+
+    if ((magic[0] == 'I' && magic[1] == 'I') ||
+        (magic[0] == 'M' && magic[1] == 'M')) {
+        return read_header(0);
+    }
+
+    long jpeg_start = -1;
+    if (magic[0] == 0xFF && magic[1] == 0xD8) {
+        jpeg_start = 0;
+    } else if (memcmp(magic, "FUJIFILM", 8) == 0) {
+        // RAF: the embedded JPEG preview carries the Exif data
+        uint8_t off[4];
+        if (!read_at(84, off, sizeof(off))) {
+            return false;
+        }
+        jpeg_start = (long(off[0]) << 24) | (long(off[1]) << 16) |
+                     (long(off[2]) << 8) | off[3];
+    }
+    if (jpeg_start < 0) {
+        return false;
+    }
+
+    // look for the APP1 Exif segment
+    long pos = jpeg_start + 2;
+    for (int i = 0; i < MAX_JPEG_SEGMENTS; ++i) {
+        uint8_t seg[10];
+        if (!read_at(pos, seg, sizeof(seg)) || seg[0] != 0xFF) {
+            return false;
+        }
+        const uint8_t marker = seg[1];
+        const long len = (long(seg[2]) << 8) | seg[3];
+        if (marker == 0xDA || marker == 0xD9 || len < 2) {
+            // start of scan or end of image, no Exif
+            return false;
+        }
+        if (marker == 0xE1 && memcmp(seg + 4, "Exif\0\0", 6) == 0) {
+            return read_header(pos + 10);
+        }
+        pos += 2 + len;
+    }
+    return false;
+}
+
+bool ExifReader::read_ifd(uint32_t offset, std::vector<Entry> &out)
+{
+    uint8_t buf[2];
+    if (!read_at(tiff_base_ + offset, buf, 2)) {
+        return false;
+    }
+    const size_t n = get16(buf);
+    if (n == 0 || n > MAX_IFD_ENTRIES) {
+        return false;
+    }
+
+    // read the whole entry table in one go
+    std::vector<uint8_t> table(n * 12);
+    if (!read_at(tiff_base_ + offset + 2, table.data(), table.size())) {
+        return false;
+    }
+    out.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t *p = &table[i * 12];
+        Entry &e = out[i];
+        e.tag = get16(p);
+        e.type = get16(p + 2);
+        e.count = get32(p + 4);
+        memcpy(e.value, p + 8, 4);
+    }
+    return true;
+}
+
+const std::vector<ExifReader::Entry> *ExifReader::get_dir(Dir dir)
+{
+    if (!ok()) {
+        return nullptr;
+    }
+
+    if (!ifd0_loaded_) {
+        ifd0_loaded_ = true;
+        if (!read_ifd(ifd0_offset_, ifd0_)) {
+            ifd0_.clear();
+        }
+    }
+    if (dir == IFD0) {
+        return ifd0_.empty() ? nullptr : &ifd0_;
+    }
+
+    if (!exif_loaded_) {
+        exif_loaded_ = true;
+        Entry e;
+        if (find(IFD0, EXIF_IFD, e) &&
+            (e.type == TIFF_LONG || e.type == TIFF_IFD) && e.count == 1 &&
+            !read_ifd(get32(e.value), exif_)) {
+            exif_.clear();
+        }
+    }
+    return exif_.empty() ? nullptr : &exif_;
+}
+
+bool ExifReader::find(Dir dir, uint16_t tag, Entry &out)
+{
+    const auto entries = get_dir(dir);
+    if (!entries) {
+        return false;
+    }
+    for (const auto &e : *entries) {
+        if (e.tag == tag) {
+            out = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ExifReader::read_value(const Entry &e, size_t size, void *buf)
+{
+    if (size <= 4) {
+        memcpy(buf, e.value, size);
+        return true;
+    }
+    return read_at(tiff_base_ + get32(e.value), buf, size);
+}
+
+bool ExifReader::getString(Dir dir, uint16_t tag, std::string &out)
+{
+    Entry e;
+    if (!find(dir, tag, e) ||
+        (e.type != TIFF_ASCII && e.type != TIFF_UNDEFINED) || e.count == 0 ||
+        e.count > MAX_STRING_SIZE) {
+        return false;
+    }
+
+    std::vector<char> buf(e.count + 1, '\0');
+    if (!read_value(e, e.count, buf.data())) {
+        return false;
+    }
+    out = buf.data();
+    return true;
+}
+
+bool ExifReader::getRational(Dir dir, uint16_t tag, double &out)
+{
+    Entry e;
+    if (!find(dir, tag, e) ||
+        (e.type != TIFF_RATIONAL && e.type != TIFF_SRATIONAL) ||
+        e.count == 0) {
+        return false;
+    }
+
+    uint8_t buf[8];
+    if (!read_value(e, sizeof(buf), buf)) {
+        return false;
+    }
+    const uint32_t num = get32(buf);
+    const uint32_t den = get32(buf + 4);
+    if (den == 0) {
+        return false;
+    }
+    if (e.type == TIFF_SRATIONAL) {
+        out = double(int32_t(num)) / double(int32_t(den));
+    } else {
+        out = double(num) / double(den);
+    }
+    return true;
+}
+
+bool ExifReader::getInts(Dir dir, uint16_t tag, std::vector<uint32_t> &out)
+{
+    Entry e;
+    if (!find(dir, tag, e) || (e.type != TIFF_SHORT && e.type != TIFF_LONG) ||
+        e.count == 0 || e.count > MAX_IFD_ENTRIES) {
+        return false;
+    }
+
+    const size_t unit = e.type == TIFF_SHORT ? 2 : 4;
+    std::vector<uint8_t> buf(e.count * unit);
+    if (!read_value(e, buf.size(), buf.data())) {
+        return false;
+    }
+    out.resize(e.count);
+    for (size_t i = 0; i < e.count; ++i) {
+        out[i] = unit == 2 ? get16(&buf[i * 2]) : get32(&buf[i * 4]);
+    }
+    return true;
+}
+
+} // namespace rtengine
@@ -0,0 +1,98 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <glibmm/ustring.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * Minimal, read-only parser for the IFDs of TIFF-based files (including most
+ * raw formats) and of the Exif block of JPEG and RAF files.
+ *
+ * Only IFD0 and the Exif IFD are walked, reading just their entry tables and
+ * the values asked for with a few small buffered reads. Makernotes and the
+ * other blocks are not decoded, so this is much cheaper than a full Exiv2
+ * parse. It is meant for the places that need just a handful of basic tags;
+ * everything else should still go through Exiv2Metadata.
+ */
+class ExifReader {
+public:
+    enum Dir { IFD0, EXIF };
+
+    enum Tag : uint16_t {
+        MAKE = 0x010f,
+        MODEL = 0x0110,
+        DATETIME = 0x0132,
+        EXPOSURE_TIME = 0x829a,
+        EXIF_IFD = 0x8769,
+        ISO_SPEED = 0x8827,
+        DATETIME_ORIGINAL = 0x9003,
+        DATETIME_DIGITIZED = 0x9004
+    };
+
+    explicit ExifReader(const Glib::ustring &fname);
+    ~ExifReader();
+
+    ExifReader(const ExifReader &) = delete;
+    ExifReader &operator=(const ExifReader &) = delete;
+
+    /** true if the file has a recognized TIFF structure */
+    bool ok() const { return f_ && tiff_base_ >= 0; }
+
+    /** ASCII tag, truncated at the first NUL */
+    bool getString(Dir dir, uint16_t tag, std::string &out);
+    /** first value of a RATIONAL or SRATIONAL tag */
+    bool getRational(Dir dir, uint16_t tag, double &out);
+    /** SHORT or LONG tag, out receives all its values */
+    bool getInts(Dir dir, uint16_t tag, std::vector<uint32_t> &out);
+
+private:
+    struct Entry {
+        uint16_t tag;
+        uint16_t type;
+        uint32_t count;
+        uint8_t value[4];
+    };
+
+    bool locate_tiff();
+    bool read_header(long base);
+    bool read_ifd(uint32_t offset, std::vector<Entry> &out);
+    const std::vector<Entry> *get_dir(Dir dir);
+    bool find(Dir dir, uint16_t tag, Entry &out);
+    bool read_value(const Entry &e, size_t size, void *buf);
+    bool read_at(long off, void *buf, size_t sz);
+    uint16_t get16(const uint8_t *p) const;
+    uint32_t get32(const uint8_t *p) const;
+
+    FILE *f_;
+    long tiff_base_;
+    bool big_endian_;
+    uint32_t ifd0_offset_;
+    bool ifd0_loaded_;
+    bool exif_loaded_;
+    std::vector<Entry> ifd0_;
+    std::vector<Entry> exif_;
+};
+
+} // namespace rtengine
@@ -0,0 +1,149 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "featurecache.h"
+#include "concurrentcache.h"
+#include <algorithm>
+#include <cstring>
+
+namespace rtengine {
+
+namespace {
+
+// total size of the cached planes and values, in bytes
+constexpr size_t FEATURE_CACHE_SIZE = 384 << 20;
+// entries larger than this (in floats) are not cached, so that a few of them
+// always fit (typically, this skips only full-size output images)
+constexpr size_t FEATURE_CACHE_MAX_ENTRY_SIZE =
+    FEATURE_CACHE_SIZE / 3 / sizeof(float);
+
+ConcurrentCache<std::string, std::shared_ptr<const FeatureCache::Entry>>
+    feature_cache(FEATURE_CACHE_SIZE);
+
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+inline uint64_t hash_row(uint64_t h, const float *row, int W)
+{
+    for (int x = 0; x < W; ++x) {
+        uint32_t v;
+        memcpy(&v, row + x, sizeof(v));
+        h = (h ^ v) * FNV_PRIME;
+    }
+    return h;
+}
+
+uint64_t combine(const std::vector<uint64_t> &rows)
+{
+    uint64_t res = FNV_OFFSET;
+    for (auto h : rows) {
+        res = (res ^ h) * FNV_PRIME;
+    }
+    return res;
+}
+
+} // namespace
+
+
+bool FeatureCache::cacheable(size_t size)
+{
+    return size <= FEATURE_CACHE_MAX_ENTRY_SIZE;
+}
+
+
+std::shared_ptr<const FeatureCache::Entry>
+FeatureCache::get(const std::string &key)
+{
+    std::shared_ptr<const Entry> ret;
+    if (!feature_cache.get(key, ret)) {
+        ret.reset();
+    }
+    return ret;
+}
+
+
+void FeatureCache::set(const std::string &key,
+                       std::shared_ptr<const Entry> entry)
+{
+    size_t size = entry->values.size();
+    for (const auto &p : entry->planes) {
+        size += size_t(p.width()) * size_t(p.height());
+    }
+    if (cacheable(size)) {
+        feature_cache.set(key, entry, size * sizeof(float));
+    }
+}
+
+
+uint64_t FeatureCache::fingerprint(Imagefloat *img, bool multithread)
+{
+    const int W = img->getWidth();
+    const int H = img->getHeight();
+    std::vector<uint64_t> rows(H);
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        uint64_t h = FNV_OFFSET;
+        for (float **chan : {img->r.ptrs, img->g.ptrs, img->b.ptrs}) {
+            h = hash_row(h, chan[y], W);
+        }
+        rows[y] = h;
+    }
+
+    return combine(rows);
+}
+
+
+uint64_t FeatureCache::fingerprint(const array2D<float> &data,
+                                   bool multithread)
+{
+    const int W = data.width();
+    const int H = data.height();
+    std::vector<uint64_t> rows(H);
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        rows[y] = hash_row(FNV_OFFSET, data[y], W);
+    }
+
+    return combine(rows);
+}
+
+
+void FeatureCache::copy(const array2D<float> &src, array2D<float> &dst,
+                        bool multithread)
+{
+    const int W = src.width();
+    const int H = src.height();
+    if (dst.width() != W || dst.height() != H) {
+        dst(W, H);
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < H; ++y) {
+        std::copy(src[y], src[y] + W, dst[y]);
+    }
+}
+
+} // namespace rtengine
@@ -0,0 +1,69 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "array2D.h"
+#include "imagefloat.h"
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * Cache for the planes that tools derive from their input before applying
+ * their own adjustments (smoothed luminance, dark channel, guided filter
+ * bases, ...), shared by all the pipelines.
+ *
+ * Tools run one after the other and each one modifies the image, so there is
+ * nothing to share between different tools within a single run. What can be
+ * reused is the work done in the previous runs: the keys include a
+ * fingerprint of the input pixels of the tool, so an entry stays valid until
+ * something upstream changes, and e.g. dragging the strength slider of a tool
+ * does not recompute its (expensive) input features every time.
+ */
+class FeatureCache {
+public:
+    struct Entry {
+        std::vector<array2D<float>> planes;
+        std::vector<float> values;
+
+        explicit Entry(size_t num_planes = 0, size_t num_values = 0)
+            : planes(num_planes), values(num_values)
+        {
+        }
+    };
+
+    /** true if an entry of the given size (in floats) would be cached */
+    static bool cacheable(size_t size);
+
+    static std::shared_ptr<const Entry> get(const std::string &key);
+    static void set(const std::string &key, std::shared_ptr<const Entry> entry);
+
+    /** cheap hash of the pixel values, to be used as part of the keys */
+    static uint64_t fingerprint(Imagefloat *img, bool multithread);
+    static uint64_t fingerprint(const array2D<float> &data, bool multithread);
+
+    /** dst is resized only if needed, so it can also wrap external data */
+    static void copy(const array2D<float> &src, array2D<float> &dst,
+                     bool multithread);
+};
+
+} // namespace rtengine
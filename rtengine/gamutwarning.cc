@@ -24,118 +24,248 @@
  */
 
 #include "gamutwarning.h"
+#include "concurrentcache.h"
+#include "settings.h"
+#include <algorithm>
 #include <iostream>
 
 namespace rtengine {
 
+extern const Settings *settings;
+
+namespace {
+
+// The out of gamut flag is sampled on a CELLS_SIZE^3 lattice over L in
+// [0, 100] and a, b in [-128, 128]. A cell is "in" (resp. "out") only if all
+// the nodes of the cell and of its neighbours are, so that the boundary is
+// computed exactly even where it bends between nodes. The classification is
+// still a heuristic: features of the gamut smaller than a cell (about 2 L
+// units and 5 a, b units) can be misclassified.
+constexpr int CELLS_SIZE = 49;
+constexpr uint8_t CELL_IN = 0;
+constexpr uint8_t CELL_OUT = 1;
+constexpr uint8_t CELL_MIXED = 2;
+
+// total size of the cached classifications, in bytes (about 110 KB each)
+constexpr size_t CELLS_CACHE_SIZE = 1 << 20;
+
+ConcurrentCache<std::string, std::shared_ptr<const std::vector<uint8_t>>>
+    cells_cache(CELLS_CACHE_SIZE);
+
+inline float node_L(int i) { return 100.f * i / (CELLS_SIZE - 1); }
+inline float node_ab(int i) { return -128.f + 256.f * i / (CELLS_SIZE - 1); }
+
+// index of the cell containing lab, -1 if outside of the lattice
+inline int cell_index(const float *lab)
+{
+    constexpr float n = CELLS_SIZE - 1;
+    const float pL = lab[0] * (n / 100.f);
+    const float pa = (lab[1] + 128.f) * (n / 256.f);
+    const float pb = (lab[2] + 128.f) * (n / 256.f);
+    if (!(pL >= 0.f && pL <= n && pa >= 0.f && pa <= n && pb >= 0.f &&
+          pb <= n)) {
+        return -1;
+    }
+    const int iL = std::min(int(pL), CELLS_SIZE - 2);
+    const int ia = std::min(int(pa), CELLS_SIZE - 2);
+    const int ib = std::min(int(pb), CELLS_SIZE - 2);
+    return (iL * (CELLS_SIZE - 1) + ia) * (CELLS_SIZE - 1) + ib;
+}
+
+} // namespace
+
 GamutWarning::GamutWarning(cmsHPROFILE gamutprof, RenderingIntent intent,
                            bool gamutbpc)
-    : lab2ref(nullptr), lab2softproof(nullptr), softproof2ref(nullptr)
 {
+    constexpr cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE;
+    const cmsUInt32Number bpc =
+        gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0;
+
     cmsHPROFILE iprof = cmsCreateLab4Profile(nullptr);
     if (cmsIsMatrixShaper(gamutprof) &&
         !cmsIsCLUT(gamutprof, intent, LCMS_USED_AS_OUTPUT)) {
         cmsHPROFILE aces = ICCStore::getInstance()->workingSpace("ACESp0");
         if (aces) {
-            lab2ref =
-                cmsCreateTransform(iprof, TYPE_Lab_FLT, aces, TYPE_RGB_FLT,
-                                   INTENT_ABSOLUTE_COLORIMETRIC,
-                                   cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            lab2softproof =
-                cmsCreateTransform(iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT,
-                                   INTENT_ABSOLUTE_COLORIMETRIC,
-                                   cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            softproof2ref = cmsCreateTransform(
+            lab2ref = LCMSTransform::create(
+                iprof, TYPE_Lab_FLT, aces, TYPE_RGB_FLT,
+                INTENT_ABSOLUTE_COLORIMETRIC, flags);
+            lab2softproof = LCMSTransform::create(
+                iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT,
+                INTENT_ABSOLUTE_COLORIMETRIC, flags);
+            softproof2ref = LCMSTransform::create(
                 gamutprof, TYPE_RGB_FLT, aces, TYPE_RGB_FLT,
-                INTENT_ABSOLUTE_COLORIMETRIC,
-                cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE |
-                    (gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0));
+                INTENT_ABSOLUTE_COLORIMETRIC, flags | bpc);
         }
     } else {
-        lab2ref = nullptr;
-        lab2softproof =
-            cmsCreateTransform(iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT,
-                               INTENT_ABSOLUTE_COLORIMETRIC,
-                               cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-        softproof2ref = cmsCreateTransform(
-            gamutprof, TYPE_RGB_FLT, iprof, TYPE_Lab_FLT,
-            INTENT_ABSOLUTE_COLORIMETRIC,
-            cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE |
-                (gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0));
+        lab2softproof = LCMSTransform::create(iprof, TYPE_Lab_FLT, gamutprof,
+                                              TYPE_RGB_FLT,
+                                              INTENT_ABSOLUTE_COLORIMETRIC,
+                                              flags);
+        softproof2ref = LCMSTransform::create(gamutprof, TYPE_RGB_FLT, iprof,
+                                              TYPE_Lab_FLT,
+                                              INTENT_ABSOLUTE_COLORIMETRIC,
+                                              flags | bpc);
     }
 
-    if (!softproof2ref) {
-        if (lab2softproof) {
-            cmsDeleteTransform(lab2softproof);
-            lab2softproof = nullptr;
+    if (!softproof2ref || !lab2softproof) {
+        lab2softproof = LCMSTransform();
+        softproof2ref = LCMSTransform();
+    }
+    cmsCloseProfile(iprof);
+
+    if (softproof2ref && !settings->proofing_exact_apply) {
+        buildCells();
+    }
+}
+
+void GamutWarning::buildCells()
+{
+    if (lab2softproof.key().empty() || softproof2ref.key().empty()) {
+        return;
+    }
+    // the keys of the transforms don't depend on when the Lab profile was
+    // created (see profile_key() in lcmstransform.cc), so this hits across
+    // instances
+    const std::string key = lab2softproof.key() + "|" + softproof2ref.key() +
+                            "|" + lab2ref.key();
+    if (cells_cache.get(key, cells_)) {
+        return;
+    }
+
+    constexpr int N = CELLS_SIZE;
+    std::vector<uint8_t> nodes(N * N * N);
+
+    // one row of nodes along b at a time
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
+    for (int iL = 0; iL < N; ++iL) {
+        for (int ia = 0; ia < N; ++ia) {
+            float lab[3 * N];
+            float buf1[3 * N];
+            float buf2[3 * N];
+            for (int ib = 0; ib < N; ++ib) {
+                lab[3 * ib] = node_L(iL);
+                lab[3 * ib + 1] = node_ab(ia);
+                lab[3 * ib + 2] = node_ab(ib);
+            }
+            check(lab, N, buf1, buf2, &nodes[(iL * N + ia) * N]);
         }
-    } else if (!lab2softproof) {
-        if (softproof2ref) {
-            cmsDeleteTransform(softproof2ref);
-            softproof2ref = nullptr;
+    }
+
+    std::vector<uint8_t> *cells =
+        new std::vector<uint8_t>((N - 1) * (N - 1) * (N - 1));
+    cells_.reset(cells);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int iL = 0; iL < N - 1; ++iL) {
+        for (int ia = 0; ia < N - 1; ++ia) {
+            for (int ib = 0; ib < N - 1; ++ib) {
+                bool seen[2] = {false, false};
+                for (int l = std::max(iL - 1, 0); l <= std::min(iL + 2, N - 1);
+                     ++l) {
+                    for (int a = std::max(ia - 1, 0);
+                         a <= std::min(ia + 2, N - 1); ++a) {
+                        for (int b = std::max(ib - 1, 0);
+                             b <= std::min(ib + 2, N - 1); ++b) {
+                            seen[nodes[(l * N + a) * N + b]] = true;
+                        }
+                    }
+                }
+                (*cells)[(iL * (N - 1) + ia) * (N - 1) + ib] =
+                    seen[0] && seen[1] ? CELL_MIXED
+                                       : (seen[1] ? CELL_OUT : CELL_IN);
+            }
         }
     }
-    cmsCloseProfile(iprof);
+
+    cells_cache.set(key, cells_, cells->size());
 }
 
-GamutWarning::~GamutWarning()
+void GamutWarning::check(const float *lab, int n, float *buf1, float *buf2,
+                         uint8_t *out) const
 {
-    if (softproof2ref) {
-        cmsDeleteTransform(softproof2ref);
+    const float delta_max = lab2ref ? 0.0001f : 4.9999f;
+    lab2softproof(lab, buf2, n);
+    // since we are checking for out-of-gamut, we do want to clamp here!
+    for (int i = 0; i < n * 3; ++i) {
+        buf2[i] = LIM01(buf2[i]);
     }
+    softproof2ref(buf2, buf1, n);
+
+    const float *proofdata = buf1;
+
     if (lab2ref) {
-        cmsDeleteTransform(lab2ref);
-    }
-    if (lab2softproof) {
-        cmsDeleteTransform(lab2softproof);
+        lab2ref(lab, buf2, n);
+        const float *refdata = buf2;
+
+        int iy = 0;
+        for (int j = 0; j < n; ++j) {
+            float delta = max(std::abs(proofdata[iy] - refdata[iy]),
+                              std::abs(proofdata[iy + 1] - refdata[iy + 1]),
+                              std::abs(proofdata[iy + 2] - refdata[iy + 2]));
+            iy += 3;
+            out[j] = delta > delta_max;
+        }
+    } else {
+        const float *refdata = lab;
+        int iy = 0;
+        for (int j = 0; j < n; ++j) {
+            cmsCIELab lab1 = {proofdata[iy], proofdata[iy + 1],
+                              proofdata[iy + 2]};
+            cmsCIELab lab2 = {refdata[iy], refdata[iy + 1], refdata[iy + 2]};
+            iy += 3;
+            float delta = cmsDeltaE(&lab1, &lab2);
+            out[j] = delta > delta_max;
+        }
     }
 }
 
 void GamutWarning::markLine(Image8 *image, int y, float *srcbuf, float *buf1,
-                            float *buf2)
+                            float *buf2, uint8_t *flags, int *todo)
 {
-    if (softproof2ref) {
-        const int width = image->getWidth();
-
-        float delta_max = lab2ref ? 0.0001f : 4.9999f;
-        cmsDoTransform(lab2softproof, srcbuf, buf2, width);
-        // since we are checking for out-of-gamut, we do want to clamp here!
-        for (int i = 0; i < width * 3; ++i) {
-            buf2[i] = LIM01(buf2[i]);
-        }
-        cmsDoTransform(softproof2ref, buf2, buf1, width);
+    if (!softproof2ref) {
+        return;
+    }
 
-        float *proofdata = buf1;
-        float *refdata = srcbuf;
+    const int width = image->getWidth();
 
-        if (lab2ref) {
-            cmsDoTransform(lab2ref, srcbuf, buf2, width);
-            refdata = buf2;
+    if (!cells_) {
+        check(srcbuf, width, buf1, buf2, flags);
+        for (int j = 0; j < width; ++j) {
+            if (flags[j]) {
+                mark(image, y, j);
+            }
+        }
+        return;
+    }
 
-            int iy = 0;
-            for (int j = 0; j < width; ++j) {
-                float delta =
-                    max(std::abs(proofdata[iy] - refdata[iy]),
-                        std::abs(proofdata[iy + 1] - refdata[iy + 1]),
-                        std::abs(proofdata[iy + 2] - refdata[iy + 2]));
-                iy += 3;
+    // the pixels in cells near the boundary (or outside of the lattice) are
+    // moved to the front of srcbuf, and checked exactly
+    const std::vector<uint8_t> &cells = *cells_;
+    int num_todo = 0;
+    for (int j = 0; j < width; ++j) {
+        const float *lab = srcbuf + 3 * j;
+        const int idx = cell_index(lab);
+        const uint8_t state = idx < 0 ? CELL_MIXED : cells[idx];
+        if (state == CELL_OUT) {
+            mark(image, y, j);
+        } else if (state == CELL_MIXED) {
+            float *dst = srcbuf + 3 * num_todo;
+            dst[0] = lab[0];
+            dst[1] = lab[1];
+            dst[2] = lab[2];
+            todo[num_todo++] = j;
+        }
+    }
 
-                if (delta > delta_max) {
-                    mark(image, y, j);
-                }
-            }
-        } else {
-            int iy = 0;
-            for (int j = 0; j < width; ++j) {
-                cmsCIELab lab1 = {proofdata[iy], proofdata[iy + 1],
-                                  proofdata[iy + 2]};
-                cmsCIELab lab2 = {refdata[iy], refdata[iy + 1],
-                                  refdata[iy + 2]};
-                iy += 3;
-                float delta = cmsDeltaE(&lab1, &lab2);
-                if (delta > delta_max) {
-                    mark(image, y, j);
-                }
+    if (num_todo > 0) {
+        check(srcbuf, num_todo, buf1, buf2, flags);
+        for (int k = 0; k < num_todo; ++k) {
+            if (flags[k]) {
+                mark(image, y, todo[k]);
             }
         }
     }
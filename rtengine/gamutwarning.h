@@ -27,23 +27,45 @@
 
 #include "iccstore.h"
 #include "image8.h"
+#include "lcmstransform.h"
 #include "noncopyable.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace rtengine {
 
+/**
+ * Marks the out of gamut pixels of the preview.
+ *
+ * Unless Settings::proofing_exact_apply is set, the result of the check is
+ * precomputed on a lattice over the Lab cube (shared by all the instances
+ * with the same profiles), and only the pixels falling in cells near the
+ * gamut boundary go through the LittleCMS transforms. This is an
+ * approximation: gamut regions thinner than a cell that fall between the
+ * nodes can be missed.
+ */
 class GamutWarning: public NonCopyable {
 public:
     GamutWarning(cmsHPROFILE gamutprof, RenderingIntent intent, bool bpc);
-    ~GamutWarning();
+    // srcbuf holds the Lab values of row y, and is overwritten. The buffers
+    // are per-thread scratch space: buf1, buf2 must hold 3 * width floats,
+    // flags and todo width elements
     void markLine(Image8 *image, int y, float *srcbuf, float *buf1,
-                  float *buf2);
+                  float *buf2, uint8_t *flags, int *todo);
 
 private:
     void mark(Image8 *image, int i, int j);
+    // sets out[i] to 1 if lab[i] is out of gamut, 0 otherwise. buf1 and buf2
+    // must hold 3 * n floats
+    void check(const float *lab, int n, float *buf1, float *buf2,
+               uint8_t *out) const;
+    void buildCells();
 
-    cmsHTRANSFORM lab2ref;
-    cmsHTRANSFORM lab2softproof;
-    cmsHTRANSFORM softproof2ref;
+    LCMSTransform lab2ref;
+    LCMSTransform lab2softproof;
+    LCMSTransform softproof2ref;
+    std::shared_ptr<const std::vector<uint8_t>> cells_;
 };
 
 } // namespace rtengine
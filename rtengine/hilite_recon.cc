@@ -24,9 +24,9 @@
 //
 ////////////////////////////////////////////////////////////////
 
-#include <cassert>
 #include <cmath>
 #include <cstddef>
+#include <vector>
 
 #include "array2D.h"
 #include "guidedfilter.h"
@@ -39,277 +39,76 @@
 
 namespace {
 
-void boxblur2(const float *const *src, float **dst, float **temp, int startY,
-              int startX, int H, int W, int bufferW, int box)
+// Size of the tiles of the highlight reconstruction passes. It must be a
+// multiple of the sampling pitch of HLRecovery_inpaint
+constexpr int HL_TILE_SIZE = 64;
+
+// Local variation of a tile of the W x H region starting at (startY, startX):
+// sum over the channels of the absolute differences from their 9x9 box
+// average, with the windows clamped to the region. The tile starts at (y0, x0)
+// of the region; hblur must have room for 3 * (HL_TILE_SIZE + 8) *
+// HL_TILE_SIZE values, and acc for HL_TILE_SIZE values
+void tile_variation(float **const rgb[3], int startY, int startX, int H, int W,
+                    int y0, int x0, float *hblur, float *acc, float *var)
 {
-    constexpr int numCols = 16;
-    assert((bufferW % numCols) == 0);
+    constexpr int box = 4;
+    constexpr int ts = HL_TILE_SIZE;
+    constexpr int bh = ts + 2 * box;
 
-    // box blur image channel; box size = 2*box+1
-    // horizontal blur
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-    for (int row = 0; row < H; ++row) {
-        int len = box + 1;
-        temp[row][0] = src[row + startY][startX] / len;
-
-        for (int j = 1; j <= box; ++j) {
-            temp[row][0] += src[row + startY][j + startX] / len;
-        }
-
-        for (int col = 1; col <= box; ++col, ++len) {
-            temp[row][col] = (temp[row][col - 1] * len +
-                              src[row + startY][col + box + startX]) /
-                             (len + 1);
-        }
-
-        for (int col = box + 1; col < W - box; ++col) {
-            temp[row][col] = temp[row][col - 1] +
-                             (src[row + startY][col + box + startX] -
-                              src[row + startY][col - box - 1 + startX]) /
-                                 len;
-        }
-
-        for (int col = W - box; col < W; ++col, --len) {
-            temp[row][col] = (temp[row][col - 1] * len -
-                              src[row + startY][col - box - 1 + startX]) /
-                             (len - 1);
-        }
-    }
-
-    // vertical blur
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-    {
-        float tempvalN[numCols] ALIGNED64;
-#ifdef _OPENMP
-#pragma omp for
-#endif
-        for (int col = 0; col < bufferW - numCols + 1; col += numCols) {
-            float len = box + 1;
-
-            for (int n = 0; n < numCols; ++n) {
-                tempvalN[n] = temp[0][col + n] / len;
-            }
-
-            for (int i = 1; i <= box; ++i) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] += temp[i][col + n] / len;
-                }
-            }
-
-            for (int n = 0; n < numCols; ++n) {
-                dst[0][col + n] = tempvalN[n];
-            }
+    const int y1 = std::min(y0 + ts, H);
+    const int x1 = std::min(x0 + ts, W);
+    const int tw = x1 - x0;
+    const int by0 = std::max(y0 - box, 0);
+    const int by1 = std::min(y1 + box, H);
 
-            for (int row = 1; row <= box; ++row, ++len) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] =
-                        (tempvalN[n] * len + temp[(row + box)][col + n]) /
-                        (len + 1);
-                    dst[row][col + n] = tempvalN[n];
-                }
-            }
+    // horizontal blur
+    for (int c = 0; c < 3; ++c) {
+        for (int y = by0; y < by1; ++y) {
+            const float *src = rgb[c][y + startY] + startX;
+            float *dst = hblur + (c * bh + y - by0) * ts;
 
-            const float rlen = 1.f / len;
+            for (int x = x0; x < x1; ++x) {
+                const int l = std::max(x - box, 0);
+                const int r = std::min(x + box, W - 1);
+                float sum = 0.f;
 
-            for (int row = box + 1; row < H - box; ++row) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] += (temp[(row + box)][col + n] -
-                                    temp[(row - box - 1)][col + n]) *
-                                   rlen;
-                    dst[row][col + n] = tempvalN[n];
+                for (int k = l; k <= r; ++k) {
+                    sum += src[k];
                 }
-            }
 
-            for (int row = H - box; row < H; ++row, --len) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] = (dst[(row - 1)][col + n] * len -
-                                   temp[(row - box - 1)][col + n]) /
-                                  (len - 1);
-                    dst[row][col + n] = tempvalN[n];
-                }
+                dst[x - x0] = sum / (r - l + 1);
             }
         }
     }
-}
-
-void boxblur_resamp(const float *const *src, float **dst, float **temp, int H,
-                    int W, int box, int samp)
-{
-    assert(samp != 0);
-
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-    {
-#ifdef _OPENMP
-#pragma omp for
-#endif
-        // box blur image channel; box size = 2*box+1
-        // horizontal blur
-        for (int row = 0; row < H; ++row) {
-            int len = box + 1;
-            float tempval = src[row][0] / len;
-
-            for (int j = 1; j <= box; ++j) {
-                tempval += src[row][j] / len;
-            }
-
-            temp[row][0] = tempval;
-
-            for (int col = 1; col <= box; ++col, ++len) {
-                tempval = (tempval * len + src[row][col + box]) / (len + 1);
-
-                if (col % samp == 0) {
-                    temp[row][col / samp] = tempval;
-                }
-            }
-
-            const float oneByLen = 1.f / static_cast<float>(len);
 
-            for (int col = box + 1; col < W - box; ++col) {
-                tempval =
-                    tempval +
-                    (src[row][col + box] - src[row][col - box - 1]) * oneByLen;
+    // vertical blur and differences
+    for (int y = y0; y < y1; ++y) {
+        const int t = std::max(y - box, 0);
+        const int b = std::min(y + box, H - 1);
+        const float norm = 1.f / (b - t + 1);
+        float *dst = var + (y - y0) * ts;
 
-                if (col % samp == 0) {
-                    temp[row][col / samp] = tempval;
-                }
-            }
-
-            for (int col = W - box; col < W; ++col, --len) {
-                tempval = (tempval * len - src[row][col - box - 1]) / (len - 1);
-
-                if (col % samp == 0) {
-                    temp[row][col / samp] = tempval;
-                }
-            }
+        for (int x = 0; x < tw; ++x) {
+            dst[x] = 0.f;
         }
-    }
-
-    constexpr int numCols =
-        8; // process numCols columns at once for better L1 CPU cache usage
-
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-    {
-        float tempvalN[numCols] ALIGNED64;
-
-#ifdef _OPENMP
-#pragma omp for nowait
-#endif
-        // vertical blur
-        for (int col = 0; col < (W / samp) - (numCols - 1); col += numCols) {
-            float len = box + 1;
-
-            for (int n = 0; n < numCols; ++n) {
-                tempvalN[n] = temp[0][col + n] / len;
-            }
-
-            for (int i = 1; i <= box; ++i) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] += temp[i][col + n] / len;
-                }
-            }
-
-            for (int n = 0; n < numCols; ++n) {
-                dst[0][col + n] = tempvalN[n];
-            }
 
-            for (int row = 1; row <= box; ++row, ++len) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] =
-                        (tempvalN[n] * len + temp[(row + box)][col + n]) /
-                        (len + 1);
-                }
-
-                if (row % samp == 0) {
-                    for (int n = 0; n < numCols; ++n) {
-                        dst[row / samp][col + n] = tempvalN[n];
-                    }
-                }
+        for (int c = 0; c < 3; ++c) {
+            for (int x = 0; x < tw; ++x) {
+                acc[x] = 0.f;
             }
 
-            const float rlen = 1.f / len;
+            for (int k = t; k <= b; ++k) {
+                const float *src = hblur + (c * bh + k - by0) * ts;
 
-            for (int row = box + 1; row < H - box; ++row) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] += (temp[(row + box)][col + n] -
-                                    temp[(row - box - 1)][col + n]) *
-                                   rlen;
-                }
-
-                if (row % samp == 0) {
-                    for (int n = 0; n < numCols; ++n) {
-                        dst[row / samp][col + n] = tempvalN[n];
-                    }
+                for (int x = 0; x < tw; ++x) {
+                    acc[x] += src[x];
                 }
             }
 
-            for (int row = H - box; row < H; ++row, --len) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] =
-                        (tempvalN[n] * len - temp[(row - box - 1)][col + n]) /
-                        (len - 1);
-                }
-
-                if (row % samp == 0) {
-                    for (int n = 0; n < numCols; ++n) {
-                        dst[row / samp][col + n] = tempvalN[n];
-                    }
-                }
-            }
-        }
-
-        // process remaining columns
-#ifdef _OPENMP
-#pragma omp single
-#endif
-        {
-
-            // vertical blur
-            for (int col = (W / samp) - ((W / samp) % numCols); col < W / samp;
-                 ++col) {
-                int len = box + 1;
-                float tempval = temp[0][col] / len;
-
-                for (int i = 1; i <= box; ++i) {
-                    tempval += temp[i][col] / len;
-                }
-
-                dst[0][col] = tempval;
-
-                for (int row = 1; row <= box; ++row, ++len) {
-                    tempval =
-                        (tempval * len + temp[(row + box)][col]) / (len + 1);
-
-                    if (row % samp == 0) {
-                        dst[row / samp][col] = tempval;
-                    }
-                }
-
-                for (int row = box + 1; row < H - box; ++row) {
-                    tempval +=
-                        (temp[(row + box)][col] - temp[(row - box - 1)][col]) /
-                        len;
+            const float *src = rgb[c][y + startY] + startX + x0;
 
-                    if (row % samp == 0) {
-                        dst[row / samp][col] = tempval;
-                    }
-                }
-
-                for (int row = H - box; row < H; ++row, --len) {
-                    tempval = (tempval * len - temp[(row - box - 1)][col]) /
-                              (len - 1);
-
-                    if (row % samp == 0) {
-                        dst[row / samp][col] = tempval;
-                    }
-                }
+            for (int x = 0; x < tw; ++x) {
+                dst[x] += std::abs(acc[x] * norm - src[x]);
             }
         }
     }
@@ -458,82 +257,74 @@ void RawImageSource::HLRecovery_inpaint(int blur)
     maxy = std::min(height - 1, maxy + blurBorder);
     const int blurWidth = maxx - minx + 1;
     const int blurHeight = maxy - miny + 1;
-    const int bufferWidth = blurWidth + ((16 - (blurWidth % 16)) & 15);
-
-    multi_array2D<float, 3> channelblur(bufferWidth, blurHeight, 0, 48);
-    array2D<float> temp(bufferWidth, blurHeight); // allocate temporary buffer
-
-    // blur RGB channels
-
-    boxblur2(red, channelblur[0], temp, miny, minx, blurHeight, blurWidth,
-             bufferWidth, 4);
+    const int hfh = (blurHeight - blurHeight % pitch) / pitch;
+    const int hfw = (blurWidth - blurWidth % pitch) / pitch;
 
-    boxblur2(green, channelblur[1], temp, miny, minx, blurHeight, blurWidth,
-             bufferWidth, 4);
+    // pixels with one or more channels in the highlights, but none blown
+    const auto near_clip = [&](int i, int j) -> bool {
+        const float r = red[i + miny][j + minx];
+        const float g = green[i + miny][j + minx];
+        const float b = blue[i + miny][j + minx];
+        return (r > thresh[0] || g > thresh[1] || b > thresh[2]) &&
+               r < max_f[0] && g < max_f[1] && b < max_f[2];
+    };
 
-    boxblur2(blue, channelblur[2], temp, miny, minx, blurHeight, blurWidth,
-             bufferWidth, 4);
+    // The highlight data are gathered in tiles, so that the temporaries
+    // don't have to cover the whole region. The local variation is only
+    // computed (and kept) for the tiles with some pixels near clipping, all
+    // the other tiles don't contribute any highlight data and are skipped
+    constexpr int ts = HL_TILE_SIZE;
+    const int tilesH = (blurHeight + ts - 1) / ts;
+    const int tilesW = (blurWidth + ts - 1) / ts;
+    std::vector<std::vector<float>> variation(tilesH * tilesW);
+    float **rgb[3] = {red, green, blue};
 
-    if (plistener) {
-        progress += 0.07;
-        plistener->setProgress(progress);
-    }
+    double hipass_sum = 0.0;
+    int hipass_norm = 0;
 
-    // reduce channel blur to one array
 #ifdef _OPENMP
-#pragma omp parallel for
+#pragma omp parallel
 #endif
-    for (int i = 0; i < blurHeight; ++i) {
-        for (int j = 0; j < blurWidth; ++j) {
-            channelblur[0][i][j] =
-                fabsf(channelblur[0][i][j] - red[i + miny][j + minx]) +
-                fabsf(channelblur[1][i][j] - green[i + miny][j + minx]) +
-                fabsf(channelblur[2][i][j] - blue[i + miny][j + minx]);
-        }
-    }
-
-    for (int c = 1; c < 3; ++c) {
-        channelblur[c].free(); // free up some memory
-    }
-
-    if (plistener) {
-        progress += 0.05;
-        plistener->setProgress(progress);
-    }
-
-    multi_array2D<float, 4> hilite_full(bufferWidth, blurHeight,
-                                        ARRAY2D_CLEAR_DATA, 32);
-
-    if (plistener) {
-        progress += 0.05;
-        plistener->setProgress(progress);
-    }
-
-    double hipass_sum = 0.0;
-    int hipass_norm = 0;
+    {
+        std::vector<float> hblur(3 * (ts + 8) * ts);
+        std::vector<float> acc(ts);
 
-    // set up which pixels are clipped or near clipping
 #ifdef _OPENMP
-#pragma omp parallel for reduction(+ : hipass_sum, hipass_norm)                \
-    schedule(dynamic, 16)
+#pragma omp for collapse(2) schedule(dynamic)                                  \
+    reduction(+ : hipass_sum, hipass_norm)
 #endif
-    for (int i = 0; i < blurHeight; ++i) {
-        for (int j = 0; j < blurWidth; ++j) {
-            if ((red[i + miny][j + minx] > thresh[0] ||
-                 green[i + miny][j + minx] > thresh[1] ||
-                 blue[i + miny][j + minx] > thresh[2]) &&
-                red[i + miny][j + minx] < max_f[0] &&
-                green[i + miny][j + minx] < max_f[1] &&
-                blue[i + miny][j + minx] < max_f[2]) {
-                // if one or more channels is highlight but none are blown, add
-                // to highlight accumulator
-                hipass_sum += channelblur[0][i][j];
-                ++hipass_norm;
-
-                hilite_full[0][i][j] = red[i + miny][j + minx];
-                hilite_full[1][i][j] = green[i + miny][j + minx];
-                hilite_full[2][i][j] = blue[i + miny][j + minx];
-                hilite_full[3][i][j] = 1.f;
+        for (int ty = 0; ty < tilesH; ++ty) {
+            for (int tx = 0; tx < tilesW; ++tx) {
+                const int y0 = ty * ts;
+                const int y1 = std::min(y0 + ts, blurHeight);
+                const int x0 = tx * ts;
+                const int x1 = std::min(x0 + ts, blurWidth);
+                bool found = false;
+
+                for (int i = y0; i < y1 && !found; ++i) {
+                    for (int j = x0; j < x1 && !found; ++j) {
+                        found = near_clip(i, j);
+                    }
+                }
+
+                if (!found) {
+                    continue;
+                }
+
+                auto &var = variation[ty * tilesW + tx];
+                var.resize(ts * ts);
+                tile_variation(rgb, miny, minx, blurHeight, blurWidth, y0, x0,
+                               hblur.data(), acc.data(), var.data());
+
+                // add to highlight accumulator
+                for (int i = y0; i < y1; ++i) {
+                    for (int j = x0; j < x1; ++j) {
+                        if (near_clip(i, j)) {
+                            hipass_sum += var[(i - y0) * ts + j - x0];
+                            ++hipass_norm;
+                        }
+                    }
+                }
             }
         }
     }
@@ -541,73 +332,149 @@ void RawImageSource::HLRecovery_inpaint(int blur)
     const float hipass_ave = 2.f * hipass_sum / (hipass_norm + epsilon);
 
     if (plistener) {
-        progress += 0.05;
+        progress += 0.24;
         plistener->setProgress(progress);
     }
 
-    array2D<float> hilite_full4(bufferWidth, blurHeight);
-    //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-    // blur highlight data
-    boxblur2(hilite_full[3], hilite_full4, temp, 0, 0, blurHeight, blurWidth,
-             bufferWidth, 1);
-
-    temp.free(); // free temporary buffer
+    multi_array2D<float, 4> hilite(hfw + 1, hfh + 1, ARRAY2D_CLEAR_DATA, 48);
 
-    if (plistener) {
-        progress += 0.07;
-        plistener->setProgress(progress);
-    }
+    //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+    // blur and resample highlight data; range=size of blur, pitch=sample
+    // spacing. Each tile of samples is computed from the highlight data of
+    // the pixels under its blur window, plus a 1 pixel border for the edge
+    // detection
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        constexpr int bs = ts + 2 * range + 2;
+        std::vector<float> flagbuf(bs * bs);
+        std::vector<float> hlbuf(4 * bs * bs);
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic, 16)
+#pragma omp for collapse(2) schedule(dynamic)
 #endif
-    for (int i = 0; i < blurHeight; ++i) {
-        for (int j = 0; j < blurWidth; ++j) {
-            if (channelblur[0][i][j] > hipass_ave) {
-                // too much variation
-                hilite_full[0][i][j] = hilite_full[1][i][j] =
-                    hilite_full[2][i][j] = hilite_full[3][i][j] = 0.f;
-                continue;
-            }
+        for (int ty = 0; ty < tilesH; ++ty) {
+            for (int tx = 0; tx < tilesW; ++tx) {
+                const int r0 = ty * ts / pitch;
+                const int r1 = std::min((ty + 1) * ts / pitch, hfh);
+                const int c0 = tx * ts / pitch;
+                const int c1 = std::min((tx + 1) * ts / pitch, hfw);
+
+                if (r0 >= r1 || c0 >= c1) {
+                    continue;
+                }
 
-            if (hilite_full4[i][j] > epsilon && hilite_full4[i][j] < 0.95f) {
-                // too near an edge, could risk using CA affected pixels,
-                // therefore omit
-                hilite_full[0][i][j] = hilite_full[1][i][j] =
-                    hilite_full[2][i][j] = hilite_full[3][i][j] = 0.f;
-            }
-        }
-    }
+                // pixels under the blur windows
+                const int py0 = std::max(r0 * pitch - range, 0);
+                const int py1 =
+                    std::min((r1 - 1) * pitch + range + 1, blurHeight);
+                const int px0 = std::max(c0 * pitch - range, 0);
+                const int px1 =
+                    std::min((c1 - 1) * pitch + range + 1, blurWidth);
+                // ... and their neighbours
+                const int fy0 = std::max(py0 - 1, 0);
+                const int fy1 = std::min(py1 + 1, blurHeight);
+                const int fx0 = std::max(px0 - 1, 0);
+                const int fx1 = std::min(px1 + 1, blurWidth);
+
+                bool found = false;
+
+                for (int i = fy0 / ts; i <= (fy1 - 1) / ts && !found; ++i) {
+                    for (int j = fx0 / ts; j <= (fx1 - 1) / ts && !found;
+                         ++j) {
+                        found = !variation[i * tilesW + j].empty();
+                    }
+                }
 
-    channelblur[0].free(); // free up some memory
-    hilite_full4.free();   // free up some memory
+                if (!found) {
+                    continue; // no highlight data, samples are zero
+                }
 
-    const int hfh = (blurHeight - blurHeight % pitch) / pitch;
-    const int hfw = (blurWidth - blurWidth % pitch) / pitch;
+                const auto flag = [&](int i, int j) -> float & {
+                    return flagbuf[(i - fy0) * bs + j - fx0];
+                };
+                const auto hl = [&](int c, int i, int j) -> float & {
+                    return hlbuf[(c * bs + i - fy0) * bs + j - fx0];
+                };
+
+                // set up which pixels are clipped or near clipping
+                for (int i = fy0; i < fy1; ++i) {
+                    for (int j = fx0; j < fx1; ++j) {
+                        flag(i, j) = near_clip(i, j) ? 1.f : 0.f;
+                    }
+                }
 
-    multi_array2D<float, 4> hilite(hfw + 1, hfh + 1, ARRAY2D_CLEAR_DATA, 48);
+                for (int i = py0; i < py1; ++i) {
+                    for (int j = px0; j < px1; ++j) {
+                        float h[4] = {0.f, 0.f, 0.f, 0.f};
+
+                        // discard pixels with too much variation
+                        if (flag(i, j) > 0.f &&
+                            variation[(i / ts) * tilesW + j / ts]
+                                     [(i % ts) * ts + j % ts] <= hipass_ave) {
+                            const int t = std::max(i - 1, 0);
+                            const int b = std::min(i + 1, blurHeight - 1);
+                            const int l = std::max(j - 1, 0);
+                            const int r = std::min(j + 1, blurWidth - 1);
+                            float sum = 0.f;
+
+                            for (int k = t; k <= b; ++k) {
+                                for (int m = l; m <= r; ++m) {
+                                    sum += flag(k, m);
+                                }
+                            }
+
+                            const float f = sum / ((b - t + 1) * (r - l + 1));
+
+                            // too near an edge, could risk using CA affected
+                            // pixels, therefore omit
+                            if (!(f > epsilon && f < 0.95f)) {
+                                h[0] = red[i + miny][j + minx];
+                                h[1] = green[i + miny][j + minx];
+                                h[2] = blue[i + miny][j + minx];
+                                h[3] = 1.f;
+                            }
+                        }
+
+                        for (int c = 0; c < 4; ++c) {
+                            hl(c, i, j) = h[c];
+                        }
+                    }
+                }
 
-    //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-    // blur and resample highlight data; range=size of blur, pitch=sample
-    // spacing
+                for (int r = r0; r < r1; ++r) {
+                    const int t = std::max(r * pitch - range, 0);
+                    const int b = std::min(r * pitch + range, blurHeight - 1);
 
-    array2D<float> temp2(blurWidth / pitch + (blurWidth % pitch == 0 ? 0 : 1),
-                         blurHeight);
+                    for (int c = c0; c < c1; ++c) {
+                        const int l = std::max(c * pitch - range, 0);
+                        const int rt =
+                            std::min(c * pitch + range, blurWidth - 1);
+                        const float norm = 1.f / ((b - t + 1) * (rt - l + 1));
 
-    for (int m = 0; m < 4; ++m) {
-        boxblur_resamp(hilite_full[m], hilite[m], temp2, blurHeight, blurWidth,
-                       range, pitch);
+                        for (int m = 0; m < 4; ++m) {
+                            float sum = 0.f;
 
-        if (plistener) {
-            progress += 0.05;
-            plistener->setProgress(progress);
+                            for (int k = t; k <= b; ++k) {
+                                for (int n = l; n <= rt; ++n) {
+                                    sum += hl(m, k, n);
+                                }
+                            }
+
+                            hilite[m][r][c] = sum * norm;
+                        }
+                    }
+                }
+            }
         }
     }
 
-    temp2.free();
+    variation.clear();
 
-    for (int c = 0; c < 4; ++c) {
-        hilite_full[c].free(); // free up some memory
+    if (plistener) {
+        progress += 0.3;
+        plistener->setProgress(progress);
     }
 
     multi_array2D<float, 8> hilite_dir(hfw, hfh, ARRAY2D_CLEAR_DATA, 64);
@@ -621,77 +488,60 @@ void RawImageSource::HLRecovery_inpaint(int blur)
         plistener->setProgress(progress);
     }
 
-    // fill gaps in highlight map by directional extension
-    // raster scan from four corners
-    for (int j = 1; j < hfw - 1; ++j) {
-        for (int i = 2; i < hfh - 2; ++i) {
-            // from left
-            if (hilite[3][i][j] > epsilon) {
-                hilite_dir0[3][j][i] = 1.f;
-            } else {
-                hilite_dir0[3][j][i] = (hilite_dir0[0 + 3][j - 1][i - 2] +
-                                        hilite_dir0[0 + 3][j - 1][i - 1] +
-                                        hilite_dir0[0 + 3][j - 1][i] +
-                                        hilite_dir0[0 + 3][j - 1][i + 1] +
-                                        hilite_dir0[0 + 3][j - 1][i + 2]) == 0.f
-                                           ? 0.f
-                                           : 0.1f;
+    // extension of a point from the 5 nearest points of the previous line:
+    // weight 1 for highlight data, 0.1 for extended data (0 if there's none),
+    // and weighted average of the colour ratios
+    const auto extend = [&](int i, int j, const float *const prev[4],
+                            float *const dst[4]) {
+        if (hilite[3][i][j] > epsilon) {
+            for (int c = 0; c < 3; ++c) {
+                *dst[c] = hilite[c][i][j] / hilite[3][i][j];
             }
-        }
 
-        if (hilite[3][2][j] <= epsilon) {
-            hilite_dir[0 + 3][0][j] = hilite_dir0[3][j][2];
-        }
+            *dst[3] = 1.f;
+        } else {
+            const float wsum = prev[3][-2] + prev[3][-1] + prev[3][0] +
+                               prev[3][1] + prev[3][2];
 
-        if (hilite[3][3][j] <= epsilon) {
-            hilite_dir[0 + 3][1][j] = hilite_dir0[3][j][3];
-        }
-
-        if (hilite[3][hfh - 3][j] <= epsilon) {
-            hilite_dir[4 + 3][hfh - 1][j] = hilite_dir0[3][j][hfh - 3];
-        }
-
-        if (hilite[3][hfh - 4][j] <= epsilon) {
-            hilite_dir[4 + 3][hfh - 2][j] = hilite_dir0[3][j][hfh - 4];
-        }
-    }
+            for (int c = 0; c < 3; ++c) {
+                *dst[c] = 0.1f * ((prev[c][-2] + prev[c][-1] + prev[c][0] +
+                                   prev[c][1] + prev[c][2]) /
+                                  (wsum + epsilon));
+            }
 
-    for (int i = 2; i < hfh - 2; ++i) {
-        if (hilite[3][i][hfw - 2] <= epsilon) {
-            hilite_dir4[3][hfw - 1][i] = hilite_dir0[3][hfw - 2][i];
+            *dst[3] = wsum == 0.f ? 0.f : 0.1f;
         }
-    }
+    };
 
+    // fill gaps in highlight map by directional extension
+    // raster scan from four corners. Each line only depends on the previous
+    // one, so the lines are processed in order, and the points of each line
+    // in parallel
 #ifdef _OPENMP
-#pragma omp parallel
+#pragma omp parallel if (hfw * hfh > 256 * 256)
 #endif
     {
+        // from left
+        for (int j = 1; j < hfw - 1; ++j) {
 #ifdef _OPENMP
-#pragma omp for nowait
+#pragma omp for
 #endif
-        for (int c = 0; c < 3; ++c) {
-            for (int j = 1; j < hfw - 1; ++j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    // from left
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir0[c][j][i] =
-                            hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir0[c][j][i] =
-                            0.1f *
-                            ((hilite_dir0[0 + c][j - 1][i - 2] +
-                              hilite_dir0[0 + c][j - 1][i - 1] +
-                              hilite_dir0[0 + c][j - 1][i] +
-                              hilite_dir0[0 + c][j - 1][i + 1] +
-                              hilite_dir0[0 + c][j - 1][i + 2]) /
-                             (hilite_dir0[0 + 3][j - 1][i - 2] +
-                              hilite_dir0[0 + 3][j - 1][i - 1] +
-                              hilite_dir0[0 + 3][j - 1][i] +
-                              hilite_dir0[0 + 3][j - 1][i + 1] +
-                              hilite_dir0[0 + 3][j - 1][i + 2] + epsilon));
-                    }
-                }
+            for (int i = 2; i < hfh - 2; ++i) {
+                const float *const prev[4] = {
+                    &hilite_dir0[0][j - 1][i], &hilite_dir0[1][j - 1][i],
+                    &hilite_dir0[2][j - 1][i], &hilite_dir0[3][j - 1][i]};
+                float *const dst[4] = {
+                    &hilite_dir0[0][j][i], &hilite_dir0[1][j][i],
+                    &hilite_dir0[2][j][i], &hilite_dir0[3][j][i]};
+                extend(i, j, prev, dst);
+            }
+        }
 
+#ifdef _OPENMP
+#pragma omp single
+#endif
+        for (int c = 0; c < 4; ++c) {
+            for (int j = 1; j < hfw - 1; ++j) {
                 if (hilite[3][2][j] <= epsilon) {
                     hilite_dir[0 + c][0][j] = hilite_dir0[c][j][2];
                 }
@@ -716,91 +566,27 @@ void RawImageSource::HLRecovery_inpaint(int blur)
             }
         }
 
+        // from right
+        for (int j = hfw - 2; j > 0; --j) {
 #ifdef _OPENMP
-#pragma omp single
+#pragma omp for
 #endif
-        {
-            for (int j = hfw - 2; j > 0; --j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    // from right
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir4[3][j][i] = 1.f;
-                    } else {
-                        hilite_dir4[3][j][i] =
-                            (hilite_dir4[3][(j + 1)][(i - 2)] +
-                             hilite_dir4[3][(j + 1)][(i - 1)] +
-                             hilite_dir4[3][(j + 1)][(i)] +
-                             hilite_dir4[3][(j + 1)][(i + 1)] +
-                             hilite_dir4[3][(j + 1)][(i + 2)]) == 0.f
-                                ? 0.f
-                                : 0.1f;
-                    }
-                }
-
-                if (hilite[3][2][j] <= epsilon) {
-                    hilite_dir[0 + 3][0][j] += hilite_dir4[3][j][2];
-                }
-
-                if (hilite[3][hfh - 3][j] <= epsilon) {
-                    hilite_dir[4 + 3][hfh - 1][j] += hilite_dir4[3][j][hfh - 3];
-                }
-            }
-
             for (int i = 2; i < hfh - 2; ++i) {
-                if (hilite[3][i][0] <= epsilon) {
-                    hilite_dir[0 + 3][i - 2][0] += hilite_dir4[3][0][i];
-                    hilite_dir[4 + 3][i + 2][0] += hilite_dir4[3][0][i];
-                }
-
-                if (hilite[3][i][1] <= epsilon) {
-                    hilite_dir[0 + 3][i - 2][1] += hilite_dir4[3][1][i];
-                    hilite_dir[4 + 3][i + 2][1] += hilite_dir4[3][1][i];
-                }
-
-                if (hilite[3][i][hfw - 2] <= epsilon) {
-                    hilite_dir[0 + 3][i - 2][hfw - 2] +=
-                        hilite_dir4[3][hfw - 2][i];
-                    hilite_dir[4 + 3][i + 2][hfw - 2] +=
-                        hilite_dir4[3][hfw - 2][i];
-                }
+                const float *const prev[4] = {
+                    &hilite_dir4[0][j + 1][i], &hilite_dir4[1][j + 1][i],
+                    &hilite_dir4[2][j + 1][i], &hilite_dir4[3][j + 1][i]};
+                float *const dst[4] = {
+                    &hilite_dir4[0][j][i], &hilite_dir4[1][j][i],
+                    &hilite_dir4[2][j][i], &hilite_dir4[3][j][i]};
+                extend(i, j, prev, dst);
             }
         }
-    }
-    if (plistener) {
-        progress += 0.05;
-        plistener->setProgress(progress);
-    }
 
 #ifdef _OPENMP
-#pragma omp parallel
-#endif
-    {
-#ifdef _OPENMP
-#pragma omp for nowait
+#pragma omp single
 #endif
-        for (int c = 0; c < 3; ++c) {
+        for (int c = 0; c < 4; ++c) {
             for (int j = hfw - 2; j > 0; --j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    // from right
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir4[c][j][i] =
-                            hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir4[c][j][i] =
-                            0.1f *
-                            ((hilite_dir4[c][(j + 1)][(i - 2)] +
-                              hilite_dir4[c][(j + 1)][(i - 1)] +
-                              hilite_dir4[c][(j + 1)][(i)] +
-                              hilite_dir4[c][(j + 1)][(i + 1)] +
-                              hilite_dir4[c][(j + 1)][(i + 2)]) /
-                             (hilite_dir4[3][(j + 1)][(i - 2)] +
-                              hilite_dir4[3][(j + 1)][(i - 1)] +
-                              hilite_dir4[3][(j + 1)][(i)] +
-                              hilite_dir4[3][(j + 1)][(i + 1)] +
-                              hilite_dir4[3][(j + 1)][(i + 2)] + epsilon));
-                    }
-                }
-
                 if (hilite[3][2][j] <= epsilon) {
                     hilite_dir[0 + c][0][j] += hilite_dir4[c][j][2];
                 }
@@ -830,71 +616,26 @@ void RawImageSource::HLRecovery_inpaint(int blur)
             }
         }
 
+        // from top
+        for (int i = 1; i < hfh - 1; ++i) {
 #ifdef _OPENMP
-#pragma omp single
+#pragma omp for
 #endif
-        {
-            for (int i = 1; i < hfh - 1; ++i)
-                for (int j = 2; j < hfw - 2; ++j) {
-                    // from top
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir[0 + 3][i][j] = 1.f;
-                    } else {
-                        hilite_dir[0 + 3][i][j] =
-                            (hilite_dir[0 + 3][i - 1][j - 2] +
-                             hilite_dir[0 + 3][i - 1][j - 1] +
-                             hilite_dir[0 + 3][i - 1][j] +
-                             hilite_dir[0 + 3][i - 1][j + 1] +
-                             hilite_dir[0 + 3][i - 1][j + 2]) == 0.f
-                                ? 0.f
-                                : 0.1f;
-                    }
-                }
-
             for (int j = 2; j < hfw - 2; ++j) {
-                if (hilite[3][hfh - 2][j] <= epsilon) {
-                    hilite_dir[4 + 3][hfh - 1][j] +=
-                        hilite_dir[0 + 3][hfh - 2][j];
-                }
+                const float *const prev[4] = {
+                    &hilite_dir[0][i - 1][j], &hilite_dir[1][i - 1][j],
+                    &hilite_dir[2][i - 1][j], &hilite_dir[3][i - 1][j]};
+                float *const dst[4] = {
+                    &hilite_dir[0][i][j], &hilite_dir[1][i][j],
+                    &hilite_dir[2][i][j], &hilite_dir[3][i][j]};
+                extend(i, j, prev, dst);
             }
         }
-    }
-    if (plistener) {
-        progress += 0.05;
-        plistener->setProgress(progress);
-    }
 
 #ifdef _OPENMP
-#pragma omp parallel
-#endif
-    {
-#ifdef _OPENMP
-#pragma omp for nowait
+#pragma omp single
 #endif
-        for (int c = 0; c < 3; ++c) {
-            for (int i = 1; i < hfh - 1; ++i) {
-                for (int j = 2; j < hfw - 2; ++j) {
-                    // from top
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir[0 + c][i][j] =
-                            hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir[0 + c][i][j] =
-                            0.1f *
-                            ((hilite_dir[0 + c][i - 1][j - 2] +
-                              hilite_dir[0 + c][i - 1][j - 1] +
-                              hilite_dir[0 + c][i - 1][j] +
-                              hilite_dir[0 + c][i - 1][j + 1] +
-                              hilite_dir[0 + c][i - 1][j + 2]) /
-                             (hilite_dir[0 + 3][i - 1][j - 2] +
-                              hilite_dir[0 + 3][i - 1][j - 1] +
-                              hilite_dir[0 + 3][i - 1][j] +
-                              hilite_dir[0 + 3][i - 1][j + 1] +
-                              hilite_dir[0 + 3][i - 1][j + 2] + epsilon));
-                    }
-                }
-            }
-
+        for (int c = 0; c < 4; ++c) {
             for (int j = 2; j < hfw - 2; ++j) {
                 if (hilite[3][hfh - 2][j] <= epsilon) {
                     hilite_dir[4 + c][hfh - 1][j] +=
@@ -903,62 +644,25 @@ void RawImageSource::HLRecovery_inpaint(int blur)
             }
         }
 
-#ifdef _OPENMP
-#pragma omp single
-#endif
+        // from bottom
         for (int i = hfh - 2; i > 0; --i) {
-            for (int j = 2; j < hfw - 2; ++j) {
-                // from bottom
-                if (hilite[3][i][j] > epsilon) {
-                    hilite_dir[4 + 3][i][j] = 1.f;
-                } else {
-                    hilite_dir[4 + 3][i][j] =
-                        (hilite_dir[4 + 3][(i + 1)][(j - 2)] +
-                         hilite_dir[4 + 3][(i + 1)][(j - 1)] +
-                         hilite_dir[4 + 3][(i + 1)][(j)] +
-                         hilite_dir[4 + 3][(i + 1)][(j + 1)] +
-                         hilite_dir[4 + 3][(i + 1)][(j + 2)]) == 0.f
-                            ? 0.f
-                            : 0.1f;
-                }
-            }
-        }
-    }
-
-    if (plistener) {
-        progress += 0.05;
-        plistener->setProgress(progress);
-    }
-
 #ifdef _OPENMP
-#pragma omp parallel for
+#pragma omp for
 #endif
-    for (int c = 0; c < 4; ++c) {
-        for (int i = hfh - 2; i > 0; --i) {
             for (int j = 2; j < hfw - 2; ++j) {
-                // from bottom
-                if (hilite[3][i][j] > epsilon) {
-                    hilite_dir[4 + c][i][j] = hilite[c][i][j] / hilite[3][i][j];
-                } else {
-                    hilite_dir[4 + c][i][j] =
-                        0.1f *
-                        ((hilite_dir[4 + c][(i + 1)][(j - 2)] +
-                          hilite_dir[4 + c][(i + 1)][(j - 1)] +
-                          hilite_dir[4 + c][(i + 1)][(j)] +
-                          hilite_dir[4 + c][(i + 1)][(j + 1)] +
-                          hilite_dir[4 + c][(i + 1)][(j + 2)]) /
-                         (hilite_dir[4 + 3][(i + 1)][(j - 2)] +
-                          hilite_dir[4 + 3][(i + 1)][(j - 1)] +
-                          hilite_dir[4 + 3][(i + 1)][(j)] +
-                          hilite_dir[4 + 3][(i + 1)][(j + 1)] +
-                          hilite_dir[4 + 3][(i + 1)][(j + 2)] + epsilon));
-                }
+                const float *const prev[4] = {
+                    &hilite_dir[4][i + 1][j], &hilite_dir[5][i + 1][j],
+                    &hilite_dir[6][i + 1][j], &hilite_dir[7][i + 1][j]};
+                float *const dst[4] = {
+                    &hilite_dir[4][i][j], &hilite_dir[5][i][j],
+                    &hilite_dir[6][i][j], &hilite_dir[7][i][j]};
+                extend(i, j, prev, dst);
             }
         }
     }
 
     if (plistener) {
-        progress += 0.05;
+        progress += 0.2;
         plistener->setProgress(progress);
     }
 
@@ -1478,68 +1182,8 @@ void RawImageSource::HLRecovery_inpaint(int blur)
 
 namespace {
 
-constexpr int HL_BORDER = 8;
 constexpr float HL_POWERF = 3.0f;
 
-// void border_fill_zero(int *d, int width, int height)
-// {
-//     for (int i = 0; i < HL_BORDER * width; i++) {
-//         d[i] = 0;
-//     }
-//     for (int i = (height - HL_BORDER - 1) * width; i < width*height; i++) {
-//         d[i] = 0;
-//     }
-//     for (int row = HL_BORDER; row < height - HL_BORDER; row++) {
-//         int *p1 = d + row*width;
-//         int *p2 = d + (row+1)*width - HL_BORDER;
-//         for(int i = 0; i < HL_BORDER; i++) {
-//             p1[i] = p2[i] = 0;
-//         }
-//     }
-// }
-
-int test_dilate(const int *img, int i, int w1)
-{
-    int retval = 0;
-    retval = img[i - w1 - 1] | img[i - w1] | img[i - w1 + 1] | img[i - 1] |
-             img[i] | img[i + 1] | img[i + w1 - 1] | img[i + w1] |
-             img[i + w1 + 1];
-    if (retval) {
-        return retval;
-    }
-
-    const size_t w2 = 2 * w1;
-    retval = img[i - w2 - 1] | img[i - w2] | img[i - w2 + 1] | img[i - w1 - 2] |
-             img[i - w1 + 2] | img[i - 2] | img[i + 2] | img[i + w1 - 2] |
-             img[i + w1 + 2] | img[i + w2 - 1] | img[i + w2] | img[i + w2 + 1];
-    if (retval) {
-        return retval;
-    }
-
-    const size_t w3 = 3 * w1;
-    retval = img[i - w3 - 2] | img[i - w3 - 1] | img[i - w3] | img[i - w3 + 1] |
-             img[i - w3 + 2] | img[i - w2 - 3] | img[i - w2 - 2] |
-             img[i - w2 + 2] | img[i - w2 + 3] | img[i - w1 - 3] |
-             img[i - w1 + 3] | img[i - 3] | img[i + 3] | img[i + w1 - 3] |
-             img[i + w1 + 3] | img[i + w2 - 3] | img[i + w2 - 2] |
-             img[i + w2 + 2] | img[i + w2 + 3] | img[i + w3 - 2] |
-             img[i + w3 - 1] | img[i + w3] | img[i + w3 + 1] | img[i + w3 + 2];
-    return retval;
-}
-
-void dilating(const int *img, int *o, int w1, int height)
-{
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-    for (int row = HL_BORDER; row < height - HL_BORDER; row++) {
-        for (int col = HL_BORDER, i = row * w1 + col; col < w1 - HL_BORDER;
-             col++, i++) {
-            o[i] = test_dilate(img, i, w1);
-        }
-    }
-}
-
 } // namespace
 
 void RawImageSource::highlight_recovery_opposed(float scale_mul[3],
@@ -1568,202 +1212,130 @@ void RawImageSource::highlight_recovery_opposed(float scale_mul[3],
     };
     const float clips[3] = {clipval * float(rr), clipval * float(gg),
                             clipval * float(bb)};
-    const float clipdark[3] = {0.03f * clips[0], 0.125f * clips[1],
-                               0.03f * clips[2]};
 
-    bool anyclipped = false;
     float **chan[3] = {red, green, blue};
 
-    const float clipscale[3] = {clips[0] / scalecoeffs[0],
-                                clips[1] / scalecoeffs[1],
-                                clips[2] / scalecoeffs[2]};
-
-    int x1 = W, y1 = H, x2 = 0, y2 = 0;
-    for (int y = 0; y < H; ++y) {
-        for (int x = 0; x < W; ++x) {
-            for (int c = 0; c < 3; ++c) {
-                if (chan[c][y][x] >= clipscale[c]) {
-                    anyclipped = true;
-                    x1 = std::min(x, x1);
-                    x2 = std::max(x, x2);
-                    y1 = std::min(y, y1);
-                    y2 = std::max(y, y2);
-                }
-            }
-        }
-    }
-
-    if (!anyclipped) {
-        if (plistener) {
-            plistener->setProgress(1.0);
-        }
-        return;
-    }
-
-    x1 = std::max(x1 - 1, 0);
-    x2 = std::min(x2 + 1, W - 1);
-    y1 = std::max(y1 - 1, 0);
-    y2 = std::min(y2 + 1, H - 1);
+    const auto scaled = [&](int c, int y, int x) -> float {
+        return chan[c][y][x] * scalecoeffs[c];
+    };
 
-    const int cW = x2 - x1 + 1;
-    const int cH = y2 - y1 + 1;
+    // The original algorithm further corrects the reconstructed values with a
+    // global chrominance offset, estimated from the differences between the
+    // unclipped values close to the clipped areas and their refavg. Here
+    // refavg is only computed for clipped channels, so those differences are
+    // zero by construction, and the correction is omitted. Each pixel then
+    // only depends on its 3x3 neighbourhood, which allows processing the
+    // image in independent tiles, skipping the ones without clipped pixels
+    constexpr int ts = HL_TILE_SIZE;
+    const int tilesH = (H + ts - 1) / ts;
+    const int tilesW = (W + ts - 1) / ts;
+
+    // reconstructed values of the tiles with clipped pixels. They are written
+    // back only after all the tiles are done, because the neighbourhoods
+    // cross the tile borders
+    std::vector<std::vector<float>> result(tilesH * tilesW);
 
 #ifdef _OPENMP
-#pragma omp parallel for
+#pragma omp parallel for collapse(2) schedule(dynamic)
 #endif
-    for (int y = 0; y < cH; ++y) {
-        const int yy = y + y1;
-        for (int x = 0; x < cW; ++x) {
-            const int xx = x + x1;
-            for (int c = 0; c < 3; ++c) {
-                chan[c][yy][xx] *= scalecoeffs[c];
-            }
-        }
-    }
-
-    if (plistener) {
-        plistener->setProgress(0.1);
-    }
-
-    multi_array2D<float, 3> tmp(cW, cH);
-
-    const int pwidth = cW + 2 * HL_BORDER;
-    const int pheight = cH + 2 * HL_BORDER;
-    const int p_size = pwidth * pheight;
-    AlignedBuffer<int> mask_vec(4 * p_size);
-    int *mask_buffer = mask_vec.data;
-
-    const auto mask_val = [&](int c, int y, int x) -> int & {
-        return mask_buffer[c * p_size + (HL_BORDER + y) * pwidth + x +
-                           HL_BORDER];
-    };
-
-    const auto set_refavg = [&](int y, int x) -> bool {
-        const int yy = y + y1;
-        const int xx = x + x1;
-        bool found = false;
-        for (int c = 0; c < 3 && !found; ++c) {
-            if (chan[c][yy][xx] >= clips[c]) {
-                found = true;
-            }
-        }
-        if (!found) {
-            return false;
-        }
-
-        float mean[3] = {0.0f, 0.0f, 0.0f};
-        for (int dy = -1; dy < 2; dy++) {
-            for (int dx = -1; dx < 2; dx++) {
-                for (int c = 0; c < 3; ++c) {
-                    mean[c] += std::max(0.0f, chan[c][yy + dy][xx + dx]);
+    for (int ty = 0; ty < tilesH; ++ty) {
+        for (int tx = 0; tx < tilesW; ++tx) {
+            // pixels on the image borders are left untouched
+            const int y0 = std::max(ty * ts, 1);
+            const int y1 = std::min((ty + 1) * ts, H - 1);
+            const int x0 = std::max(tx * ts, 1);
+            const int x1 = std::min((tx + 1) * ts, W - 1);
+            bool found = false;
+
+            for (int y = y0; y < y1 && !found; ++y) {
+                for (int x = x0; x < x1 && !found; ++x) {
+                    for (int c = 0; c < 3 && !found; ++c) {
+                        found = scaled(c, y, x) >= clips[c];
+                    }
                 }
             }
-        }
-        for (int c = 0; c < 3; ++c) {
-            mean[c] = pow_F(mean[c] / 9.0f, 1.0f / HL_POWERF);
-        }
-
-        const float croot_refavg[3] = {0.5f * (mean[1] + mean[2]),
-                                       0.5f * (mean[0] + mean[2]),
-                                       0.5f * (mean[0] + mean[1])};
 
-        for (int c = 0; c < 3; ++c) {
-            if (chan[c][yy][xx] >= clips[c]) {
-                tmp[c][y][x] = pow_F(croot_refavg[c], HL_POWERF);
-                mask_val(c, y, x) = 1;
+            if (!found) {
+                continue;
             }
-        }
-        return true;
-    };
 
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-    for (int y = 0; y < cH; ++y) {
-        const int yy = y + y1;
-        for (int x = 0; x < cW; ++x) {
-            const int xx = x + x1;
-            for (int c = 0; c < 3; ++c) {
-                tmp[c][y][x] = std::max(0.f, chan[c][yy][xx]);
-            }
+            auto &dst = result[ty * tilesW + tx];
+            dst.resize(3 * ts * ts);
 
-            if ((x > 0) && (x < cW - 1) && (y > 0) && (y < cH - 1)) {
-                set_refavg(y, x);
-            }
-        }
-    }
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    float *const out = &dst[(y - ty * ts) * ts + x - tx * ts];
+                    bool clipped = false;
 
-    if (plistener) {
-        plistener->setProgress(0.3);
-    }
+                    for (int c = 0; c < 3; ++c) {
+                        out[c * ts * ts] = chan[c][y][x];
+                        clipped = clipped || scaled(c, y, x) >= clips[c];
+                    }
 
-    for (size_t i = 0; i < 3; i++) {
-        int *mask = mask_buffer + i * p_size;
-        int *tmp = mask_buffer + 3 * p_size;
-        // border_fill_zero(mask, pwidth, pheight);
-        dilating(mask, tmp, pwidth, pheight);
-        memcpy(mask, tmp, p_size * sizeof(int));
-    }
+                    if (!clipped) {
+                        continue;
+                    }
 
-    float cr_sum[3] = {0.f, 0.f, 0.f};
-    int cr_cnt[3] = {0, 0, 0};
+                    float mean[3] = {0.0f, 0.0f, 0.0f};
+                    for (int dy = -1; dy < 2; dy++) {
+                        for (int dx = -1; dx < 2; dx++) {
+                            for (int c = 0; c < 3; ++c) {
+                                mean[c] +=
+                                    std::max(0.0f, scaled(c, y + dy, x + dx));
+                            }
+                        }
+                    }
+                    for (int c = 0; c < 3; ++c) {
+                        mean[c] = pow_F(mean[c] / 9.0f, 1.0f / HL_POWERF);
+                    }
 
-#ifdef _OPENMP
-#pragma omp parallel for reduction(+ : cr_sum, cr_cnt)
-#endif
-    for (int y = 1; y < cH - 1; ++y) {
-        const int yy = y + y1;
-        for (int x = 1; x < cW - 1; ++x) {
-            const int xx = x + x1;
-            for (int c = 0; c < 3; ++c) {
-                const float inval = std::max(0.0f, chan[c][yy][xx]);
-                if (mask_val(c, y, x) && (inval > clipdark[c]) &&
-                    (inval < clips[c])) {
-                    cr_sum[c] += inval - tmp[c][y][x];
-                    ++cr_cnt[c];
+                    const float croot_refavg[3] = {0.5f * (mean[1] + mean[2]),
+                                                   0.5f * (mean[0] + mean[2]),
+                                                   0.5f * (mean[0] + mean[1])};
+
+                    for (int c = 0; c < 3; ++c) {
+                        const float inval = scaled(c, y, x);
+                        if (inval >= clips[c]) {
+                            out[c * ts * ts] =
+                                std::max(inval,
+                                         pow_F(croot_refavg[c], HL_POWERF)) /
+                                scalecoeffs[c];
+                        }
+                    }
                 }
             }
         }
     }
 
     if (plistener) {
-        plistener->setProgress(0.6);
+        plistener->setProgress(0.9);
     }
 
-    float chrominance[3] = {cr_sum[0] / std::max(1.f, float(cr_cnt[0])),
-                            cr_sum[1] / std::max(1.f, float(cr_cnt[1])),
-                            cr_sum[2] / std::max(1.f, float(cr_cnt[2]))};
-
 #ifdef _OPENMP
-#pragma omp parallel for
+#pragma omp parallel for collapse(2) schedule(dynamic)
 #endif
-    for (int y = 0; y < cH; ++y) {
-        const int yy = y + y1;
-        for (int x = 0; x < cW; ++x) {
-            const int xx = x + x1;
-            for (int c = 0; c < 3; ++c) {
-                const float inval = std::max(0.0f, chan[c][yy][xx]);
-                if (inval >= clips[c]) {
-                    chan[c][yy][xx] =
-                        std::max(inval, tmp[c][y][x] + chrominance[c]);
-                }
+    for (int ty = 0; ty < tilesH; ++ty) {
+        for (int tx = 0; tx < tilesW; ++tx) {
+            const auto &src = result[ty * tilesW + tx];
+
+            if (src.empty()) {
+                continue;
             }
-        }
-    }
 
-    if (plistener) {
-        plistener->setProgress(0.9);
-    }
+            const int y0 = std::max(ty * ts, 1);
+            const int y1 = std::min((ty + 1) * ts, H - 1);
+            const int x0 = std::max(tx * ts, 1);
+            const int x1 = std::min((tx + 1) * ts, W - 1);
 
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-    for (int y = 0; y < cH; ++y) {
-        const int yy = y + y1;
-        for (int x = 0; x < cW; ++x) {
-            const int xx = x + x1;
-            for (int c = 0; c < 3; ++c) {
-                chan[c][yy][xx] /= scalecoeffs[c];
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    const float *const in =
+                        &src[(y - ty * ts) * ts + x - tx * ts];
+
+                    for (int c = 0; c < 3; ++c) {
+                        chan[c][y][x] = in[c * ts * ts];
+                    }
+                }
             }
         }
     }
@@ -357,7 +357,6 @@ class ICCStore::Implementation {
 public:
     Implementation()
         : loadAll(true), xyz(createXYZProfile()), srgb(cmsCreate_sRGBProfile()),
-          thumb_monitor_xform_(nullptr),
           monitor_profile_hash_("000000000000000000000000000000000")
     {
         // cmsErrorAction(LCMS_ERROR_SHOW);
@@ -375,10 +374,6 @@ public:
 
     ~Implementation()
     {
-        if (thumb_monitor_xform_) {
-            cmsDeleteTransform(thumb_monitor_xform_);
-        }
-
         for (auto &p : wProfiles) {
             if (p.second) {
                 cmsCloseProfile(p.second);
@@ -687,7 +682,7 @@ public:
         return res;
     }
 
-    cmsHTRANSFORM getThumbnailMonitorTransform()
+    LCMSTransform getThumbnailMonitorTransform()
     {
         return thumb_monitor_xform_;
     }
@@ -755,10 +750,7 @@ private:
 
     void update_thumbnail_monitor_transform()
     {
-        if (thumb_monitor_xform_) {
-            cmsDeleteTransform(thumb_monitor_xform_);
-        }
-        thumb_monitor_xform_ = nullptr;
+        thumb_monitor_xform_ = LCMSTransform();
 
         auto monitor = getActiveMonitorProfile_unlocked();
         if (monitor) {
@@ -785,9 +777,11 @@ private:
 
             cmsHPROFILE iprof = cmsCreateLab4Profile(nullptr);
             cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
-            thumb_monitor_xform_ =
+            // not through LCMSTransform::create(), as this runs with the
+            // store locked (and also before lcmsMutex is set up)
+            thumb_monitor_xform_ = LCMSTransform::adopt(
                 cmsCreateTransform(iprof, TYPE_Lab_FLT, monitor, TYPE_RGB_FLT,
-                                   settings->monitorIntent, flags);
+                                   settings->monitorIntent, flags));
             cmsCloseProfile(iprof);
         } else {
             monitor_profile_hash_ = "000000000000000000000000000000000";
@@ -1117,7 +1111,7 @@ private:
 
     mutable MyMutex mutex;
 
-    cmsHTRANSFORM thumb_monitor_xform_;
+    LCMSTransform thumb_monitor_xform_;
     std::string monitor_profile_hash_;
 };
 
@@ -1243,7 +1237,7 @@ std::uint8_t ICCStore::getProofIntents(const Glib::ustring &name) const
     return implementation->getProofIntents(name);
 }
 
-cmsHTRANSFORM ICCStore::getThumbnailMonitorTransform()
+LCMSTransform ICCStore::getThumbnailMonitorTransform()
 {
     return implementation->getThumbnailMonitorTransform();
 }
@@ -28,6 +28,7 @@
 #include <lcms2.h>
 
 #include "color.h"
+#include "lcmstransform.h"
 #include "linalgebra.h"
 #include "settings.h"
 
@@ -112,7 +113,7 @@ public:
     createFromMatrix(const double matrix[3][3], bool gamma = false,
                      const Glib::ustring &name = Glib::ustring());
 
-    cmsHTRANSFORM getThumbnailMonitorTransform();
+    LCMSTransform getThumbnailMonitorTransform();
     const std::string &getThumbnailMonitorHash() const;
 
     bool getProfileMatrix(const Glib::ustring &name, Mat33<float> &out);
@@ -23,6 +23,7 @@
 #include <strings.h>
 #include <tiff.h>
 
+#include "exifreader.h"
 #include "imagedata.h"
 #include "imagesource.h"
 #include "imgiomanager.h"
@@ -58,7 +59,7 @@ FramesMetaData *FramesMetaData::fromFile(const Glib::ustring &fname)
     return new FramesData(fname);
 }
 
-FramesData::FramesData(const Glib::ustring &fname, bool only_make_model)
+FramesData::FramesData(const Glib::ustring &fname, Tags tags)
     : ok_(false), fname_(fname), dcrawFrameCount(0), time(), timeStamp(),
       iso_speed(0), aperture(0.), focal_len(0.), focal_len35mm(0.),
       focus_dist(0.f), shutter(0.), expcomp(0.), make("Unknown"),
@@ -81,6 +82,95 @@ FramesData::FramesData(const Glib::ustring &fname, bool only_make_model)
     orientation.clear();
     lens.clear();
 
+    const auto normalize_make_model = [&]() -> void {
+        if (make.size() > 0) {
+            for (const auto &corp :
+                 {"Canon", "NIKON", "EPSON", "KODAK", "Kodak", "OLYMPUS",
+                  "PENTAX", "RICOH", "MINOLTA", "Minolta", "Konica", "CASIO",
+                  "Sinar", "Phase One", "SAMSUNG", "Mamiya", "MOTOROLA", "Leaf",
+                  "Panasonic"}) {
+                if (make.find(corp) !=
+                    std::string::npos) { // Simplify company names
+                    make = corp;
+                    break;
+                }
+            }
+        }
+        make.erase(make.find_last_not_of(' ') + 1);
+        model.erase(model.find_last_not_of(' ') + 1);
+
+        if (make.length() > 0 && model.find(make + " ") == 0) {
+            model = model.substr(make.length() + 1);
+        }
+    };
+
+    const auto parse_datetime = [&](const std::string &datetime_taken) -> void {
+        if (sscanf(datetime_taken.c_str(), "%d:%d:%d %d:%d:%d", &time.tm_year,
+                   &time.tm_mon, &time.tm_mday, &time.tm_hour, &time.tm_min,
+                   &time.tm_sec) == 6) {
+            auto d = Glib::DateTime::create_utc(time.tm_year, time.tm_mon,
+                                                time.tm_mday, time.tm_hour,
+                                                time.tm_min, time.tm_sec);
+            if (d.gobj()) {
+                d.get_ymd(time.tm_year, time.tm_mon, time.tm_mday);
+                time.tm_year -= 1900;
+                time.tm_mon -= 1;
+                time.tm_hour = d.get_hour();
+                time.tm_min = d.get_minute();
+                time.tm_sec = d.get_second();
+                timeStamp = d.to_unix();
+            }
+        }
+    };
+
+    if (tags != Tags::ALL) {
+        // make/model and the basic tags are standard Exif ones for most
+        // formats: read them directly from the file, and fall back to Exiv2
+        // if any of them is missing, or if the ISO needs the makernotes
+        // (values that do not fit ISOSpeedRatings, or Nikon's Lo/Hi pairs),
+        // so that the result is the same as with a full parse
+        ExifReader reader(fname);
+        if (reader.getString(ExifReader::IFD0, ExifReader::MAKE, make) &&
+            reader.getString(ExifReader::IFD0, ExifReader::MODEL, model) &&
+            !make.empty() && !model.empty()) {
+            if (tags == Tags::MAKE_MODEL) {
+                make = validateUtf8(make);
+                model = validateUtf8(model);
+                normalize_make_model();
+                ok_ = true;
+                return;
+            }
+
+            double exposure = 0.0;
+            std::vector<uint32_t> iso;
+            std::string datetime;
+            if (reader.getRational(ExifReader::EXIF, ExifReader::EXPOSURE_TIME,
+                                   exposure) &&
+                reader.getInts(ExifReader::EXIF, ExifReader::ISO_SPEED, iso) &&
+                iso.size() == 1 && iso[0] > 0 && iso[0] < 65535 &&
+                (reader.getString(ExifReader::IFD0,
+                                  ExifReader::DATETIME_ORIGINAL, datetime) ||
+                 reader.getString(ExifReader::EXIF,
+                                  ExifReader::DATETIME_ORIGINAL, datetime) ||
+                 reader.getString(ExifReader::EXIF,
+                                  ExifReader::DATETIME_DIGITIZED, datetime) ||
+                 reader.getString(ExifReader::IFD0, ExifReader::DATETIME,
+                                  datetime))) {
+                make = validateUtf8(make);
+                model = validateUtf8(model);
+                normalize_make_model();
+                // same rounding as Exiv2's toFloat()
+                shutter = float(exposure);
+                iso_speed = iso[0];
+                parse_datetime(validateUtf8(datetime));
+                ok_ = true;
+                return;
+            }
+        }
+        make.clear();
+        model.clear();
+    }
+
     try {
         Exiv2Metadata meta(fname);
         meta.load();
@@ -138,27 +228,9 @@ FramesData::FramesData(const Glib::ustring &fname, bool only_make_model)
             model = validateUtf8(pos->print(&exif));
         }
 
-        if (make.size() > 0) {
-            for (const auto &corp :
-                 {"Canon", "NIKON", "EPSON", "KODAK", "Kodak", "OLYMPUS",
-                  "PENTAX", "RICOH", "MINOLTA", "Minolta", "Konica", "CASIO",
-                  "Sinar", "Phase One", "SAMSUNG", "Mamiya", "MOTOROLA", "Leaf",
-                  "Panasonic"}) {
-                if (make.find(corp) !=
-                    std::string::npos) { // Simplify company names
-                    make = corp;
-                    break;
-                }
-            }
-        }
-        make.erase(make.find_last_not_of(' ') + 1);
-        model.erase(model.find_last_not_of(' ') + 1);
+        normalize_make_model();
 
-        if (make.length() > 0 && model.find(make + " ") == 0) {
-            model = model.substr(make.length() + 1);
-        }
-
-        if (only_make_model) {
+        if (tags == Tags::MAKE_MODEL) {
             return;
         }
 
@@ -368,23 +440,7 @@ FramesData::FramesData(const Glib::ustring &fname, bool only_make_model)
             find_exif_tag("Exif.Photo.DateTimeOriginal") ||
             find_exif_tag("Exif.Photo.DateTimeDigitized") ||
             find_exif_tag("Exif.Image.DateTime")) {
-            std::string datetime_taken = validateUtf8(pos->print(&exif));
-            if (sscanf(datetime_taken.c_str(), "%d:%d:%d %d:%d:%d",
-                       &time.tm_year, &time.tm_mon, &time.tm_mday,
-                       &time.tm_hour, &time.tm_min, &time.tm_sec) == 6) {
-                auto d = Glib::DateTime::create_utc(time.tm_year, time.tm_mon,
-                                                    time.tm_mday, time.tm_hour,
-                                                    time.tm_min, time.tm_sec);
-                if (d.gobj()) {
-                    d.get_ymd(time.tm_year, time.tm_mon, time.tm_mday);
-                    time.tm_year -= 1900;
-                    time.tm_mon -= 1;
-                    time.tm_hour = d.get_hour();
-                    time.tm_min = d.get_minute();
-                    time.tm_sec = d.get_second();
-                    timeStamp = d.to_unix();
-                }
-            }
+            parse_datetime(validateUtf8(pos->print(&exif)));
         }
 
         if (find_exif_tag("Exif.Image.ExposureBiasValue")) {
@@ -62,7 +62,13 @@ private:
     std::string internal_make_model_;
 
 public:
-    FramesData(const Glib::ustring &fname, bool only_make_model = false);
+    // which tags the constructor reads. ALL goes through Exiv2; MAKE_MODEL
+    // and BASIC (make, model, ISO, shutter speed and date) are read with
+    // ExifReader when possible, skipping the Exiv2 parse, and the other
+    // getters then return their defaults
+    enum class Tags { ALL, MAKE_MODEL, BASIC };
+
+    FramesData(const Glib::ustring &fname, Tags tags = Tags::ALL);
 
     void setDCRawFrameCount(unsigned int frameCount);
     unsigned int getFrameCount() const override;
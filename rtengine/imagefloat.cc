@@ -501,48 +501,6 @@ void Imagefloat::calcCroppedHistogram(const ProcParams &params, float scale,
     }
 }
 
-// Parallelized transformation; create transform with cmsFLAGS_NOCACHE!
-void Imagefloat::ExecCMSTransform(cmsHTRANSFORM hTransform, bool multithread)
-{
-
-    // LittleCMS cannot parallelize planar setups -- Hombre: LCMS2.4 can! But it
-    // we use this new feature, memory allocation have to be modified too to
-    // build temporary buffers that allow multi processor execution
-#ifdef _OPENMP
-#pragma omp parallel if (multithread)
-#endif
-    {
-        AlignedBuffer<float> pBuf(width * 3);
-
-#ifdef _OPENMP
-#pragma omp for schedule(dynamic, 16)
-#endif
-
-        for (int y = 0; y < height; y++) {
-            float *p = pBuf.data, *pR = r(y), *pG = g(y), *pB = b(y);
-
-            for (int x = 0; x < width; x++) {
-                *(p++) = *(pR++);
-                *(p++) = *(pG++);
-                *(p++) = *(pB++);
-            }
-
-            cmsDoTransform(hTransform, pBuf.data, pBuf.data, width);
-
-            p = pBuf.data;
-            pR = r(y);
-            pG = g(y);
-            pB = b(y);
-
-            for (int x = 0; x < width; x++) {
-                *(pR++) = *(p++);
-                *(pG++) = *(p++);
-                *(pB++) = *(p++);
-            }
-        } // End of parallelization
-    }
-}
-
 // Parallelized transformation; create transform with cmsFLAGS_NOCACHE!
 void Imagefloat::ExecCMSTransform(cmsHTRANSFORM hTransform,
                                   const Imagefloat *src, bool multithread)
@@ -770,8 +728,18 @@ void Imagefloat::xyz_to_yuv(bool multithread)
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
-    for (int y = 0; y < height; ++y) { // TODO - SSE2 optimization
-        for (int x = 0; x < width; ++x) {
+    for (int y = 0; y < height; ++y) {
+        int x = 0;
+#ifdef ART_SIMD
+        vfloat Rv, Gv, Bv;
+        for (; x < width - 3; x += 4) {
+            vfloat Yv = LVF(g(y, x));
+            Color::xyz2rgb(LVF(r(y, x)), Yv, LVF(b(y, x)), Rv, Gv, Bv, viws_);
+            STVF(r(y, x), Rv - Yv);
+            STVF(b(y, x), Yv - Bv);
+        }
+#endif
+        for (; x < width; ++x) {
             float R, G, B;
             float Y = g(y, x);
             Color::xyz2rgb(r(y, x), Y, b(y, x), R, G, B, iws_);
@@ -816,8 +784,21 @@ void Imagefloat::yuv_to_xyz(bool multithread)
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
-    for (int y = 0; y < height; ++y) { // TODO - SSE2 optimization
-        for (int x = 0; x < width; ++x) {
+    for (int y = 0; y < height; ++y) {
+        int x = 0;
+#ifdef ART_SIMD
+        vfloat Rv, Gv, Bv;
+        vfloat Xv, Yv, Zv;
+        for (; x < width - 3; x += 4) {
+            Color::yuv2rgb(LVF(g(y, x)), LVF(b(y, x)), LVF(r(y, x)), Rv, Gv,
+                           Bv, vws_);
+            Color::rgbxyz(Rv, Gv, Bv, Xv, Yv, Zv, vws_);
+            STVF(r(y, x), Xv);
+            STVF(g(y, x), Yv);
+            STVF(b(y, x), Zv);
+        }
+#endif
+        for (; x < width; ++x) {
             float R, G, B;
             Color::yuv2rgb(g(y, x), b(y, x), r(y, x), R, G, B, ws_);
             Color::rgbxyz(R, G, B, r(y, x), g(y, x), b(y, x), ws_);
@@ -884,7 +865,18 @@ void Imagefloat::xyz_to_lab(bool multithread)
 #pragma omp parallel for if (multithread)
 #endif
     for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
+        int x = 0;
+#ifdef ART_SIMD
+        vfloat Lv, av, bv;
+        for (; x < width - 3; x += 4) {
+            Color::XYZ2Lab(LVF(r(y, x)), LVF(g(y, x)), LVF(b(y, x)), Lv, av,
+                           bv);
+            STVF(g(y, x), Lv);
+            STVF(r(y, x), av);
+            STVF(b(y, x), bv);
+        }
+#endif
+        for (; x < width; ++x) {
             xyz_to_lab(y, x, g(y, x), r(y, x), b(y, x));
         }
     }
@@ -976,7 +968,18 @@ void Imagefloat::lab_to_xyz(bool multithread)
 #pragma omp parallel for if (multithread)
 #endif
     for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
+        int x = 0;
+#ifdef ART_SIMD
+        vfloat Xv, Yv, Zv;
+        for (; x < width - 3; x += 4) {
+            Color::Lab2XYZ(LVF(g(y, x)), LVF(r(y, x)), LVF(b(y, x)), Xv, Yv,
+                           Zv);
+            STVF(r(y, x), Xv);
+            STVF(g(y, x), Yv);
+            STVF(b(y, x), Zv);
+        }
+#endif
+        for (; x < width; ++x) {
             Color::Lab2XYZ(this->g(y, x), this->r(y, x), this->b(y, x),
                            this->r(y, x), this->g(y, x), this->b(y, x));
         }
@@ -96,7 +96,6 @@ public:
     void normalizeFloatTo65535(bool multithread = true);
     void calcCroppedHistogram(const ProcParams &params, float scale,
                               LUTu &hist);
-    void ExecCMSTransform(cmsHTRANSFORM hTransform, bool multithread);
     void ExecCMSTransform(cmsHTRANSFORM hTransform, const Imagefloat *img,
                           bool multithread);
 
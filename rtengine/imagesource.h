@@ -76,6 +76,9 @@ public:
                             const ColorTemp &wb = ColorTemp()) {};
     virtual void demosaic(const RAWParams &raw, bool autoContrast,
                           double &contrastThreshold) {};
+    // allow demosaic() to bin the raw data for zoomed-out previews, deferring
+    // the full resolution demosaic until something needs it
+    virtual void setLazyDemosaic(bool yes) {}
     virtual void flushRawData() {};
     virtual void flushRGB() {};
     virtual void HLRecovery_Global(const ExposureParams &hrp) {};
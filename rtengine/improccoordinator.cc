@@ -95,6 +95,11 @@ ImProcCoordinator::ImProcCoordinator()
 void ImProcCoordinator::assign(ImageSource *imgsrc)
 {
     this->imgsrc = imgsrc;
+    if (imgsrc) {
+        // zoomed-out previews can be served from binned raw data, see
+        // RawImageSource::bin_demosaic()
+        imgsrc->setLazyDemosaic(true);
+    }
     denoiseInfoStore.valid = false;
 }
 
@@ -154,6 +159,7 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
     ipf.setDCPProfile(dcpProf, dcpApplyState);
     ipf.setViewport(0, 0, -1, -1);
     ipf.setOutputHistograms(&histToneCurve, &histCCurve, &histLCurve);
+    ipf.setCheckpoints(&checkpoints_);
 
     if (todo == CROP && ipf.needsPCVignetting()) {
         todo |= M_LUMINANCE; // TRANSFORM;    // Change about Crop does affect
@@ -915,20 +921,16 @@ void rgb2lab(const Image8 &src, int x, int y, int w, int h, float L[],
     }
 
     if (oprof) {
-        cmsUInt32Number flags =
-            cmsFLAGS_NOOPTIMIZE |
-            cmsFLAGS_NOCACHE; // NOCACHE is important for thread safety
+        cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE;
 
         if (icm.outputBPC) {
             flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
         }
 
-        lcmsMutex->lock();
         cmsHPROFILE LabIProf = cmsCreateLab4Profile(nullptr);
-        cmsHTRANSFORM hTransform = cmsCreateTransform(
+        LCMSTransform hTransform = LCMSTransform::create(
             oprof, TYPE_RGB_8, LabIProf, TYPE_Lab_FLT, icm.outputIntent, flags);
         cmsCloseProfile(LabIProf);
-        lcmsMutex->unlock();
 
         // cmsDoTransform is relatively expensive
 #ifdef _OPENMP
@@ -950,7 +952,7 @@ void rgb2lab(const Image8 &src, int x, int y, int w, int h, float L[],
                 float *ra = a + (i - y) * w;
                 float *rb = b + (i - y) * w;
 
-                cmsDoTransform(hTransform, src.data + ix, outbuffer, w);
+                hTransform(src.data + ix, outbuffer, w);
 
                 for (int j = 0; j < w; j++) {
                     rL[j] = outbuffer[iy++] * 327.68f;
@@ -959,8 +961,6 @@ void rgb2lab(const Image8 &src, int x, int y, int w, int h, float L[],
                 }
             }
         } // End of parallelization
-
-        cmsDeleteTransform(hTransform);
     } else {
         TMatrix wprof = ICCStore::getInstance()->workingSpaceMatrix(profile);
         const float wp[3][3] = {
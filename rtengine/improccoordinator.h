@@ -61,6 +61,7 @@ protected:
     Imagefloat *spotprev;
     Imagefloat *bufs_[3];
     std::array<bool, 4> pipeline_stop_;
+    PipelineCheckpoints checkpoints_;
 
     Imagefloat
         *drcomp_11_dcrop_cache; // global cache for dynamicRangeCompression used
@@ -19,6 +19,7 @@
 #include <cmath>
 #include <glib.h>
 #include <glibmm.h>
+#include <sstream>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -31,6 +32,7 @@
 #include "clutstore.h"
 #include "color.h"
 #include "curves.h"
+#include "featurecache.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
 #include "imagesource.h"
@@ -50,22 +52,17 @@ using namespace procparams;
 extern const Settings *settings;
 
 ImProcFunctions::ImProcFunctions(const ProcParams *iparams, bool imultiThread)
-    : monitor(nullptr), monitorTransform(nullptr), params(iparams), scale(1),
+    : monitor(nullptr), params(iparams), scale(1),
       multiThread(imultiThread), cur_pipeline(Pipeline::OUTPUT),
       dcpProf(nullptr), dcpApplyState(nullptr), pipetteBuffer(nullptr),
       lumimul{}, offset_x(0), offset_y(0), full_width(-1), full_height(-1),
       histToneCurve(nullptr), histCCurve(nullptr), histLCurve(nullptr),
       show_sharpening_mask(false), plistener(nullptr), progress_step(0),
-      progress_end(1)
+      progress_end(1), checkpoints(nullptr)
 {
 }
 
-ImProcFunctions::~ImProcFunctions()
-{
-    if (monitorTransform) {
-        cmsDeleteTransform(monitorTransform);
-    }
-}
+ImProcFunctions::~ImProcFunctions() {}
 
 void ImProcFunctions::setScale(double iscale) { scale = iscale; }
 
@@ -74,12 +71,10 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring &monitorProfile,
                                           bool softProof, GamutCheck gamutCheck)
 {
     // set up monitor transform
-    if (monitorTransform) {
-        cmsDeleteTransform(monitorTransform);
-    }
     gamutWarning.reset(nullptr);
 
-    monitorTransform = nullptr;
+    monitorTransform = LCMSTransform();
+    monitorLUT.reset();
     monitor = nullptr;
 
     if (settings->color_mgmt_mode !=
@@ -92,8 +87,6 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring &monitorProfile,
     }
 
     if (monitor) {
-        MyMutex::MyLock lcmsLock(*lcmsMutex);
-
         cmsUInt32Number flags;
         // cmsHPROFILE iprof  = cmsCreateLab4Profile (nullptr);
         cmsHPROFILE iprof = nullptr;
@@ -161,14 +154,18 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring &monitorProfile,
                     }
                 };
 
-                cmsHPROFILE softproof = ProfileContent(oprof).toProfile();
-                if (softproof) {
-                    make_gamma_table(softproof, cmsSigRedTRCTag);
-                    make_gamma_table(softproof, cmsSigGreenTRCTag);
-                    make_gamma_table(softproof, cmsSigBlueTRCTag);
+                cmsHPROFILE softproof = nullptr;
+                {
+                    MyMutex::MyLock lcmsLock(*lcmsMutex);
+                    softproof = ProfileContent(oprof).toProfile();
+                    if (softproof) {
+                        make_gamma_table(softproof, cmsSigRedTRCTag);
+                        make_gamma_table(softproof, cmsSigGreenTRCTag);
+                        make_gamma_table(softproof, cmsSigBlueTRCTag);
+                    }
                 }
 
-                monitorTransform = cmsCreateProofingTransform(
+                monitorTransform = LCMSTransform::createProofing(
                     iprof, TYPE_RGB_FLT, // TYPE_Lab_FLT,
                     monitor, TYPE_RGB_FLT, softproof, monitorIntent, outIntent,
                     flags);
@@ -179,6 +176,14 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring &monitorProfile,
 
                 if (monitorTransform) {
                     softProofCreated = true;
+                    // the printer simulation is the expensive part of the
+                    // preview, so it goes through a device link table
+                    float g, s;
+                    const bool linear =
+                        ICCStore::getProfileParametricTRC(iprof, g, s) &&
+                        g == 1.f;
+                    monitorLUT =
+                        DeviceLinkLUT::get(monitorTransform, linear);
                 }
 
                 // if (gamutCheck == GAMUT_CHECK_OUTPUT) {
@@ -221,8 +226,8 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring &monitorProfile,
             }
 
             monitorTransform =
-                cmsCreateTransform(iprof, TYPE_RGB_FLT, monitor, TYPE_RGB_FLT,
-                                   monitorIntent, flags);
+                LCMSTransform::create(iprof, TYPE_RGB_FLT, monitor,
+                                      TYPE_RGB_FLT, monitorIntent, flags);
         }
 
         if (gamutCheck && gamutprof) {
@@ -547,6 +552,18 @@ namespace {
 
 constexpr int NUM_PIPELINE_STEPS = 23;
 
+bool has_linked_masks(const ProcParams &params)
+{
+    for (auto mp : params.get_maskable()) {
+        for (auto &m : mp->get_masks()) {
+            if (m.enabled && m.linkedMask.enabled) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 } // namespace
 
 void ImProcFunctions::setProgressListener(ProgressListener *pl,
@@ -609,30 +626,7 @@ bool ImProcFunctions::process(Pipeline pipeline, Stage stage, Imagefloat *img)
         stop = stop || STEP_s_(guidedSmoothing);
         break;
     case Stage::STAGE_3:
-        STEP_(creativeGradients);
-        stop = stop || STEP_s_(textureBoost);
-        if (!stop) {
-            STEP_(filmGrain);
-            STEP_(logEncoding);
-            STEP_(saturationVibrance);
-            if (!params->icm.dcp_look_early) {
-                dcpProfile(img, dcpProf, dcpApplyState, multiThread);
-            }
-            if (!params->filmSimulation.after_tone_curve) {
-                STEP_(filmSimulation);
-            }
-            STEP_(toneCurve);
-            if (params->filmSimulation.after_tone_curve) {
-                STEP_(filmSimulation);
-            }
-            STEP_(rgbCurves);
-            STEP_(labAdjustments);
-            STEP_(softLight);
-        }
-        stop = stop || STEP_s_(localContrast);
-        if (!stop) {
-            STEP_(blackAndWhite);
-        }
+        stop = processStage3(pipeline, img);
         if (pipeline == Pipeline::PREVIEW && params->prsharpening.enabled) {
             double s = scale;
             int fw = full_width * s, fh = full_height * s;
@@ -647,6 +641,159 @@ bool ImProcFunctions::process(Pipeline pipeline, Stage stage, Imagefloat *img)
     return stop;
 }
 
+bool ImProcFunctions::processStage3(Pipeline pipeline, Imagefloat *img)
+{
+    typedef PipelineCheckpoints::Step Step;
+    std::vector<Step> steps;
+
+    steps.push_back(Step{
+        "creativegradients",
+        [](const ProcParams &a, const ProcParams &b) -> bool {
+            return a.gradient == b.gradient && a.pcvignette == b.pcvignette &&
+                   a.vignetting == b.vignetting && a.crop == b.crop &&
+                   a.cacorrection == b.cacorrection &&
+                   a.distortion == b.distortion && a.rotate == b.rotate &&
+                   a.perspective == b.perspective && a.lensProf == b.lensProf;
+        },
+        [=]() -> bool {
+            STEP_(creativeGradients);
+            return false;
+        }});
+    steps.push_back(Step{"textureboost",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.textureBoost == b.textureBoost;
+                         },
+                         [=]() -> bool { return STEP_s_(textureBoost); }});
+    steps.push_back(Step{"filmgrain",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.grain == b.grain;
+                         },
+                         [=]() -> bool {
+                             STEP_(filmGrain);
+                             return false;
+                         }});
+    steps.push_back(Step{"logencoding",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.logenc == b.logenc && a.icm == b.icm;
+                         },
+                         [=]() -> bool {
+                             STEP_(logEncoding);
+                             return false;
+                         }});
+    steps.push_back(Step{"saturation",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.saturation == b.saturation &&
+                                    a.icm == b.icm;
+                         },
+                         [=]() -> bool {
+                             STEP_(saturationVibrance);
+                             return false;
+                         }});
+    if (!params->icm.dcp_look_early) {
+        steps.push_back(
+            Step{"dcp",
+                 [](const ProcParams &a, const ProcParams &b) -> bool {
+                     return a.icm == b.icm;
+                 },
+                 [=]() -> bool {
+                     dcpProfile(img, dcpProf, dcpApplyState, multiThread);
+                     return false;
+                 }});
+    }
+    const Step filmsim{"filmsimulation",
+                       [](const ProcParams &a, const ProcParams &b) -> bool {
+                           return a.filmSimulation == b.filmSimulation &&
+                                  a.icm == b.icm;
+                       },
+                       [=]() -> bool {
+                           STEP_(filmSimulation);
+                           return false;
+                       }};
+    if (!params->filmSimulation.after_tone_curve) {
+        steps.push_back(filmsim);
+    }
+    steps.push_back(Step{"tonecurve",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.toneCurve == b.toneCurve &&
+                                    a.icm == b.icm && a.logenc == b.logenc;
+                         },
+                         [=]() -> bool {
+                             STEP_(toneCurve);
+                             return false;
+                         }});
+    if (params->filmSimulation.after_tone_curve) {
+        steps.push_back(filmsim);
+    }
+    steps.push_back(Step{"rgbcurves",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.rgbCurves == b.rgbCurves;
+                         },
+                         [=]() -> bool {
+                             STEP_(rgbCurves);
+                             return false;
+                         }});
+    steps.push_back(Step{"labadjustments",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.labCurve == b.labCurve;
+                         },
+                         [=]() -> bool {
+                             STEP_(labAdjustments);
+                             return false;
+                         }});
+    steps.push_back(Step{"softlight",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.softlight == b.softlight;
+                         },
+                         [=]() -> bool {
+                             STEP_(softLight);
+                             return false;
+                         }});
+    steps.push_back(Step{"localcontrast",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.localContrast == b.localContrast;
+                         },
+                         [=]() -> bool { return STEP_s_(localContrast); }});
+    steps.push_back(Step{"blackandwhite",
+                         [](const ProcParams &a, const ProcParams &b) -> bool {
+                             return a.blackwhite == b.blackwhite;
+                         },
+                         [=]() -> bool {
+                             STEP_(blackAndWhite);
+                             return false;
+                         }});
+
+    // linked masks are computed from the output of other tools, and the
+    // pipette buffers are filled as a side effect of running the steps, so
+    // in both cases the steps can't be skipped
+    const bool use_checkpoints =
+        checkpoints && settings->pipeline_checkpoints_budget > 0 &&
+        !(pipetteBuffer && pipetteBuffer->getEditID() != EUID_None) &&
+        !has_linked_masks(*params);
+
+    if (!use_checkpoints) {
+        if (checkpoints) {
+            checkpoints->clear();
+        }
+        for (auto &s : steps) {
+            if (s.run()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::ostringstream key;
+    key << int(pipeline) << ":" << img->getWidth() << "x" << img->getHeight()
+        << ":" << int(img->mode()) << ":" << img->colorSpace() << ":" << scale
+        << ":" << offset_x << "," << offset_y << "," << full_width << ","
+        << full_height << ":" << static_cast<const void *>(dcpProf) << ":"
+        << FeatureCache::fingerprint(img, multiThread);
+
+    const bool stop = checkpoints->run(steps, *params, key.str(), img);
+    progress_step += checkpoints->skipped();
+    return stop;
+}
+
 int ImProcFunctions::setDeltaEData(EditUniqueID id, double x, double y)
 {
     deltaE.ok = false;
@@ -26,13 +26,16 @@
 #include "cplx_wavelet_dec.h"
 #include "curves.h"
 #include "dcp.h"
+#include "devicelink.h"
 #include "gamutwarning.h"
 #include "image16.h"
 #include "image8.h"
 #include "imagefloat.h"
 #include "labimage.h"
+#include "lcmstransform.h"
 #include "lcp.h"
 #include "masks.h"
+#include "pipelinecheckpoints.h"
 #include "pipettebuffer.h"
 #include "procparams.h"
 
@@ -65,7 +68,11 @@ public:
     void updateColorProfiles(const Glib::ustring &monitorProfile,
                              RenderingIntent monitorIntent, bool softProof,
                              GamutCheck gamutCheck);
-    void setMonitorTransform(cmsHTRANSFORM xform) { monitorTransform = xform; }
+    void setMonitorTransform(const LCMSTransform &xform)
+    {
+        monitorTransform = xform;
+        monitorLUT.reset();
+    }
 
     void setDCPProfile(DCPProfile *dcp, const DCPProfile::ApplyState &as)
     {
@@ -89,6 +96,7 @@ public:
     void setOutputHistograms(LUTu *histToneCurve, LUTu *histCCurve,
                              LUTu *histLCurve);
     void setShowSharpeningMask(bool yes);
+    void setCheckpoints(PipelineCheckpoints *cp) { checkpoints = cp; }
     //----------------------------------------------------------------------
 
     //----------------------------------------------------------------------
@@ -237,7 +245,9 @@ public:
 
 private:
     cmsHPROFILE monitor;
-    cmsHTRANSFORM monitorTransform;
+    LCMSTransform monitorTransform;
+    // sampled soft-proofing transform, see DeviceLinkLUT
+    std::shared_ptr<const DeviceLinkLUT> monitorLUT;
     std::unique_ptr<GamutWarning> gamutWarning;
 
     const ProcParams *params;
@@ -268,8 +278,11 @@ private:
     int progress_end;
 
     LinkedMaskManager linked_mask_mgr_;
+    PipelineCheckpoints *checkpoints;
 
 private:
+    bool processStage3(Pipeline pipeline, Imagefloat *img);
+
     void transformLuminanceOnly(Imagefloat *original, Imagefloat *transformed,
                                 int cx, int cy, int oW, int oH, int fW, int fH,
                                 bool creative);
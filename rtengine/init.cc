@@ -94,17 +94,18 @@ int init(const Settings *s, Glib::ustring baseDir,
 #pragma omp section
 #endif
         {
+            // the database is big and needed only for lens corrections, so
+            // in lightweight mode (e.g. the CLI) it is loaded on first use
+            std::vector<Glib::ustring> dbdirs;
             if (s->lensfunDbDirectory.empty()) {
-                if (!LFDatabase::init(s->lensfunDbDirectory)) {
-                    LFDatabase::init(
-                        Glib::build_filename(baseDir, "share", "lensfun"));
-                }
+                dbdirs = {s->lensfunDbDirectory,
+                          Glib::build_filename(baseDir, "share", "lensfun")};
             } else if (Glib::path_is_absolute(s->lensfunDbDirectory)) {
-                LFDatabase::init(s->lensfunDbDirectory);
+                dbdirs = {s->lensfunDbDirectory};
             } else {
-                LFDatabase::init(
-                    Glib::build_filename(baseDir, s->lensfunDbDirectory));
+                dbdirs = {Glib::build_filename(baseDir, s->lensfunDbDirectory)};
             }
+            LFDatabase::init(dbdirs, !loadAll);
         }
 #ifdef _OPENMP
 #pragma omp section
@@ -211,7 +212,10 @@ Settings::Settings()
       xmp_sidecar_style(XmpSidecarStyle::STD),
       metadata_xmp_sync(MetadataXmpSync::NONE), thread_pool_size(0),
       ctl_scripts_fast_preview(false),
-      os_monitor_profile(StdMonitorProfile::SRGB), imgio_raw_cache_size(10)
+      os_monitor_profile(StdMonitorProfile::SRGB), imgio_raw_cache_size(10),
+      batch_queue_prefetch(true), fattal_multigrid(false),
+      pipeline_checkpoints_budget(256), lens_exact_apply(false),
+      proofing_exact_apply(false)
 {
 }
 
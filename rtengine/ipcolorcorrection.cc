@@ -236,7 +236,9 @@ bool ImProcFunctions::colorCorrection(Imagefloat *rgb)
             rgb, "colorcorrection", linked_mask_mgr_,
             params->colorcorrection.masks, offset_x, offset_y, full_width,
             full_height, scale, multiThread, show_mask_idx, &Lmask, &abmask,
-            cur_pipeline == Pipeline::NAVIGATOR ? plistener : nullptr)) {
+            cur_pipeline == Pipeline::NAVIGATOR ? plistener : nullptr,
+            cur_pipeline == Pipeline::PREVIEW ||
+                cur_pipeline == Pipeline::NAVIGATOR)) {
         return true; // show mask is active, nothing more to do
     }
 
@@ -28,6 +28,7 @@
  *
  */
 
+#include "featurecache.h"
 #include "guidedfilter.h"
 #include "improcfun.h"
 #include "rescale.h"
@@ -37,6 +38,7 @@
 #include "boxblur.h"
 #include <iostream>
 #include <queue>
+#include <sstream>
 
 extern Options options;
 
@@ -371,7 +373,28 @@ void ImProcFunctions::dehaze(Imagefloat *img)
     array2D<float> &t_tilde = dark;
     float max_t = 0.f;
 
-    {
+    // the dark channel and the ambient light depend only on the input image,
+    // so they can be reused when only the strength curve changes
+    std::string cache_key;
+    std::shared_ptr<const FeatureCache::Entry> cached;
+    if ((cur_pipeline == Pipeline::PREVIEW ||
+         cur_pipeline == Pipeline::NAVIGATOR) &&
+        FeatureCache::cacheable(size_t(W) * size_t(H))) {
+        std::ostringstream buf;
+        buf << "dehaze:" << W << 'x' << H << ':' << scale << ':'
+            << FeatureCache::fingerprint(img, multiThread);
+        cache_key = buf.str();
+        cached = FeatureCache::get(cache_key);
+    }
+
+    if (cached) {
+        patchsize = int(cached->values[0]);
+        max_t = cached->values[1];
+        std::copy(cached->values.begin() + 2, cached->values.end(), ambient);
+        if (max_t >= 0.f) {
+            FeatureCache::copy(cached->planes[0], dark, multiThread);
+        }
+    } else {
         // array2D<float> R(W, H);
         array2D<float> &R =
             dark; // R and dark can safely use the same buffer, which is faster
@@ -398,23 +421,39 @@ void ImProcFunctions::dehaze(Imagefloat *img)
                                             false, multiThread);
             max_t = estimate_ambient_light(RR, GG, BB, D, patchsize, npatches,
                                            ambient);
-            if (max_t < 0.f) {
-                if (options.rtSettings.verbose) {
-                    std::cout << "dehaze: no haze detected" << std::endl;
-                }
-                restore(img, maxchan, multiThread);
-                return; // probably no haze at all
-            }
         }
 
-        patchsize = max(max(W, H) / 600, 2);
+        if (max_t >= 0.f) {
+            patchsize = max(max(W, H) / 600, 2);
+            get_dark_channel(R, G, B, dark, patchsize, ambient, true,
+                             multiThread);
+        }
 
+        if (!cache_key.empty()) {
+            // no need to store the dark channel if there's no haze
+            auto entry =
+                std::make_shared<FeatureCache::Entry>(max_t >= 0.f ? 1 : 0, 5);
+            entry->values[0] = patchsize;
+            entry->values[1] = max_t;
+            std::copy(ambient, ambient + 3, entry->values.begin() + 2);
+            if (max_t >= 0.f) {
+                FeatureCache::copy(dark, entry->planes[0], multiThread);
+            }
+            FeatureCache::set(cache_key, entry);
+        }
+    }
+
+    if (max_t < 0.f) {
         if (options.rtSettings.verbose) {
-            std::cout << "dehaze: ambient light is " << ambient[0] << ", "
-                      << ambient[1] << ", " << ambient[2] << std::endl;
+            std::cout << "dehaze: no haze detected" << std::endl;
         }
+        restore(img, maxchan, multiThread);
+        return; // probably no haze at all
+    }
 
-        get_dark_channel(R, G, B, dark, patchsize, ambient, true, multiThread);
+    if (options.rtSettings.verbose) {
+        std::cout << "dehaze: ambient light is " << ambient[0] << ", "
+                  << ambient[1] << ", " << ambient[2] << std::endl;
     }
 
     // if (min(ambient[0], ambient[1], ambient[2]) < 0.01f) {
@@ -473,7 +473,9 @@ bool ImProcFunctions::localContrast(Imagefloat *rgb)
                 rgb, "localcontrast", linked_mask_mgr_,
                 params->localContrast.masks, offset_x, offset_y, full_width,
                 full_height, scale, multiThread, show_mask_idx, &mask, nullptr,
-                cur_pipeline == Pipeline::NAVIGATOR ? plistener : nullptr)) {
+                cur_pipeline == Pipeline::NAVIGATOR ? plistener : nullptr,
+                cur_pipeline == Pipeline::PREVIEW ||
+                    cur_pipeline == Pipeline::NAVIGATOR)) {
             return true; // show mask is active, nothing more to do
         }
 
@@ -265,11 +265,15 @@ void ImProcFunctions::rgb2monitor(Imagefloat *img, Image8 *image,
             AlignedBuffer<float> gwBuf1;
             AlignedBuffer<float> gwBuf2;
             AlignedBuffer<float> gwSrcBuf;
+            AlignedBuffer<uint8_t> gwFlags;
+            AlignedBuffer<int> gwTodo;
 
             if (gamutWarning) {
                 gwSrcBuf.resize(3 * W);
                 gwBuf1.resize(3 * W);
                 gwBuf2.resize(3 * W);
+                gwFlags.resize(W);
+                gwTodo.resize(W);
             }
 
             float *buffer = pBuf.data;
@@ -320,12 +324,17 @@ void ImProcFunctions::rgb2monitor(Imagefloat *img, Image8 *image,
                     }
                 }
 
-                cmsDoTransform(monitorTransform, buffer, outbuffer, W);
+                if (monitorLUT && !bypass_out) {
+                    (*monitorLUT)(buffer, outbuffer, W);
+                } else {
+                    monitorTransform(buffer, outbuffer, W);
+                }
                 copyAndClampLine(outbuffer, data + ix, W);
 
                 if (gamutWarning) {
                     gamutWarning->markLine(image, i, gwSrcBuf.data, gwBuf1.data,
-                                           gwBuf2.data);
+                                           gwBuf2.data, gwFlags.data,
+                                           gwTodo.data);
                 }
             }
         } // End of parallelization
@@ -379,24 +388,22 @@ Image8 *ImProcFunctions::rgb2out(Imagefloat *img, int cx, int cy, int cw,
     if (oprof) {
         img->setMode(Imagefloat::Mode::RGB, true);
 
-        cmsHTRANSFORM hTransform = nullptr;
+        LCMSTransform hTransform;
 
         ARTOutputProfile op(oprof, icm, img->colorSpace(), 256);
 
         if (!op) {
-            cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
+            cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE;
 
             if (icm.outputBPC) {
                 flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
             }
 
-            lcmsMutex->lock();
             auto iprof =
                 ICCStore::getInstance()->workingSpace(img->colorSpace());
-            hTransform = cmsCreateTransform(
-                iprof, TYPE_RGB_FLT, oprof, TYPE_RGB_FLT, icm.outputIntent,
-                flags); // NOCACHE is important for thread safety
-            lcmsMutex->unlock();
+            hTransform = LCMSTransform::create(iprof, TYPE_RGB_FLT, oprof,
+                                               TYPE_RGB_FLT, icm.outputIntent,
+                                               flags);
         }
 
         unsigned char *data = image->data;
@@ -432,15 +439,11 @@ Image8 *ImProcFunctions::rgb2out(Imagefloat *img, int cx, int cy, int cw,
                 if (op) {
                     op(buffer, outbuffer, cw);
                 } else {
-                    cmsDoTransform(hTransform, buffer, outbuffer, cw);
+                    hTransform(buffer, outbuffer, cw);
                 }
                 copyAndClampLine(outbuffer, data + ix, cw);
             }
         } // End of parallelization
-
-        if (hTransform) {
-            cmsDeleteTransform(hTransform);
-        }
     } else {
         const auto xyz_rgb =
             ICCStore::getInstance()->workingSpaceInverseMatrix(profile);
@@ -481,22 +484,19 @@ ImProcFunctions::rgb2out(Imagefloat *img,
             // }
             op(img, image, multiThread);
         } else {
-            cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
+            cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE;
 
             if (icm.outputBPC) {
                 flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
             }
 
-            lcmsMutex->lock();
             cmsHPROFILE iprof =
                 ICCStore::getInstance()->workingSpace(img->colorSpace());
-            cmsHTRANSFORM hTransform =
-                cmsCreateTransform(iprof, TYPE_RGB_FLT, oprof, TYPE_RGB_FLT,
-                                   icm.outputIntent, flags);
-            lcmsMutex->unlock();
+            LCMSTransform hTransform =
+                LCMSTransform::create(iprof, TYPE_RGB_FLT, oprof, TYPE_RGB_FLT,
+                                      icm.outputIntent, flags);
 
-            image->ExecCMSTransform(hTransform, img, multiThread);
-            cmsDeleteTransform(hTransform);
+            image->ExecCMSTransform(hTransform.get(), img, multiThread);
         }
     } else if (icm.outputProfile !=
                procparams::ColorManagementParams::NoProfileString) {
@@ -28,7 +28,7 @@
 #include "../rtgui/multilangmgr.h"
 #include "StopWatch.h"
 #include "cJSON.h"
-#include "cache.h"
+#include "concurrentcache.h"
 #include "coord.h"
 #include "rt_algo.h"
 #include "stdimagesource.h"
@@ -366,7 +366,20 @@ private:
     float sigma_;
 };
 
-Cache<Glib::ustring, std::shared_ptr<array2D<float>>> rl_kernel_cache(10);
+ConcurrentCache<Glib::ustring, std::shared_ptr<array2D<float>>>
+    rl_kernel_cache(16 << 20);
+
+// PSF and flipped PSF convolutions (holding the precomputed spectra for the
+// FFT path), indexed by kernel file and rescaled kernel size. The spectra of
+// a 101 px kernel take about 1.3 MB
+struct RLConvolutions {
+    std::unique_ptr<TiledConvolution> conv;
+    std::unique_ptr<TiledConvolution> flipconv;
+};
+
+ConcurrentCache<std::pair<Glib::ustring, int>,
+                std::shared_ptr<RLConvolutions>>
+    rl_conv_cache(32 << 20);
 
 template <class Img> bool import_kernel(Img *img, array2D<float> &out)
 {
@@ -616,7 +629,9 @@ void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
             return;
         }
 
-        rl_kernel_cache.set(key, kernel_ptr);
+        rl_kernel_cache.set(key, kernel_ptr,
+                            kernel_ptr->width() * kernel_ptr->height() *
+                                sizeof(float));
     }
 
     float scale = data.scale;
@@ -625,11 +640,30 @@ void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
         return;
     }
 
-    array2D<float> kernel(kw, kw);
-    rescale_kernel(*kernel_ptr, kernel);
+    std::shared_ptr<RLConvolutions> convs;
+    const auto conv_key = std::make_pair(psf_file, kw);
+    if (!rl_conv_cache.get(conv_key, convs)) {
+        array2D<float> kernel(kw, kw);
+        rescale_kernel(*kernel_ptr, kernel);
+
+        convs = std::make_shared<RLConvolutions>();
+        convs->conv.reset(new TiledConvolution(kernel));
+        if (flip_kernel(kernel)) {
+            convs->flipconv.reset(new TiledConvolution(kernel));
+        }
+        rl_conv_cache.set(conv_key, convs,
+                          convs->conv->getMemoryUsage() +
+                              (convs->flipconv
+                                   ? convs->flipconv->getMemoryUsage()
+                                   : 0));
+    }
+    TiledConvolution &conv = *convs->conv;
+    TiledConvolution &flipconv =
+        convs->flipconv ? *convs->flipconv : *convs->conv;
 
     array2D<float> lum(W, H);
     array2D<float> tmp(W, H);
+    array2D<float> tmp2(W, H);
     array2D<float> out(W, H);
 
 #ifdef _OPENMP
@@ -643,14 +677,6 @@ void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
         }
     }
 
-    Convolution conv(kernel, W, H, data.multiThread);
-    Convolution *flipconv = &conv;
-    std::unique_ptr<Convolution> flipconv_ptr;
-    if (flip_kernel(kernel)) {
-        flipconv_ptr.reset(new Convolution(kernel, W, H, data.multiThread));
-        flipconv = flipconv_ptr.get();
-    }
-
     LUTf loglut(65536);
     for (int i = 1; i < 65536; ++i) {
         float x = float(i) / 65535.f;
@@ -686,7 +712,7 @@ void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
     };
 
     for (int i = 0; i < iterations; ++i) {
-        conv(lum, tmp);
+        conv(lum, tmp, data.multiThread);
 
 #ifdef _OPENMP
 #pragma omp parallel for if (data.multiThread)
@@ -700,15 +726,15 @@ void rl_deconvolution_psf(float **luminance, float **blend, int W, int H,
             }
         }
 
-        (*flipconv)(tmp, tmp);
+        flipconv(tmp, tmp2, data.multiThread);
 
 #ifdef _OPENMP
 #pragma omp parallel for if (data.multiThread)
 #endif
         for (int y = 0; y < H; ++y) {
             for (int x = 0; x < W; ++x) {
-                lum[y][x] *= tmp[y][x];
-                assert(std::isfinite(tmp[y][x]));
+                lum[y][x] *= tmp2[y][x];
+                assert(std::isfinite(tmp2[y][x]));
                 assert(std::isfinite(lum[y][x]));
 
                 check_stop(y, x);
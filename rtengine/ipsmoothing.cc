@@ -952,7 +952,9 @@ bool ImProcFunctions::guidedSmoothing(Imagefloat *rgb)
                 rgb, "smoothing", linked_mask_mgr_, params->smoothing.masks,
                 offset_x, offset_y, full_width, full_height, scale, multiThread,
                 show_mask_idx, nullptr, &mask,
-                cur_pipeline == Pipeline::NAVIGATOR ? plistener : nullptr)) {
+                cur_pipeline == Pipeline::NAVIGATOR ? plistener : nullptr,
+                cur_pipeline == Pipeline::PREVIEW ||
+                    cur_pipeline == Pipeline::NAVIGATOR)) {
             return true; // show mask is active, nothing more to do
         }
 
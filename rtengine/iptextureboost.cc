@@ -23,12 +23,14 @@
 #endif
 
 #include "array2D.h"
+#include "featurecache.h"
 #include "gauss.h"
 #include "guidedfilter.h"
 #include "improcfun.h"
 #include "masks.h"
 #include "rescale.h"
 #include "rt_algo.h"
+#include <sstream>
 
 namespace rtengine {
 
@@ -36,7 +38,8 @@ namespace {
 
 void texture_boost(array2D<float> &Y,
                    const rtengine::procparams::TextureBoostParams::Region &pp,
-                   double scale, bool multithread, bool high_detail)
+                   double scale, bool multithread, bool high_detail,
+                   const std::string &cache_key)
 {
     float full_radius = pp.detailThreshold * 3.5f;
     float fradius = full_radius / scale;
@@ -114,24 +117,45 @@ void texture_boost(array2D<float> &Y,
         gaussian_blur.reset(new Convolution(kernel, W, H, multithread));
     }
 
+    // the filtered planes of the first iteration depend only on the input
+    // and on the detail threshold, so they can be reused when only the
+    // strength changes
+    std::shared_ptr<const FeatureCache::Entry> cached;
+    if (!cache_key.empty()) {
+        cached = FeatureCache::get(cache_key);
+    }
+
     for (int i = 0; i < pp.iterations; ++i) {
         float blend = 1.f / std::pow(2.f, i);
 #ifdef ART_SIMD
         vfloat vblend = F2V(blend);
 #endif
-        if (isguided) {
-            guidedFilter(mid, mid, mid, radius, epsilon, multithread);
+        if (i == 0 && cached) {
+            FeatureCache::copy(cached->planes[0], mid, multithread);
+            FeatureCache::copy(cached->planes[1], base, multithread);
         } else {
-            if (high_detail) {
-                (*gaussian_blur)(mid, mid);
+            if (isguided) {
+                guidedFilter(mid, mid, mid, radius, epsilon, multithread);
             } else {
+                if (high_detail) {
+                    (*gaussian_blur)(mid, mid);
+                } else {
 #ifdef _OPENMP
 #pragma omp parallel if (multithread)
 #endif
-                gaussianBlur(mid, mid, W, H, fradius);
+                    gaussianBlur(mid, mid, W, H, fradius);
+                }
+            }
+            guidedFilter(mid, mid, base, radius * 4, epsilon / 10.f,
+                         multithread);
+
+            if (i == 0 && !cache_key.empty()) {
+                auto entry = std::make_shared<FeatureCache::Entry>(2);
+                FeatureCache::copy(mid, entry->planes[0], multithread);
+                FeatureCache::copy(base, entry->planes[1], multithread);
+                FeatureCache::set(cache_key, entry);
             }
         }
-        guidedFilter(mid, mid, base, radius * 4, epsilon / 10.f, multithread);
 
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
@@ -223,7 +247,9 @@ bool ImProcFunctions::textureBoost(Imagefloat *rgb)
                 rgb, "textureboost", linked_mask_mgr_,
                 params->textureBoost.masks, offset_x, offset_y, full_width,
                 full_height, scale, multiThread, show_mask_idx, &mask, nullptr,
-                cur_pipeline == Pipeline::NAVIGATOR ? plistener : nullptr)) {
+                cur_pipeline == Pipeline::NAVIGATOR ? plistener : nullptr,
+                cur_pipeline == Pipeline::PREVIEW ||
+                    cur_pipeline == Pipeline::NAVIGATOR)) {
             return true; // show mask is active, nothing more to do
         }
 
@@ -241,8 +267,20 @@ bool ImProcFunctions::textureBoost(Imagefloat *rgb)
 
             auto &r = params->textureBoost.regions[i];
             if (r.strength != 0) {
-                texture_boost(Y, r, scale, multiThread,
-                              scale == 1 || cur_pipeline == Pipeline::OUTPUT);
+                const bool high_detail =
+                    scale == 1 || cur_pipeline == Pipeline::OUTPUT;
+                std::string cache_key;
+                if ((cur_pipeline == Pipeline::PREVIEW ||
+                     cur_pipeline == Pipeline::NAVIGATOR) &&
+                    FeatureCache::cacheable(2 * size_t(W) * size_t(H))) {
+                    std::ostringstream buf;
+                    buf << "textureboost:" << W << 'x' << H << ':' << scale
+                        << ':' << r.detailThreshold << ':' << high_detail
+                        << ':' << FeatureCache::fingerprint(Y, multiThread);
+                    cache_key = buf.str();
+                }
+                texture_boost(Y, r, scale, multiThread, high_detail,
+                              cache_key);
                 const auto &blend = mask[i];
 
 #ifdef _OPENMP
@@ -37,12 +37,14 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "featurecache.h"
 #include "gauss.h"
 #include "guidedfilter.h"
 #include "improcfun.h"
 #include "opthelper.h"
 #include "sleef.h"
 #include <array>
+#include <sstream>
 #include <vector>
 // #define BENCHMARK
 #include "StopWatch.h"
@@ -60,14 +62,19 @@ const std::vector<std::array<float, 3>> colormap = {
     {1.f, 0.f, 0.f},                       // whites
     {1.f, 0.f, 0.f},    {1.f, 0.f, 0.f},   {1.f, 0.f, 0.f}};
 
-void tone_eq(array2D<float> &R, array2D<float> &G, array2D<float> &B,
-             const ToneEqualizerParams &pp, const Glib::ustring &workingProfile,
-             double scale, bool multithread, bool show_color_map,
-             cmsHPROFILE monitor_prof)
+// Build the luma channels: band-pass filters with gaussian windows of
+// std 2 EV, spaced by 2 EV
+const float centers[12] = {-16.0f, -14.0f, -12.0f, -10.0f, -8.0f, -6.0f,
+                           -4.0f,  -2.0f,  0.0f,   2.0f,   4.0f,  6.0f};
+
+void get_smoothed_luminance(const array2D<float> &R, const array2D<float> &G,
+                            const array2D<float> &B, array2D<float> &Y,
+                            const ToneEqualizerParams &pp,
+                            const Glib::ustring &workingProfile, double scale,
+                            bool multithread)
 {
     const int W = R.width();
     const int H = R.height();
-    array2D<float> Y(W, H, ARRAY2D_ALIGNED);
 
     const auto log2 = [](float x) -> float {
         static const float l2 = xlogf(2);
@@ -76,31 +83,6 @@ void tone_eq(array2D<float> &R, array2D<float> &G, array2D<float> &B,
 
     const auto exp2 = [](float x) -> float { return pow_F(2.f, x); };
 
-    // Build the luma channels: band-pass filters with gaussian windows of
-    // std 2 EV, spaced by 2 EV
-    const float centers[12] = {-16.0f, -14.0f, -12.0f, -10.0f, -8.0f, -6.0f,
-                               -4.0f,  -2.0f,  0.0f,   2.0f,   4.0f,  6.0f};
-
-    const auto conv = [&](int v, float lo, float hi) -> float {
-        const float f = v < 0 ? lo : hi;
-        return exp2(float(v) / 100.f * f);
-    };
-
-    const float factors[12] = {
-        conv(pp.bands[0], 2.f, 3.f),   // -16 EV
-        conv(pp.bands[0], 2.f, 3.f),   // -14 EV
-        conv(pp.bands[0], 2.f, 3.f),   // -12 EV
-        conv(pp.bands[0], 2.f, 3.f),   // -10 EV
-        conv(pp.bands[0], 2.f, 3.f),   //  -8 EV
-        conv(pp.bands[1], 2.f, 3.f),   //  -6 EV
-        conv(pp.bands[2], 2.5f, 2.5f), //  -4 EV
-        conv(pp.bands[3], 3.f, 2.f),   //  -2 EV
-        conv(pp.bands[4], 3.f, 2.f),   //   0 EV
-        conv(pp.bands[4], 3.f, 2.f),   //   2 EV
-        conv(pp.bands[4], 3.f, 2.f),   //   4 EV
-        conv(pp.bands[4], 3.f, 2.f)    //   6 EV
-    };
-
     TMatrix ws = ICCStore::getInstance()->workingSpaceMatrix(workingProfile);
 
 #ifdef _OPENMP
@@ -147,6 +129,62 @@ void tone_eq(array2D<float> &R, array2D<float> &G, array2D<float> &B,
                                    multithread);
         }
     }
+}
+
+
+void tone_eq(array2D<float> &R, array2D<float> &G, array2D<float> &B,
+             const ToneEqualizerParams &pp, const Glib::ustring &workingProfile,
+             double scale, bool multithread, bool show_color_map,
+             cmsHPROFILE monitor_prof, const std::string &cache_key)
+{
+    const int W = R.width();
+    const int H = R.height();
+    array2D<float> Y(W, H, ARRAY2D_ALIGNED);
+
+    const auto log2 = [](float x) -> float {
+        static const float l2 = xlogf(2);
+        return xlogf(x) / l2;
+    };
+
+    const auto exp2 = [](float x) -> float { return pow_F(2.f, x); };
+
+    const auto conv = [&](int v, float lo, float hi) -> float {
+        const float f = v < 0 ? lo : hi;
+        return exp2(float(v) / 100.f * f);
+    };
+
+    const float factors[12] = {
+        conv(pp.bands[0], 2.f, 3.f),   // -16 EV
+        conv(pp.bands[0], 2.f, 3.f),   // -14 EV
+        conv(pp.bands[0], 2.f, 3.f),   // -12 EV
+        conv(pp.bands[0], 2.f, 3.f),   // -10 EV
+        conv(pp.bands[0], 2.f, 3.f),   //  -8 EV
+        conv(pp.bands[1], 2.f, 3.f),   //  -6 EV
+        conv(pp.bands[2], 2.5f, 2.5f), //  -4 EV
+        conv(pp.bands[3], 3.f, 2.f),   //  -2 EV
+        conv(pp.bands[4], 3.f, 2.f),   //   0 EV
+        conv(pp.bands[4], 3.f, 2.f),   //   2 EV
+        conv(pp.bands[4], 3.f, 2.f),   //   4 EV
+        conv(pp.bands[4], 3.f, 2.f)    //   6 EV
+    };
+
+    // the smoothed luminance doesn't depend on the bands, so it can be reused
+    // while they are being adjusted
+    std::shared_ptr<const FeatureCache::Entry> cached;
+    if (!cache_key.empty()) {
+        cached = FeatureCache::get(cache_key);
+    }
+    if (cached) {
+        FeatureCache::copy(cached->planes[0], Y, multithread);
+    } else {
+        get_smoothed_luminance(R, G, B, Y, pp, workingProfile, scale,
+                               multithread);
+        if (!cache_key.empty()) {
+            auto entry = std::make_shared<FeatureCache::Entry>(1);
+            FeatureCache::copy(Y, entry->planes[0], multithread);
+            FeatureCache::set(cache_key, entry);
+        }
+    }
 
     const auto gauss = [](float b, float x) -> float {
         return xexpf((-SQR(x - b) / 4.0f));
@@ -178,24 +216,22 @@ void tone_eq(array2D<float> &R, array2D<float> &G, array2D<float> &B,
 
     std::vector<std::array<float, 3>> cur_colormap;
     if (show_color_map) {
-        lcmsMutex->lock();
         cmsHPROFILE in = monitor_prof;
         if (!in) {
             in = ICCStore::getInstance()->getsRGBProfile();
         }
         cmsHPROFILE out = ICCStore::getInstance()->workingSpace(workingProfile);
-        cmsHTRANSFORM xform = cmsCreateTransform(
+        LCMSTransform xform = LCMSTransform::create(
             in, TYPE_RGB_FLT, out, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC,
-            cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-        lcmsMutex->unlock();
+            cmsFLAGS_NOOPTIMIZE);
 
         for (auto &c : colormap) {
             cur_colormap.push_back(c);
             auto &cc = cur_colormap.back();
-            cmsDoTransform(xform, &cc[0], &cc[0], 1);
+            if (xform) {
+                xform(&cc[0], &cc[0], 1);
+            }
         }
-
-        cmsDeleteTransform(xform);
     }
 
     const auto process_colormap = [&](float y) -> std::array<float, 3> {
@@ -346,8 +382,20 @@ bool ImProcFunctions::toneEqualizer(Imagefloat *rgb)
 
     bool show_color_map = params->toneEqualizer.show_colormap &&
                           cur_pipeline == Pipeline::PREVIEW;
+    std::string cache_key;
+    if ((cur_pipeline == Pipeline::PREVIEW ||
+         cur_pipeline == Pipeline::NAVIGATOR) &&
+        FeatureCache::cacheable(size_t(W) * size_t(H))) {
+        std::ostringstream buf;
+        buf << "toneequalizer:" << W << 'x' << H << ':' << scale << ':'
+            << params->icm.workingProfile << ':'
+            << params->toneEqualizer.regularization << ':'
+            << FeatureCache::fingerprint(rgb, multiThread);
+        cache_key = buf.str();
+    }
+
     tone_eq(R, G, B, params->toneEqualizer, params->icm.workingProfile, scale,
-            multiThread, show_color_map, monitor);
+            multiThread, show_color_map, monitor, cache_key);
 
     rgb->multiply(!show_color_map ? 1.f / gain : 65535.f, multiThread);
 
@@ -22,6 +22,7 @@
 #include <omp.h>
 #endif
 #include "../rtgui/multilangmgr.h"
+#include "lenscorrectionmap.h"
 #include "lensexif.h"
 #include "mytime.h"
 #include "opthelper.h"
@@ -616,6 +617,9 @@ void ImProcFunctions::transform(Imagefloat *original, Imagefloat *transformed,
                                                     params->lensProf.lcpFile));
         }
     }
+    // the sampled corrections are shared by all the images taken with the
+    // same lens settings
+    pLCPMap = LensCorrectionMap::wrap(std::move(pLCPMap), oW, oH);
 
     if (needsCA() || scale == 1) {
         highQuality = true;
@@ -1181,6 +1185,10 @@ void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original,
                         ? getTransformAutoFill(oW, oH, pLCPMap)
                         : 1.0;
 
+    if (enableLCPDist) {
+        pLCPMap->prepareDistortion(ascale);
+    }
+
     const bool use_enc = highQuality;
     constexpr float invalid = 0.f;
 
@@ -1394,6 +1402,8 @@ void ImProcFunctions::transformLCPCAOnly(Imagefloat *original,
     chTrans[1] = transformed->g.ptrs;
     chTrans[2] = transformed->b.ptrs;
 
+    pLCPMap->prepareCA();
+
 #ifdef _OPENMP
 #pragma omp parallel for if (multiThread)
 #endif
@@ -0,0 +1,199 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lcmstransform.h"
+#include "alignedbuffer.h"
+#include "concurrentcache.h"
+#include "iccstore.h"
+#include "rtengine.h"
+#include <algorithm>
+#include <functional>
+#include <sstream>
+
+namespace rtengine {
+
+namespace {
+
+// total cost of the cached transforms, in bytes (see transform_cost())
+constexpr size_t TRANSFORM_CACHE_SIZE = 16 << 20;
+constexpr int APPLY_BAND_HEIGHT = 16;
+
+ConcurrentCache<std::string, LCMSTransform>
+    transform_cache(TRANSFORM_CACHE_SIZE);
+
+// LittleCMS does not report the memory used by a transform. When it is not
+// just a matrix-shaper, most of it is the precalculated device link, a 3D
+// CLUT with at most 33 points per side, which is used as an upper bound
+size_t transform_cost(cmsUInt32Number out_fmt)
+{
+    constexpr size_t GRID_POINTS = 33;
+    return GRID_POINTS * GRID_POINTS * GRID_POINTS * T_CHANNELS(out_fmt) *
+           sizeof(float);
+}
+
+// profiles are identified by their serialized contents, since the same
+// profile is often opened more than once (or built on the fly), and handles
+// of closed profiles can be reused. The creation date and the profile ID in
+// the header are ignored, otherwise profiles built on the fly (e.g. with
+// cmsCreateLab4Profile()) would get a different key every second
+std::string profile_key(cmsHPROFILE prof)
+{
+    if (!prof) {
+        return "-";
+    }
+    const ProfileContent content(prof);
+    std::string data = content.getData();
+    constexpr size_t DATE_OFFSET = 24, DATE_SIZE = 12;
+    constexpr size_t ID_OFFSET = 84, ID_SIZE = 16;
+    if (data.size() >= ID_OFFSET + ID_SIZE) {
+        data.replace(DATE_OFFSET, DATE_SIZE, DATE_SIZE, '\0');
+        data.replace(ID_OFFSET, ID_SIZE, ID_SIZE, '\0');
+    }
+    std::ostringstream buf;
+    buf << std::hex << std::hash<std::string>()(data) << std::dec << ":"
+        << data.size();
+    return buf.str();
+}
+
+cmsUInt32Number supported_format(cmsUInt32Number fmt)
+{
+#if LCMS_VERSION < 2080
+    // no cmsDoTransformLineStride, planar images are converted through
+    // interleaved buffers in apply()
+    return fmt & ~PLANAR_SH(1);
+#else
+    return fmt;
+#endif
+}
+
+} // namespace
+
+LCMSTransform LCMSTransform::adopt(cmsHTRANSFORM xform)
+{
+    LCMSTransform ret;
+    if (xform) {
+        ret.xform_.reset(xform, cmsDeleteTransform);
+    }
+    return ret;
+}
+
+LCMSTransform LCMSTransform::create(cmsHPROFILE in, cmsUInt32Number in_fmt,
+                                    cmsHPROFILE out, cmsUInt32Number out_fmt,
+                                    cmsUInt32Number intent,
+                                    cmsUInt32Number flags)
+{
+    return createProofing(in, in_fmt, out, out_fmt, nullptr, intent,
+                          INTENT_RELATIVE_COLORIMETRIC, flags);
+}
+
+LCMSTransform
+LCMSTransform::createProofing(cmsHPROFILE in, cmsUInt32Number in_fmt,
+                              cmsHPROFILE out, cmsUInt32Number out_fmt,
+                              cmsHPROFILE proof, cmsUInt32Number intent,
+                              cmsUInt32Number proof_intent,
+                              cmsUInt32Number flags)
+{
+    flags |= cmsFLAGS_NOCACHE;
+    in_fmt = supported_format(in_fmt);
+    out_fmt = supported_format(out_fmt);
+
+    MyMutex::MyLock lock(*lcmsMutex);
+
+    std::ostringstream buf;
+    buf << profile_key(in) << "/" << in_fmt << "/" << profile_key(out) << "/"
+        << out_fmt << "/" << intent << "/" << flags;
+    if (proof) {
+        buf << "/" << profile_key(proof) << "/" << proof_intent;
+    }
+    const std::string key = buf.str();
+
+    LCMSTransform ret;
+    if (transform_cache.get(key, ret)) {
+        return ret;
+    }
+
+    cmsHTRANSFORM xform =
+        proof ? cmsCreateProofingTransform(in, in_fmt, out, out_fmt, proof,
+                                           intent, proof_intent, flags)
+              : cmsCreateTransform(in, in_fmt, out, out_fmt, intent, flags);
+    if (xform) {
+        ret = adopt(xform);
+        ret.planar_ = T_PLANAR(in_fmt) && T_PLANAR(out_fmt);
+        ret.key_ = key;
+        transform_cache.set(key, ret, transform_cost(out_fmt));
+    }
+    return ret;
+}
+
+void LCMSTransform::apply(PlanarRGBData<float> *img, bool multithread) const
+{
+    const int W = img->getWidth();
+    const int H = img->getHeight();
+    const cmsHTRANSFORM xform = xform_.get();
+
+#if LCMS_VERSION >= 2080
+    if (planar_) {
+        // the three planes are in a single block, so LittleCMS can work
+        // directly on the image data
+        const cmsUInt32Number rs = img->getRowStride();
+        const cmsUInt32Number ps = img->getPlaneStride();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (multithread)
+#endif
+        for (int y = 0; y < H; y += APPLY_BAND_HEIGHT) {
+            float *p = img->r(y);
+            cmsDoTransformLineStride(xform, p, p, W,
+                                     std::min(APPLY_BAND_HEIGHT, H - y), rs,
+                                     rs, ps, ps);
+        }
+        return;
+    }
+#endif
+
+#ifdef _OPENMP
+#pragma omp parallel if (multithread)
+#endif
+    {
+        AlignedBuffer<float> buf(W * 3);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int y = 0; y < H; ++y) {
+            float *p = buf.data;
+            const float *pR = img->r(y), *pG = img->g(y), *pB = img->b(y);
+            for (int x = 0; x < W; ++x) {
+                *(p++) = pR[x];
+                *(p++) = pG[x];
+                *(p++) = pB[x];
+            }
+
+            cmsDoTransform(xform, buf.data, buf.data, W);
+
+            p = buf.data;
+            float *oR = img->r(y), *oG = img->g(y), *oB = img->b(y);
+            for (int x = 0; x < W; ++x) {
+                oR[x] = *(p++);
+                oG[x] = *(p++);
+                oB[x] = *(p++);
+            }
+        }
+    }
+}
+
+} // namespace rtengine
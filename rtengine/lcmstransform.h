@@ -0,0 +1,83 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "iimage.h"
+#include <lcms2.h>
+#include <memory>
+#include <string>
+
+namespace rtengine {
+
+/**
+ * Shared handle to a LittleCMS transform.
+ *
+ * Transforms are obtained through create()/createProofing(), which look them
+ * up in a process-wide cache keyed on the contents of the profiles, the
+ * formats, the intents and the flags, so that identical transforms (e.g. the
+ * monitor or gamut warning ones, or those used for each thumbnail) are built
+ * only once. cmsFLAGS_NOCACHE is always added, so the same handle can be used
+ * by several threads at the same time. Handles stay valid after the profiles
+ * are closed and after the transform is evicted from the cache.
+ *
+ * create() and createProofing() lock lcmsMutex, so they must not be called
+ * while holding it.
+ */
+class LCMSTransform {
+public:
+    LCMSTransform(): planar_(false) {}
+
+    explicit operator bool() const { return bool(xform_); }
+    cmsHTRANSFORM get() const { return xform_.get(); }
+    /** cache key of the transform, empty if it was not built by create() or
+     * createProofing() */
+    const std::string &key() const { return key_; }
+
+    void operator()(const void *in, void *out, cmsUInt32Number n) const
+    {
+        cmsDoTransform(xform_.get(), in, out, n);
+    }
+
+    /**
+     * In-place conversion of a whole image, in parallel over bands of rows.
+     * The transform must have been created with TYPE_RGB_FLT_PLANAR for both
+     * the input and the output, and the data must already be in the range
+     * expected by LittleCMS.
+     */
+    void apply(PlanarRGBData<float> *img, bool multithread) const;
+
+    static LCMSTransform create(cmsHPROFILE in, cmsUInt32Number in_fmt,
+                                cmsHPROFILE out, cmsUInt32Number out_fmt,
+                                cmsUInt32Number intent, cmsUInt32Number flags);
+    static LCMSTransform
+    createProofing(cmsHPROFILE in, cmsUInt32Number in_fmt, cmsHPROFILE out,
+                   cmsUInt32Number out_fmt, cmsHPROFILE proof,
+                   cmsUInt32Number intent, cmsUInt32Number proof_intent,
+                   cmsUInt32Number flags);
+
+    /** takes ownership of a transform created elsewhere, without caching */
+    static LCMSTransform adopt(cmsHTRANSFORM xform);
+
+private:
+    std::shared_ptr<void> xform_;
+    bool planar_;
+    std::string key_;
+};
+
+} // namespace rtengine
@@ -24,6 +24,7 @@
 
 #include <algorithm>
 #include <cstring>
+#include <iomanip>
 
 #include <glib/gstdio.h>
 
@@ -953,6 +954,34 @@ rtengine::LCPMapper::LCPMapper(const std::shared_ptr<LCPProfile> &pProf,
 
 bool rtengine::LCPMapper::isCACorrectionAvailable() const { return enableCA; }
 
+namespace {
+
+void add_to_key(std::ostream &out, const rtengine::LCPModelCommon &m)
+{
+    out << "/" << m.x0 << "," << m.y0 << "," << m.fx << "," << m.fy << ","
+        << m.scale_factor;
+    for (auto p : m.param) {
+        out << "," << p;
+    }
+}
+
+} // namespace
+
+std::string rtengine::LCPMapper::getCacheKey() const
+{
+    // the corrections are fully determined by the prepared parameters
+    std::ostringstream key;
+    key << std::setprecision(9) << "lcp/" << isFisheye << swapXY << enableCA
+        << useCADist;
+    add_to_key(key, mc);
+    if (enableCA) {
+        for (int i = 0; i < 3; ++i) {
+            add_to_key(key, chrom[i]);
+        }
+    }
+    return key.str();
+}
+
 void rtengine::LCPMapper::correctDistortion(double &x, double &y, int cx,
                                             int cy, double scale) const
 {
@@ -157,6 +157,19 @@ public:
                                  float **rawData) const = 0;
     virtual void processVignette3Channels(int width, int height,
                                           float **rawData) const = 0;
+
+    /**
+     * Identifies the distortion and CA corrections, so that the grids of
+     * LensCorrectionMap can be shared among images. Empty if they can't.
+     */
+    virtual std::string getCacheKey() const { return ""; }
+    /**
+     * Hints that correctDistortion() (resp. correctCA()) is about to be
+     * called on many points with the given scale. Must not be called
+     * concurrently with the other methods.
+     */
+    virtual void prepareDistortion(double scale) const {}
+    virtual void prepareCA() const {}
 };
 
 // Once precalculated class to correct a point
@@ -177,6 +190,7 @@ public:
     void processVignette(int width, int height, float **rawData) const override;
     void processVignette3Channels(int width, int height,
                                   float **rawData) const override;
+    std::string getCacheKey() const override;
 
 private:
     bool enableCA;  // is the mapper capable if CA correction?
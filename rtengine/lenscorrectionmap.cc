@@ -0,0 +1,235 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lenscorrectionmap.h"
+#include "concurrentcache.h"
+#include "settings.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+// the corrections are smooth, so with this spacing (in pixels) the error of
+// the bilinear interpolation stays well below 1/100 of a pixel for typical
+// lenses
+constexpr int GRID_STEP = 16;
+
+} // namespace
+
+class LensCorrectionMap::Grid {
+public:
+    Grid(int width, int height, int channels)
+        : width_(width), height_(height),
+          nx_(std::max((width + GRID_STEP - 2) / GRID_STEP + 1, 2)),
+          ny_(std::max((height + GRID_STEP - 2) / GRID_STEP + 1, 2)),
+          data_(size_t(channels) * nx_ * ny_ * 2)
+    {
+    }
+
+    int nx() const { return nx_; }
+    int ny() const { return ny_; }
+    size_t bytes() const { return data_.size() * sizeof(float); }
+
+    float *node(int c, int i, int j)
+    {
+        return &data_[((size_t(c) * ny_ + j) * nx_ + i) * 2];
+    }
+
+    // interpolated displacement at (x, y), false if outside of the image
+    bool get(int c, double x, double y, double &dx, double &dy) const
+    {
+        if (!(x >= 0 && y >= 0 && x <= width_ - 1 && y <= height_ - 1)) {
+            return false;
+        }
+        const double fx = x / GRID_STEP;
+        const double fy = y / GRID_STEP;
+        const int i = std::min(int(fx), nx_ - 2);
+        const int j = std::min(int(fy), ny_ - 2);
+        const double ax = fx - i;
+        const double ay = fy - j;
+
+        const float *p0 = &data_[((size_t(c) * ny_ + j) * nx_ + i) * 2];
+        const float *p1 = p0 + nx_ * 2;
+        dx = (1 - ay) * ((1 - ax) * p0[0] + ax * p0[2]) +
+             ay * ((1 - ax) * p1[0] + ax * p1[2]);
+        dy = (1 - ay) * ((1 - ax) * p0[1] + ax * p0[3]) +
+             ay * ((1 - ax) * p1[1] + ax * p1[3]);
+        return true;
+    }
+
+private:
+    const int width_;
+    const int height_;
+    const int nx_;
+    const int ny_;
+    std::vector<float> data_;
+};
+
+namespace {
+
+// total size of the cached grids, in bytes. The CA grids of a 60 Mpix image
+// take about 6 MB, the distortion ones a third of that
+constexpr size_t GRID_CACHE_SIZE = 32 << 20;
+
+ConcurrentCache<std::string, std::shared_ptr<const LensCorrectionMap::Grid>>
+    grid_cache(GRID_CACHE_SIZE);
+
+} // namespace
+
+std::unique_ptr<const LensCorrection>
+LensCorrectionMap::wrap(std::unique_ptr<const LensCorrection> corr, int width,
+                        int height)
+{
+    if (!corr || settings->lens_exact_apply) {
+        return corr;
+    }
+    const std::string key = corr->getCacheKey();
+    if (key.empty()) {
+        return corr;
+    }
+    return std::unique_ptr<const LensCorrection>(
+        new LensCorrectionMap(std::move(corr), key, width, height));
+}
+
+LensCorrectionMap::LensCorrectionMap(
+    std::unique_ptr<const LensCorrection> base, const std::string &key,
+    int width, int height)
+    : base_(std::move(base)), key_(key), width_(width), height_(height),
+      dist_scale_(0)
+{
+}
+
+void LensCorrectionMap::prepareDistortion(double scale) const
+{
+    if (dist_ && dist_scale_ == scale) {
+        return;
+    }
+
+    std::ostringstream buf;
+    buf << std::setprecision(17) << key_ << "/" << width_ << "x" << height_
+        << "/dist/" << scale;
+    const std::string key = buf.str();
+
+    std::shared_ptr<const Grid> grid;
+    if (!grid_cache.get(key, grid)) {
+        Grid *g = new Grid(width_, height_, 1);
+        grid.reset(g);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int j = 0; j < g->ny(); ++j) {
+            for (int i = 0; i < g->nx(); ++i) {
+                const double gx = i * GRID_STEP;
+                const double gy = j * GRID_STEP;
+                double x = gx, y = gy;
+                base_->correctDistortion(x, y, 0, 0, scale);
+                float *p = g->node(0, i, j);
+                p[0] = x - gx * scale;
+                p[1] = y - gy * scale;
+            }
+        }
+        grid_cache.set(key, grid, grid->bytes());
+    }
+    dist_ = grid;
+    dist_scale_ = scale;
+}
+
+void LensCorrectionMap::prepareCA() const
+{
+    if (ca_ || !base_->isCACorrectionAvailable()) {
+        return;
+    }
+
+    std::ostringstream buf;
+    buf << key_ << "/" << width_ << "x" << height_ << "/ca";
+    const std::string key = buf.str();
+
+    std::shared_ptr<const Grid> grid;
+    if (!grid_cache.get(key, grid)) {
+        Grid *g = new Grid(width_, height_, 3);
+        grid.reset(g);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int j = 0; j < g->ny(); ++j) {
+            for (int i = 0; i < g->nx(); ++i) {
+                const double gx = i * GRID_STEP;
+                const double gy = j * GRID_STEP;
+                for (int c = 0; c < 3; ++c) {
+                    double x = gx, y = gy;
+                    base_->correctCA(x, y, 0, 0, c);
+                    float *p = g->node(c, i, j);
+                    p[0] = x - gx;
+                    p[1] = y - gy;
+                }
+            }
+        }
+        grid_cache.set(key, grid, grid->bytes());
+    }
+    ca_ = grid;
+}
+
+void LensCorrectionMap::correctDistortion(double &x, double &y, int cx,
+                                          int cy, double scale) const
+{
+    double dx, dy;
+    if (dist_ && scale == dist_scale_ &&
+        dist_->get(0, x + cx, y + cy, dx, dy)) {
+        x = x * scale + dx;
+        y = y * scale + dy;
+    } else {
+        base_->correctDistortion(x, y, cx, cy, scale);
+    }
+}
+
+bool LensCorrectionMap::isCACorrectionAvailable() const
+{
+    return base_->isCACorrectionAvailable();
+}
+
+void LensCorrectionMap::correctCA(double &x, double &y, int cx, int cy,
+                                  int channel) const
+{
+    double dx, dy;
+    if (ca_ && ca_->get(channel, x + cx, y + cy, dx, dy)) {
+        x += dx;
+        y += dy;
+    } else {
+        base_->correctCA(x, y, cx, cy, channel);
+    }
+}
+
+void LensCorrectionMap::processVignette(int width, int height,
+                                        float **rawData) const
+{
+    base_->processVignette(width, height, rawData);
+}
+
+void LensCorrectionMap::processVignette3Channels(int width, int height,
+                                                 float **rawData) const
+{
+    base_->processVignette3Channels(width, height, rawData);
+}
+
+} // namespace rtengine
@@ -0,0 +1,76 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "lcp.h"
+#include "noncopyable.h"
+#include <memory>
+#include <string>
+
+namespace rtengine {
+
+/**
+ * Lens correction that evaluates the distortion and CA corrections of
+ * another one (lensfun, LCP or Exif-based) on a coarse grid of points, and
+ * interpolates between them.
+ *
+ * The grids are built on the first prepareDistortion()/prepareCA() call and
+ * are kept in a process-wide cache keyed on LensCorrection::getCacheKey()
+ * and the image size, so that all the images shot with the same lens
+ * settings share them. Points outside of the image, and distortion
+ * corrections at a scale different from the prepared one, are computed by
+ * the wrapped correction, which is also used for the vignetting.
+ */
+class LensCorrectionMap final: public LensCorrection, public NonCopyable {
+public:
+    /**
+     * Wraps corr, for an image of the given size. corr is returned as is if
+     * it can't be shared or if Settings::lens_exact_apply is set.
+     */
+    static std::unique_ptr<const LensCorrection>
+    wrap(std::unique_ptr<const LensCorrection> corr, int width, int height);
+
+    void correctDistortion(double &x, double &y, int cx, int cy,
+                           double scale) const override;
+    bool isCACorrectionAvailable() const override;
+    void correctCA(double &x, double &y, int cx, int cy,
+                   int channel) const override;
+    void processVignette(int width, int height, float **rawData) const override;
+    void processVignette3Channels(int width, int height,
+                                  float **rawData) const override;
+    std::string getCacheKey() const override { return key_; }
+    void prepareDistortion(double scale) const override;
+    void prepareCA() const override;
+
+    class Grid;
+
+private:
+    LensCorrectionMap(std::unique_ptr<const LensCorrection> base,
+                      const std::string &key, int width, int height);
+
+    std::unique_ptr<const LensCorrection> base_;
+    std::string key_;
+    int width_;
+    int height_;
+    mutable std::shared_ptr<const Grid> dist_;
+    mutable double dist_scale_;
+    mutable std::shared_ptr<const Grid> ca_;
+};
+
+} // namespace rtengine
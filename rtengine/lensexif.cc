@@ -43,7 +43,9 @@
 #include "metadata.h"
 #include "settings.h"
 #include <array>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 namespace rtengine {
 
@@ -604,6 +606,36 @@ bool ExifLensCorrection::isCACorrectionAvailable() const
     return data_.get() && data_->has_ca();
 }
 
+std::string ExifLensCorrection::getCacheKey() const
+{
+    if (!data_ || (is_dng_ && data_->has_dist() && dist_.size() != 6)) {
+        // in the latter case correctDistortion() ignores the scale
+        return "";
+    }
+
+    const auto add = [](std::ostream &out,
+                        const std::vector<float> &v) -> void {
+        out << "/";
+        for (auto f : v) {
+            out << f << ",";
+        }
+    };
+
+    std::ostringstream key;
+    key << std::setprecision(9) << "exif/" << is_dng_ << swap_xy_ << "/"
+        << w2_ << "/" << h2_ << "/" << r_;
+    add(key, knots_);
+    if (data_->has_dist()) {
+        add(key, dist_);
+    }
+    if (data_->has_ca()) {
+        for (auto &c : ca_) {
+            add(key, c);
+        }
+    }
+    return key.str();
+}
+
 void ExifLensCorrection::correctCA(double &x, double &y, int cx, int cy,
                                    int channel) const
 {
@@ -24,6 +24,7 @@
 #include "procparams.h"
 #include "rtengine.h"
 #include <memory>
+#include <string>
 
 namespace rtengine {
 
@@ -44,6 +45,7 @@ public:
                                   float **rawData) const override
     {
     }
+    std::string getCacheKey() const override;
 
     class CorrectionData {
     public:
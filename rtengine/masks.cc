@@ -26,6 +26,7 @@
 #include "color.h"
 #include "coord.h"
 #include "curves.h"
+#include "featurecache.h"
 #include "gauss.h"
 #include "guidedfilter.h"
 #include "halffloat.h"
@@ -37,6 +38,7 @@
 #include "rt_math.h"
 #include "sleef.h"
 #include "stdimagesource.h"
+#include <sstream>
 
 namespace rtengine {
 
@@ -651,6 +653,45 @@ void rgb2lab(Imagefloat::Mode mode, float R, float G, float B, float &L,
     }
 }
 
+#ifdef ART_SIMD
+// Lab values of row y of rgb, 4 pixels at a time
+void rgb2lab(Imagefloat::Mode mode, Imagefloat *rgb, int y, int W, float *L,
+             float *a, float *b, const float ws[3][3], const vfloat vws[3][3])
+{
+    int x = 0;
+    for (; x < W - 3; x += 4) {
+        vfloat R = LVFU(rgb->r(y, x));
+        vfloat G = LVFU(rgb->g(y, x));
+        vfloat B = LVFU(rgb->b(y, x));
+        vfloat Lv, av, bv;
+        switch (mode) {
+        case Imagefloat::Mode::RGB:
+            Color::rgb2lab(R, G, B, Lv, av, bv, vws);
+            break;
+        case Imagefloat::Mode::YUV:
+            Color::yuv2rgb(G, B, R, R, G, B, vws);
+            Color::rgb2lab(R, G, B, Lv, av, bv, vws);
+            break;
+        case Imagefloat::Mode::XYZ:
+            Color::XYZ2Lab(R, G, B, Lv, av, bv);
+            break;
+        default:
+            Lv = G;
+            av = R;
+            bv = B;
+            break;
+        }
+        STVFU(L[x], Lv);
+        STVFU(a[x], av);
+        STVFU(b[x], bv);
+    }
+    for (; x < W; ++x) {
+        rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x), L[x], a[x],
+                b[x], ws);
+    }
+}
+#endif
+
 class DeltaEEvaluator {
 public:
     DeltaEEvaluator(const std::vector<Mask> &masks)
@@ -950,7 +991,7 @@ bool LinkedMaskManager::is_needed(const Glib::ustring &toolname,
 
 std::unique_ptr<ExternalMaskManager> ExternalMaskManager::instance_;
 
-ExternalMaskManager::ExternalMaskManager(): cache_(4) {}
+ExternalMaskManager::ExternalMaskManager(): cache_(256 << 20) {}
 
 ExternalMaskManager *ExternalMaskManager::getInstance()
 {
@@ -999,7 +1040,7 @@ bool ExternalMaskManager::apply_mask(
             }
         }
 
-        cache_.set(key, mask);
+        cache_.set(key, mask, size_t(W) * H * sizeof(float));
     }
 
     const array2D<float> &a = *mask;
@@ -1055,24 +1096,22 @@ bool ExternalMaskManager::apply_mask(
 
 //-----------------------------------------------------------------------------
 
-bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
-                   LinkedMaskManager &mmgr, const std::vector<Mask> &masks,
-                   int offset_x, int offset_y, int full_width, int full_height,
-                   double scale, bool multithread, int show_mask_idx,
-                   std::vector<array2D<float>> *Lmask,
-                   std::vector<array2D<float>> *abmask,
-                   ProgressListener *plistener)
+namespace {
+
+void generate_masks(Imagefloat *rgb, const Glib::ustring &toolname,
+                    LinkedMaskManager &mmgr, const std::vector<Mask> &masks,
+                    int offset_x, int offset_y, int full_width,
+                    int full_height, double scale, bool multithread,
+                    int show_mask_idx, const std::vector<bool> &needed,
+                    std::vector<array2D<float>> *Lmask,
+                    std::vector<array2D<float>> *abmask,
+                    ProgressListener *plistener)
 {
     int n = masks.size();
-    if (show_mask_idx < 0 || show_mask_idx >= n ||
-        !masks[show_mask_idx].enabled) {
-        show_mask_idx = -1;
-    }
     std::vector<std::unique_ptr<FlatCurve>> hmask(n);
     std::vector<std::unique_ptr<FlatCurve>> cmask(n);
     std::vector<std::unique_ptr<FlatCurve>> lmask(n);
     std::vector<float> ldetail(n);
-    std::vector<bool> needed(n, true);
 
     const int W = rgb->getWidth();
     const int H = rgb->getHeight();
@@ -1080,14 +1119,12 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
 
     const Mask dflt;
 
-    const int begin_idx = max(show_mask_idx, 0);
     const int end_idx = (show_mask_idx < 0 ? n : show_mask_idx + 1);
     bool has_mask = false;
 
     for (int i = 0; i < end_idx; ++i) {
         auto &r = masks[i];
-        if (i < begin_idx && !mmgr.is_needed(toolname, r.name)) {
-            needed[i] = false;
+        if (!needed[i]) {
             continue;
         }
         if (r.deltaEMask.enabled) {
@@ -1143,6 +1180,14 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
             wp[i][j] = ws[i][j];
         }
     }
+#ifdef ART_SIMD
+    vfloat wpv[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            wpv[i][j] = F2V(wp[i][j]);
+        }
+    }
+#endif
 
     array2D<float> LL;
     if (has_lmask) {
@@ -1209,9 +1254,8 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
 #endif
         for (int y = 0; y < H; ++y) {
 #ifdef ART_SIMD
+            rgb2lab(mode, rgb, y, W, lBuffer, aBuffer, bBuffer, wp, wpv);
             for (int x = 0; x < W; ++x) {
-                rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x),
-                        lBuffer[x], aBuffer[x], bBuffer[x], wp);
                 lBuffer[x] /= 32768.f;
                 aBuffer[x] /= 42000.f;
                 bBuffer[x] /= 42000.f;
@@ -1544,37 +1588,181 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
             mmgr.store_mask(toolname, masks[i].name, m1, m2, multithread);
         }
     }
+}
 
-    if (show_mask_idx >= 0) {
-        TMatrix iws = ICCStore::getInstance()->workingSpaceInverseMatrix(
-            rgb->colorSpace());
-        float iwp[3][3];
-        for (int i = 0; i < 3; ++i) {
-            for (int j = 0; j < 3; ++j) {
-                iwp[i][j] = iws[i][j];
-            }
-        }
 
-        auto *smask = abmask ? abmask : Lmask;
+void show_mask(Imagefloat *rgb, const std::vector<array2D<float>> *smask,
+               int show_mask_idx, bool multithread)
+{
+    const int W = rgb->getWidth();
+    const int H = rgb->getHeight();
+    const auto mode = rgb->mode();
+
+    TMatrix ws = ICCStore::getInstance()->workingSpaceMatrix(rgb->colorSpace());
+    TMatrix iws =
+        ICCStore::getInstance()->workingSpaceInverseMatrix(rgb->colorSpace());
+    float wp[3][3];
+    float iwp[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            wp[i][j] = ws[i][j];
+            iwp[i][j] = iws[i][j];
+        }
+    }
 
 #ifdef _OPENMP
 #pragma omp parallel for if (multithread)
 #endif
-        for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                auto blend = smask ? (*smask)[show_mask_idx][y][x] : 0.f;
-                float l, a, b;
-                rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x), l, a, b,
-                        wp);
-                a = 0.f;
-                b = blend * 42000.f;
-                l = LIM(l + 32768.f * blend, 0.f, 32768.f);
-                Color::lab2rgb(l, a, b, rgb->r(y, x), rgb->g(y, x),
-                               rgb->b(y, x), iwp);
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            auto blend = smask ? (*smask)[show_mask_idx][y][x] : 0.f;
+            float l, a, b;
+            rgb2lab(mode, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x), l, a, b,
+                    wp);
+            a = 0.f;
+            b = blend * 42000.f;
+            l = LIM(l + 32768.f * blend, 0.f, 32768.f);
+            Color::lab2rgb(l, a, b, rgb->r(y, x), rgb->g(y, x), rgb->b(y, x),
+                           iwp);
+        }
+    }
+    rgb->assignMode(Imagefloat::Mode::RGB);
+}
+
+
+// Masks are cached across runs of the interactive pipelines, so that editing
+// a parameter of a later tool (or of a tool whose masks are unchanged) does
+// not recompute them. There is no notion of "generation" of the input image
+// in the pipeline, so a fingerprint of its contents is used instead: this is
+// much cheaper than generating the masks. The output pipeline doesn't use
+// the cache, as hits across images are practically impossible.
+struct MaskCacheEntry {
+    std::vector<Mask> masks;
+    std::vector<bool> needed;
+    std::vector<array2D<float>> Lmask;
+    std::vector<array2D<float>> abmask;
+
+    explicit MaskCacheEntry(size_t n): Lmask(n), abmask(n) {}
+};
+
+// total size of the cached masks, in bytes. Entries larger than half of it
+// are not cached
+constexpr size_t MASK_CACHE_SIZE = 256 << 20;
+
+ConcurrentCache<std::string, std::shared_ptr<MaskCacheEntry>>
+    mask_cache(MASK_CACHE_SIZE);
+
+} // namespace
+
+
+bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
+                   LinkedMaskManager &mmgr, const std::vector<Mask> &masks,
+                   int offset_x, int offset_y, int full_width, int full_height,
+                   double scale, bool multithread, int show_mask_idx,
+                   std::vector<array2D<float>> *Lmask,
+                   std::vector<array2D<float>> *abmask,
+                   ProgressListener *plistener, bool use_cache)
+{
+    const int n = masks.size();
+    if (show_mask_idx < 0 || show_mask_idx >= n ||
+        !masks[show_mask_idx].enabled) {
+        show_mask_idx = -1;
+    }
+
+    const int W = rgb->getWidth();
+    const int H = rgb->getHeight();
+    const int begin_idx = max(show_mask_idx, 0);
+    const int end_idx = (show_mask_idx < 0 ? n : show_mask_idx + 1);
+
+    std::vector<bool> needed(n, true);
+    size_t num_needed = 0;
+    // linked masks depend on the output of other tools, which is not
+    // captured by the cache key
+    bool cacheable = use_cache;
+    for (int i = 0; i < end_idx; ++i) {
+        if (i < begin_idx && !mmgr.is_needed(toolname, masks[i].name)) {
+            needed[i] = false;
+        } else {
+            ++num_needed;
+            if (masks[i].linkedMask.enabled) {
+                cacheable = false;
+            }
+        }
+    }
+    const size_t entry_size = size_t(W) * size_t(H) * num_needed *
+                              (int(bool(Lmask)) + int(bool(abmask))) *
+                              sizeof(float);
+    cacheable = cacheable && entry_size <= MASK_CACHE_SIZE / 2;
+
+    std::string key;
+    std::shared_ptr<MaskCacheEntry> entry;
+    if (cacheable) {
+        std::ostringstream buf;
+        buf << toolname << ':' << rgb->colorSpace() << ':'
+            << int(rgb->mode()) << ':' << W << 'x' << H << ':' << offset_x
+            << ',' << offset_y << ':' << full_width << 'x' << full_height
+            << ':' << scale << ':' << show_mask_idx << ':' << bool(Lmask)
+            << bool(abmask) << ':'
+            << FeatureCache::fingerprint(rgb, multithread);
+        // the contents of external mask files are not in the params
+        for (int i = 0; i < end_idx; ++i) {
+            const auto &em = masks[i].externalMask;
+            if (needed[i] && em.enabled) {
+                buf << ':' << getMD5(em.filename, true);
+            }
+        }
+        key = buf.str();
+        if (mask_cache.get(key, entry) &&
+            (entry->masks != masks || entry->needed != needed)) {
+            entry.reset();
+        }
+    }
+
+    if (entry) {
+        for (int i = 0; i < end_idx; ++i) {
+            if (!needed[i]) {
+                continue;
             }
+            if (Lmask) {
+                FeatureCache::copy(entry->Lmask[i], (*Lmask)[i],
+                                   multithread);
+            }
+            if (abmask) {
+                FeatureCache::copy(entry->abmask[i], (*abmask)[i],
+                                   multithread);
+            }
+            const array2D<float> *m1 = abmask ? &(*abmask)[i] : &(*Lmask)[i];
+            const array2D<float> *m2 = (Lmask && abmask) ? &(*Lmask)[i] : nullptr;
+            mmgr.store_mask(toolname, masks[i].name, m1, m2, multithread);
         }
-        rgb->assignMode(Imagefloat::Mode::RGB);
+    } else {
+        generate_masks(rgb, toolname, mmgr, masks, offset_x, offset_y,
+                       full_width, full_height, scale, multithread,
+                       show_mask_idx, needed, Lmask, abmask, plistener);
+
+        if (cacheable) {
+            entry = std::make_shared<MaskCacheEntry>(n);
+            entry->masks = masks;
+            entry->needed = needed;
+            for (int i = 0; i < end_idx; ++i) {
+                if (!needed[i]) {
+                    continue;
+                }
+                if (Lmask) {
+                    FeatureCache::copy((*Lmask)[i], entry->Lmask[i],
+                                       multithread);
+                }
+                if (abmask) {
+                    FeatureCache::copy((*abmask)[i], entry->abmask[i],
+                                       multithread);
+                }
+            }
+            mask_cache.set(key, entry, entry_size);
+        }
+    }
 
+    if (show_mask_idx >= 0) {
+        show_mask(rgb, abmask ? abmask : Lmask, show_mask_idx, multithread);
         return false;
     }
 
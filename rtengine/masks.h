@@ -21,7 +21,7 @@
 #pragma once
 
 #include "array2D.h"
-#include "cache.h"
+#include "concurrentcache.h"
 #include "imagefloat.h"
 #include "labimage.h"
 #include "procparams.h"
@@ -64,7 +64,7 @@ public:
 private:
     ExternalMaskManager();
 
-    Cache<std::string, std::shared_ptr<array2D<float>>> cache_;
+    ConcurrentCache<std::string, std::shared_ptr<array2D<float>>> cache_;
     static std::unique_ptr<ExternalMaskManager> instance_;
 };
 
@@ -74,7 +74,8 @@ bool generateMasks(Imagefloat *rgb, const Glib::ustring &toolname,
                    int offset_y, int full_width, int full_height, double scale,
                    bool multithread, int show_mask_idx,
                    std::vector<array2D<float>> *Lmask,
-                   std::vector<array2D<float>> *abmask, ProgressListener *pl);
+                   std::vector<array2D<float>> *abmask, ProgressListener *pl,
+                   bool use_cache);
 
 enum class MasksEditID { H = 0, C, L };
 void fillPipetteMasks(Imagefloat *rgb, PlanarWhateverData<float> *editWhatever,
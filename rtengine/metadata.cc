@@ -73,7 +73,37 @@ private:
 
 #endif // EXIV2_TEST_VERSION
 
-constexpr size_t IMAGE_CACHE_SIZE = 200;
+// budgets in bytes, see image_cost() and json_cost()
+constexpr size_t IMAGE_CACHE_SIZE = 32 << 20;
+constexpr size_t JSON_CACHE_SIZE = 16 << 20;
+
+// rough estimate of the memory used by the parsed metadata
+size_t image_cost(Exiv2::Image *image)
+{
+    size_t ret = sizeof(Exiv2::Image);
+    if (image) {
+        for (const auto &d : image->exifData()) {
+            ret += sizeof(d) + d.size();
+        }
+        for (const auto &d : image->iptcData()) {
+            ret += sizeof(d) + d.size();
+        }
+        for (const auto &d : image->xmpData()) {
+            ret += sizeof(d) + d.size();
+        }
+        ret += image->xmpPacket().size();
+    }
+    return ret;
+}
+
+size_t json_cost(const std::unordered_map<std::string, std::string> &data)
+{
+    size_t ret = sizeof(data);
+    for (const auto &p : data) {
+        ret += sizeof(p) + p.first.size() + p.second.size();
+    }
+    return ret;
+}
 
 std::unique_ptr<Exiv2::Image> open_exiv2(const Glib::ustring &fname,
                                          bool check_exif)
@@ -443,7 +473,7 @@ void Exiv2Metadata::load() const
                 val.image_mtime = finfo->modification_time();
                 val.xmp_mtime = xmp_mtime;
                 val.use_xmp = merge_xmp_;
-                cache_->set(src_, val);
+                cache_->set(src_, val, image_cost(image_.get()));
             }
         }
     }
@@ -813,7 +843,7 @@ void Exiv2Metadata::init(const Glib::ustring &base_dir,
                          const Glib::ustring &user_dir)
 {
     cache_.reset(new ImageCache(IMAGE_CACHE_SIZE));
-    jsoncache_.reset(new JSONCache(IMAGE_CACHE_SIZE));
+    jsoncache_.reset(new JSONCache(JSON_CACHE_SIZE));
     const gchar *exiftool_base_dir_env = g_getenv("ART_EXIFTOOL_BASE_DIR");
     if (exiftool_base_dir_env) {
         exiftool_base_dir = exiftool_base_dir_env;
@@ -985,7 +1015,8 @@ Exiv2Metadata::getExiftoolMakernotes(const Glib::ustring &fname)
     ret.erase("SourceFile");
 
     if (jsoncache_ && finfo) {
-        jsoncache_->set(fname, JSONCacheVal(ret, finfo->modification_time()));
+        jsoncache_->set(fname, JSONCacheVal(ret, finfo->modification_time()),
+                        json_cost(ret));
     }
 
     return ret;
@@ -20,7 +20,7 @@
 
 #pragma once
 
-#include "cache.h"
+#include "concurrentcache.h"
 #include "procparams.h"
 #include <exiv2/exiv2.hpp>
 #include <glibmm.h>
@@ -129,12 +129,12 @@ private:
         }
     };
     // typedef std::pair<std::shared_ptr<Exiv2::Image>, Glib::TimeVal> CacheVal;
-    typedef Cache<Glib::ustring, CacheVal> ImageCache;
+    typedef ConcurrentCache<Glib::ustring, CacheVal> ImageCache;
     static std::unique_ptr<ImageCache> cache_;
     typedef std::pair<std::unordered_map<std::string, std::string>,
                       Glib::TimeVal>
         JSONCacheVal;
-    typedef Cache<Glib::ustring, JSONCacheVal> JSONCache;
+    typedef ConcurrentCache<Glib::ustring, JSONCacheVal> JSONCache;
     static std::unique_ptr<JSONCache> jsoncache_;
 
     static std::unique_ptr<Exiftool> exiftool_;
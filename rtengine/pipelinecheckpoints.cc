@@ -0,0 +1,181 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pipelinecheckpoints.h"
+#include "mytime.h"
+#include "settings.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace rtengine {
+
+extern const Settings *settings;
+
+namespace {
+
+// taking a snapshot and restoring it cost a copy of the image each, so there
+// is no point in keeping one after a step that is cheaper than this (in
+// seconds)
+constexpr double MIN_STEP_COST = 0.005;
+
+} // namespace
+
+PipelineCheckpoints::PipelineCheckpoints(): skipped_(0) {}
+
+PipelineCheckpoints::~PipelineCheckpoints() = default;
+
+void PipelineCheckpoints::clear()
+{
+    key_.clear();
+    params_.reset();
+    entries_.clear();
+    skipped_ = 0;
+}
+
+std::vector<bool> PipelineCheckpoints::select(size_t image_size) const
+{
+    const size_t budget =
+        size_t(std::max(settings->pipeline_checkpoints_budget, 0)) << 20;
+    const size_t num = image_size ? budget / image_size : 0;
+
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].cost >= MIN_STEP_COST) {
+            candidates.push_back(i);
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [this](size_t a, size_t b) -> bool {
+                         return entries_[a].cost > entries_[b].cost;
+                     });
+
+    std::vector<bool> ret(entries_.size(), false);
+    for (size_t i = 0; i < std::min(num, candidates.size()); ++i) {
+        ret[candidates[i]] = true;
+    }
+    return ret;
+}
+
+bool PipelineCheckpoints::run(const std::vector<Step> &steps,
+                              const procparams::ProcParams &params,
+                              const std::string &key, Imagefloat *img)
+{
+    const size_t n = steps.size();
+    const size_t image_size =
+        size_t(img->getWidth()) * img->getHeight() * 3 * sizeof(float);
+
+    bool same_steps = entries_.size() == n;
+    for (size_t i = 0; i < n && same_steps; ++i) {
+        same_steps = entries_[i].name == steps[i].name;
+    }
+
+    if (!same_steps) {
+        // keep the costs measured so far, they are still good estimates
+        std::vector<Entry> entries(n);
+        for (size_t i = 0; i < n; ++i) {
+            entries[i].name = steps[i].name;
+            entries[i].cost = 0.0;
+            for (auto &e : entries_) {
+                if (e.name == steps[i].name) {
+                    entries[i].cost = e.cost;
+                }
+            }
+        }
+        entries_.swap(entries);
+    }
+
+    // first step whose result is not the same as in the previous run
+    size_t changed = 0;
+    if (same_steps && params_ && key == key_) {
+        while (changed < n && steps[changed].unchanged(*params_, params)) {
+            ++changed;
+        }
+    }
+
+    size_t start = 0;
+    for (size_t i = changed; i > 0; --i) {
+        if (entries_[i - 1].snapshot) {
+            start = i;
+            break;
+        }
+    }
+
+    if (start > 0) {
+        entries_[start - 1].snapshot->copyTo(img);
+    }
+    skipped_ = start;
+
+    key_ = key;
+    if (params_) {
+        *params_ = params;
+    } else {
+        params_.reset(new procparams::ProcParams(params));
+    }
+
+    std::vector<bool> keep = select(image_size);
+    for (size_t i = 0; i < n; ++i) {
+        // the buffers of the snapshots that will be retaken are reused
+        if (!keep[i]) {
+            entries_[i].snapshot.reset();
+        }
+    }
+
+    bool stop = false;
+    size_t i = start;
+    for (; i < n && !stop; ++i) {
+        MyTime t1, t2;
+        t1.set();
+        stop = steps[i].run();
+        t2.set();
+
+        Entry &e = entries_[i];
+        const double cost = t2.etime(t1) * 1e-6;
+        e.cost = e.cost > 0.0 ? 0.5 * (e.cost + cost) : cost;
+
+        keep = select(image_size);
+        if (!stop && keep[i]) {
+            if (!e.snapshot) {
+                e.snapshot.reset(new Imagefloat());
+            }
+            img->copyTo(e.snapshot.get());
+        } else {
+            e.snapshot.reset();
+        }
+    }
+
+    // the steps after a stop were not run
+    for (; i < n; ++i) {
+        entries_[i].snapshot.reset();
+    }
+
+    keep = select(image_size);
+    for (size_t j = 0; j < n; ++j) {
+        if (!keep[j]) {
+            entries_[j].snapshot.reset();
+        }
+    }
+
+    if (settings->verbose > 1 && start > 0) {
+        printf("PipelineCheckpoints: resumed after step %s\n",
+               entries_[start - 1].name.c_str());
+    }
+
+    return stop;
+}
+
+} // namespace rtengine
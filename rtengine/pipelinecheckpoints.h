@@ -0,0 +1,86 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "imagefloat.h"
+#include "noncopyable.h"
+#include "procparams.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rtengine {
+
+/**
+ * Snapshots of the image taken after some of the steps of a pipeline stage,
+ * so that when only the parameters of a later step change the stage can be
+ * resumed from the last snapshot before it, instead of being run from the
+ * beginning.
+ *
+ * The running time of every step is measured, and the snapshots are kept
+ * after the most expensive ones, as many as fit in the memory budget (see
+ * Settings::pipeline_checkpoints_budget). Each pipeline (the preview and
+ * each detail window) owns its own instance.
+ */
+class PipelineCheckpoints: public NonCopyable {
+public:
+    struct Step {
+        std::string name;
+        /** true if the parameters used by the step are the same in both */
+        std::function<bool(const procparams::ProcParams &,
+                           const procparams::ProcParams &)>
+            unchanged;
+        /** runs the step, returning true if the pipeline has to stop */
+        std::function<bool()> run;
+    };
+
+    PipelineCheckpoints();
+    ~PipelineCheckpoints();
+
+    void clear();
+
+    /**
+     * Runs the given steps on img. key must identify everything besides the
+     * parameters that affects the result (input pixels, scale, viewport,
+     * ...). Returns true if some step asked to stop the pipeline.
+     */
+    bool run(const std::vector<Step> &steps,
+             const procparams::ProcParams &params, const std::string &key,
+             Imagefloat *img);
+
+    /** number of leading steps skipped in the last run */
+    size_t skipped() const { return skipped_; }
+
+private:
+    struct Entry {
+        std::string name;
+        double cost; // smoothed running time, in seconds
+        std::unique_ptr<Imagefloat> snapshot;
+    };
+
+    std::vector<bool> select(size_t image_size) const;
+
+    std::string key_;
+    std::unique_ptr<procparams::ProcParams> params_;
+    std::vector<Entry> entries_;
+    size_t skipped_;
+};
+
+} // namespace rtengine
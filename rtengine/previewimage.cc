@@ -21,6 +21,7 @@
 #include "iccstore.h"
 #include "iimage.h"
 #include "imgiomanager.h"
+#include "lcmstransform.h"
 #include "rawimagesource.h"
 #include "rtthumbnail.h"
 #include "stdimagesource.h"
@@ -54,21 +55,18 @@ PreviewImage::~PreviewImage()
 void PreviewImage::render(bool enable_cms)
 {
     if (img_) {
-        cmsHTRANSFORM xform = nullptr;
+        LCMSTransform xform;
         if (enable_cms) {
             cmsHPROFILE mprof =
                 ICCStore::getInstance()->getActiveMonitorProfile();
             cmsHPROFILE iprof =
                 imgprof_ ? imgprof_ : ICCStore::getInstance()->getsRGBProfile();
             if (mprof) {
-                lcmsMutex->lock();
-                xform = cmsCreateTransform(
+                xform = LCMSTransform::create(
                     iprof, TYPE_RGB_8, mprof, TYPE_RGB_8,
                     settings->monitorIntent,
-                    cmsFLAGS_NOCACHE |
-                        (settings->monitorBPC ? cmsFLAGS_BLACKPOINTCOMPENSATION
-                                              : 0));
-                lcmsMutex->unlock();
+                    settings->monitorBPC ? cmsFLAGS_BLACKPOINTCOMPENSATION
+                                         : 0);
             }
         }
         const unsigned char *data = img_->data;
@@ -90,7 +88,7 @@ void PreviewImage::render(bool enable_cms)
                 unsigned char *dst = previewImage->get_data() + i * w * 4;
 
                 if (xform) {
-                    cmsDoTransform(xform, src, buf, w);
+                    xform(src, buf, w);
                     src = buf;
                 }
 
@@ -104,10 +102,6 @@ void PreviewImage::render(bool enable_cms)
             }
         }
         previewImage->mark_dirty();
-
-        if (xform) {
-            cmsDeleteTransform(xform);
-        }
     }
 }
 
@@ -195,17 +189,15 @@ Image8 *PreviewImage::load_img(const Glib::ustring &fname, int w, int h)
         // do the CMS conversion here
         Imagefloat *f = static_cast<Imagefloat *>(img);
         if (has_profile) {
-            lcmsMutex->lock();
-            cmsHTRANSFORM xform =
-                cmsCreateTransform(img->getEmbeddedProfile(), TYPE_RGB_FLT,
-                                   ICCStore::getInstance()->getsRGBProfile(),
-                                   TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC,
-                                   cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            lcmsMutex->unlock();
-            f->normalizeFloatTo1();
-            f->ExecCMSTransform(xform, true);
-            f->normalizeFloatTo65535();
-            cmsDeleteTransform(xform);
+            LCMSTransform xform = LCMSTransform::create(
+                img->getEmbeddedProfile(), TYPE_RGB_FLT_PLANAR,
+                ICCStore::getInstance()->getsRGBProfile(), TYPE_RGB_FLT_PLANAR,
+                INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
+            if (xform) {
+                f->normalizeFloatTo1();
+                xform.apply(f, true);
+                f->normalizeFloatTo65535();
+            }
         }
         has_profile = false;
         f->resizeImgTo(w, h, TI_Bilinear, ret);
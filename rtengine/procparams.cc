@@ -17,6 +17,7 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <iterator>
 #include <map>
@@ -108,6 +109,99 @@ std::string pack_list(const std::vector<double> &data)
     return base64encode(bytes);
 }
 
+const char *const BINARY_MAGIC = "ARPB";
+const uint32_t BINARY_VERSION = 1;
+const size_t BINARY_HEADER_SIZE = 4 + sizeof(uint32_t) + sizeof(uint64_t);
+
+struct BinaryGroup {
+    uint32_t offset;
+    uint32_t size;
+};
+
+uint64_t fnv1a_hash(const char *data, size_t size,
+                    uint64_t h = 14695981039346656037ULL)
+{
+    for (size_t i = 0; i < size; ++i) {
+        h ^= uint8_t(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void binary_put(std::string &out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(char((v >> (8 * i)) & 0xFF));
+    }
+}
+
+void binary_put(std::string &out, const std::string &s)
+{
+    binary_put(out, uint32_t(s.size()));
+    out += s;
+}
+
+class BinaryReader {
+public:
+    BinaryReader(const std::string &data, size_t pos,
+                 size_t end = std::string::npos)
+        : data_(data), pos_(pos), end_(std::min(end, data.size()))
+    {
+    }
+
+    size_t pos() const { return pos_; }
+
+    bool skip(size_t n)
+    {
+        if (pos_ + n > end_) {
+            return false;
+        }
+        pos_ += n;
+        return true;
+    }
+
+    bool get(uint32_t &out)
+    {
+        uint64_t v = 0;
+        if (!get_le(v, 4)) {
+            return false;
+        }
+        out = uint32_t(v);
+        return true;
+    }
+
+    bool get(uint64_t &out) { return get_le(out, 8); }
+
+    bool get(std::string &out)
+    {
+        uint32_t n = 0;
+        if (!get(n) || pos_ + n > end_) {
+            return false;
+        }
+        out.assign(data_, pos_, n);
+        pos_ += n;
+        return true;
+    }
+
+private:
+    bool get_le(uint64_t &out, int n)
+    {
+        if (pos_ + n > end_) {
+            return false;
+        }
+        out = 0;
+        for (int i = 0; i < n; ++i) {
+            out |= uint64_t(uint8_t(data_[pos_ + i])) << (8 * i);
+        }
+        pos_ += n;
+        return true;
+    }
+
+    const std::string &data_;
+    size_t pos_;
+    size_t end_;
+};
+
 } // namespace
 
 const short SpotParams::minRadius = 2;
@@ -225,6 +319,32 @@ void KeyFile::set_double_list(const Glib::ustring &grp,
 bool KeyFile::load_from_file(const Glib::ustring &fn)
 {
     filename_ = fn;
+
+    // look at the beginning of the file before reading it: this is also
+    // called on the images themselves (see ProcParams::load()), which must
+    // not be read into memory as a whole. Binary params start with the
+    // magic, and text key files do not contain control characters, while
+    // raw and image headers do within their first bytes
+    char head[64];
+    size_t n = 0;
+    FILE *f = g_fopen(fn.c_str(), "rb");
+    if (f) {
+        n = fread(head, 1, sizeof(head), f);
+        fclose(f);
+    }
+
+    if (n >= 4 && memcmp(head, BINARY_MAGIC, 4) == 0) {
+        return load_from_binary(Glib::file_get_contents(fn));
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned char c = head[i];
+        if (c < 0x20 && c != '\t' && c != '\n' && c != '\r') {
+            throw Glib::KeyFileError(Glib::KeyFileError::PARSE,
+                                     "not a key file: " + fn);
+        }
+    }
+
     return kf_.load_from_file(fn);
 }
 
@@ -235,6 +355,106 @@ bool KeyFile::load_from_data(const Glib::ustring &data)
 
 Glib::ustring KeyFile::to_data() { return kf_.to_data(); }
 
+/******************************************************************************
+ * binary format (all integers are little endian):
+ *
+ * "ARPB" magic
+ * uint32 format version
+ * uint64 FNV-1a hash of everything that follows
+ * uint32 number of groups
+ * for each group: name (uint32 length + bytes), uint32 offset, uint32 size
+ * payload: for each group, uint32 number of keys, followed by the key names
+ *          and the raw (escaped) values, each as uint32 length + bytes
+ ******************************************************************************/
+
+bool KeyFile::load_from_binary(const std::string &data)
+{
+    uint64_t hash = 0;
+    if (!get_binary_hash(data, hash) ||
+        fnv1a_hash(data.data() + BINARY_HEADER_SIZE,
+                   data.size() - BINARY_HEADER_SIZE) != hash) {
+        return false;
+    }
+
+    BinaryReader rd(data, BINARY_HEADER_SIZE);
+    uint32_t n = 0;
+    if (!rd.get(n)) {
+        return false;
+    }
+    // to_binary() writes the groups in order, so decoding them in index
+    // order preserves the group order
+    std::vector<std::pair<std::string, BinaryGroup>> index;
+    for (uint32_t i = 0; i < n; ++i) {
+        std::string name;
+        BinaryGroup g;
+        if (!rd.get(name) || !rd.get(g.offset) || !rd.get(g.size)) {
+            return false;
+        }
+        index.emplace_back(name, g);
+    }
+
+    kf_.load_from_data("");
+    const size_t base = rd.pos();
+    for (auto &p : index) {
+        const size_t start = base + p.second.offset;
+        BinaryReader grd(data, start, start + p.second.size);
+        uint32_t nkeys = 0;
+        if (start + p.second.size > data.size() || !grd.get(nkeys)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < nkeys; ++i) {
+            std::string key, value;
+            if (!grd.get(key) || !grd.get(value)) {
+                return false;
+            }
+            kf_.set_value(p.first, key, value);
+        }
+    }
+
+    return true;
+}
+
+std::string KeyFile::to_binary()
+{
+    std::string payload;
+    std::string index;
+    std::vector<Glib::ustring> groups = kf_.get_groups();
+    binary_put(index, uint32_t(groups.size()));
+    for (auto &g : groups) {
+        const size_t start = payload.size();
+        std::vector<Glib::ustring> keys = kf_.get_keys(g);
+        binary_put(payload, uint32_t(keys.size()));
+        for (auto &k : keys) {
+            binary_put(payload, k.raw());
+            binary_put(payload, kf_.get_value(g, k).raw());
+        }
+        binary_put(index, g.raw());
+        binary_put(index, uint32_t(start));
+        binary_put(index, uint32_t(payload.size() - start));
+    }
+
+    const std::string body = index + payload;
+    const uint64_t hash = fnv1a_hash(body.data(), body.size());
+    std::string ret = BINARY_MAGIC;
+    binary_put(ret, BINARY_VERSION);
+    for (int i = 0; i < 8; ++i) {
+        ret.push_back(char((hash >> (8 * i)) & 0xFF));
+    }
+    ret += body;
+    return ret;
+}
+
+bool KeyFile::get_binary_hash(const std::string &data, uint64_t &out)
+{
+    BinaryReader rd(data, 0);
+    uint32_t version = 0;
+    if (data.compare(0, 4, BINARY_MAGIC) != 0 || !rd.skip(4) ||
+        !rd.get(version) || version != BINARY_VERSION || !rd.get(out)) {
+        return false;
+    }
+    return true;
+}
+
 namespace {
 
 Glib::ustring expandRelativePath(const Glib::ustring &procparams_fname,
@@ -6343,6 +6563,21 @@ std::string ProcParams::to_data() const
     }
 }
 
+std::string ProcParams::to_binary() const
+{
+    try {
+        KeyFile kf;
+        int ret = save(nullptr, kf, nullptr, "");
+        if (ret != 0) {
+            return "";
+        }
+
+        return kf.to_binary();
+    } catch (Glib::KeyFileError &exc) {
+        return "";
+    }
+}
+
 std::vector<const MaskableParams *> ProcParams::get_maskable() const
 {
     std::vector<const MaskableParams *> ret = {&colorcorrection, &smoothing,
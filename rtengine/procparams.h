@@ -23,6 +23,7 @@
 #include <cmath>
 #include <cstdio>
 #include <map>
+#include <stdint.h>
 #include <type_traits>
 #include <vector>
 
@@ -94,6 +95,11 @@ public:
     bool load_from_data(const Glib::ustring &data);
     Glib::ustring to_data();
 
+    // compact binary representation of the same contents as to_data().
+    // load_from_file() recognizes binary files automatically
+    bool load_from_binary(const std::string &data);
+    std::string to_binary();
+
     Glib::ustring get_prefix() const { return prefix_; }
     void set_prefix(const Glib::ustring &prefix) { prefix_ = prefix; }
 
@@ -101,6 +107,7 @@ public:
 
 private:
     Glib::ustring GRP(const Glib::ustring &g) const { return prefix_ + g; }
+    static bool get_binary_hash(const std::string &data, uint64_t &out);
 
     Glib::ustring prefix_;
     Glib::KeyFile kf_;
@@ -1668,6 +1675,10 @@ public:
     bool from_data(const char *data);
     std::string to_data() const;
 
+    /** Binary counterpart of to_data() (see KeyFile::to_binary()). Binary
+     * files are read back by load() */
+    std::string to_binary() const;
+
     std::vector<const MaskableParams *> get_maskable() const;
 
 private:
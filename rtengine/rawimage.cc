@@ -1230,7 +1230,7 @@ int RawImage::loadRaw(bool loadData, unsigned int imageNum, bool closeFile,
         return do_loadRaw(imgio_filename_, loadData, imageNum, closeFile,
                           plistener, progressRange, apply_corrections);
     default: {
-        FramesData md(filename, true);
+        FramesData md(filename, FramesData::Tags::MAKE_MODEL);
         use_imgio_ = ImageIOManager::getInstance()->loadRaw(
                          filename, md.getMake(), md.getModel(), imgio_filename_)
                          ? ThreeValBool::T
@@ -17,7 +17,10 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <cmath>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <tuple>
 
 #include "../rtgui/multilangmgr.h"
 #include "camconst.h"
@@ -35,11 +38,15 @@
 #include "rawimage.h"
 #include "rawimagesource.h"
 #include "rawimagesource_i.h"
+#include "rawstatistics.h"
 #include "rt_math.h"
 #include "rtengine.h"
 #include "rtlensfun.h"
+#include "utils.h"
 #define BENCHMARK
 #include "StopWatch.h"
+#include "cache.h"
+#include "concurrentcache.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -682,6 +689,42 @@ void apply_cat(RawImageSource *src, Imagefloat *img, const ColorTemp &ctemp)
     }
 }
 
+/*
+ * Box-blurred flat fields, shared by all the images that use the same flat
+ * field template with the same blur settings. Computing the blur is the bulk
+ * of the flat-field correction cost, and in batch processing the same
+ * calibration set is typically used for many frames. The budget (in bytes)
+ * allows for the three maps of the VH blur type up to about 32 Mpix.
+ *
+ * The entries are keyed on the file name, size and mtime of the template
+ * and on a fingerprint of its data (which is an average of several files
+ * for automatically matched flat fields), plus the blur settings.
+ */
+using FlatFieldBlurKey = std::tuple<std::string, int, int, int, int>;
+ConcurrentCache<FlatFieldBlurKey, std::shared_ptr<const std::vector<float>>>
+    flatFieldBlurCache(384 << 20);
+
+std::string flat_field_id(const RawImage *ri)
+{
+    const int fw = ri->get_width();
+    const int fh = ri->get_height();
+    // every 16th row is enough to tell the templates apart
+    size_t h = 0;
+    for (int i = 0; i < fh; i += 16) {
+        const float *row = ri->data[i];
+        for (int j = 0; j < fw; ++j) {
+            h = h * 31 + std::hash<float>()(row[j]);
+        }
+    }
+    std::ostringstream buf;
+    buf << ri->get_filename() << ':' << getMD5(ri->get_filename(), true) << ':'
+        << fw << 'x' << fh << ':' << std::hex << h;
+    return buf.str();
+}
+
+// distance from the edges of the area used for the auto white balance
+constexpr int AWB_MARGIN = 32;
+
 } // namespace
 
 extern const Settings *settings;
@@ -697,11 +740,15 @@ RawImageSource::RawImageSource()
       refwb_blue(0.0), rgb_cam{}, cam_rgb{}, xyz_cam{}, cam_xyz{}, fuji(false),
       d1x(false), border(4), chmax{}, hlmax{}, clmax{}, initialGain(0.0),
       camInitialGain(0.0), defGain(0.0), ri(nullptr), rawData(0, 0),
-      green(0, 0), red(0, 0), blue(0, 0), rawDirty(true)
+      green(0, 0), red(0, 0), blue(0, 0), rawDirty(true),
+      rawDataIsScaledRaw(false)
 {
     camProfile = nullptr;
     embProfile = nullptr;
     rgbSourceModified = false;
+    lazy_demosaic = false;
+    bin_factor = 0;
+    bin_pending = false;
     for (int i = 0; i < 4; ++i) {
         psRedBrightness[i] = psGreenBrightness[i] = psBlueBrightness[i] = 1.f;
     }
@@ -711,6 +758,7 @@ RawImageSource::RawImageSource()
 
 RawImageSource::~RawImageSource()
 {
+    demosaic_discard();
 
     delete idata;
 
@@ -992,6 +1040,8 @@ void RawImageSource::getImage(const ColorTemp &ctemp, int tran,
         (hrp.hrmode == procparams::ExposureParams::HR_COLOR ||
          hrp.hrmode == procparams::ExposureParams::HR_COLORSOFT)) {
         if (!rgbSourceModified) {
+            // the reconstruction works on the whole image
+            demosaic_finish();
             if (hrp.hrmode == procparams::ExposureParams::HR_COLOR) {
                 HLRecovery_inpaint(hrp.hrblur);
             } else {
@@ -1033,6 +1083,21 @@ void RawImageSource::getImage(const ColorTemp &ctemp, int tran,
     gm /= area;
     bm /= area;
 
+    // binned data can be used when every output pixel covers whole bins
+    int bf = 0;
+    if (!fuji && !d1x) {
+        MyMutex::MyLock lock(lazyDemosaicMutex);
+        if (bin_factor && skip % bin_factor == 0) {
+            bf = bin_factor;
+        }
+    }
+    const int bskip = bf ? skip / bf : 0;
+    const float binArea = bf * bf;
+
+    if (!bf) {
+        demosaic_full();
+    }
+
 #ifdef _OPENMP
 #pragma omp parallel if (                                                      \
         !d1x) // omp disabled for D1x to avoid race conditions (see Issue 1088
@@ -1055,17 +1120,35 @@ void RawImageSource::getImage(const ColorTemp &ctemp, int tran,
             if (ri->getSensorType() == ST_BAYER ||
                 ri->getSensorType() == ST_FUJI_XTRANS ||
                 ri->get_colors() == 1 || ri->get_colors() == 3) {
+                const int bi =
+                    bf ? std::min(i / bf, bin_red.height() - bskip) : 0;
+
                 for (int j = 0, jx = sx1; j < imwidth; j++, jx += skip) {
                     jx = std::min(jx, maxx - skip); // avoid trouble
 
                     float rtot = 0.f, gtot = 0.f, btot = 0.f;
 
-                    for (int m = 0; m < skip; m++)
-                        for (int n = 0; n < skip; n++) {
-                            rtot += red[i + m][jx + n];
-                            gtot += green[i + m][jx + n];
-                            btot += blue[i + m][jx + n];
-                        }
+                    if (bf) {
+                        const int bj =
+                            std::min(jx / bf, bin_red.width() - bskip);
+                        for (int m = 0; m < bskip; m++)
+                            for (int n = 0; n < bskip; n++) {
+                                rtot += bin_red[bi + m][bj + n];
+                                gtot += bin_green[bi + m][bj + n];
+                                btot += bin_blue[bi + m][bj + n];
+                            }
+                        // each bin holds the average of bf x bf pixels
+                        rtot *= binArea;
+                        gtot *= binArea;
+                        btot *= binArea;
+                    } else {
+                        for (int m = 0; m < skip; m++)
+                            for (int n = 0; n < skip; n++) {
+                                rtot += red[i + m][jx + n];
+                                gtot += green[i + m][jx + n];
+                                btot += blue[i + m][jx + n];
+                            }
+                    }
 
                     rtot *= rm;
                     gtot *= gm;
@@ -1447,14 +1530,19 @@ int RawImageSource::load(const Glib::ustring &fname, bool firstFrameOnly)
 #pragma omp for nowait
 #endif
             for (unsigned int i = 0; i < numFrames; ++i) {
+                int err = 0;
                 if (i == 0) {
                     riFrames[i] = ri;
-                    errCodeThr =
+                    err =
                         riFrames[i]->loadRaw(true, i + 1, true, plistener, 0.8);
                 } else {
                     riFrames[i] = new RawImage(fname);
-                    errCodeThr = riFrames[i]->loadRaw(true, i + 1);
+                    err = riFrames[i]->loadRaw(true, i + 1);
+                }
+                if (!err) {
+                    riFrames[i]->compress_image(i);
                 }
+                errCodeThr = err ? err : errCodeThr;
             }
 #ifdef _OPENMP99
 #pragma omp critical
@@ -1473,14 +1561,24 @@ int RawImageSource::load(const Glib::ustring &fname, bool firstFrameOnly)
 #pragma omp for nowait
 #endif
             for (unsigned int i = 0; i < numFrames; ++i) {
+                // each frame is decoded and converted to its compact float
+                // representation right away by the thread that loaded it:
+                // this way the conversion of the frames runs concurrently,
+                // and the full-size decoder buffer of each frame is released
+                // as soon as possible, which keeps the peak memory usage
+                // bounded for files with many frames
+                int err = 0;
                 if (i == 0) {
                     riFrames[i] = ri;
-                    errCodeThr =
-                        riFrames[i]->loadRaw(true, i, true, plistener, 0.8);
+                    err = riFrames[i]->loadRaw(true, i, true, plistener, 0.8);
                 } else {
                     riFrames[i] = new RawImage(fname);
-                    errCodeThr = riFrames[i]->loadRaw(true, i);
+                    err = riFrames[i]->loadRaw(true, i);
                 }
+                if (!err) {
+                    riFrames[i]->compress_image(i);
+                }
+                errCodeThr = err ? err : errCodeThr;
             }
 #ifdef _OPENMP
 #pragma omp critical
@@ -1492,13 +1590,12 @@ int RawImageSource::load(const Glib::ustring &fname, bool firstFrameOnly)
     } else {
         riFrames[0] = ri;
         errCode = riFrames[0]->loadRaw(true, 0, true, plistener, 0.8);
+        if (!errCode) {
+            riFrames[0]->compress_image(0);
+        }
     }
 
-    if (!errCode) {
-        for (unsigned int i = 0; i < numFrames; ++i) {
-            riFrames[i]->compress_image(i);
-        }
-    } else {
+    if (errCode) {
         return errCode;
     }
 
@@ -1696,6 +1793,11 @@ void RawImageSource::preprocess(const RAWParams &raw,
     MyTime t1, t2;
     t1.set();
 
+    // rawData is about to change, and preprocess() is always followed by
+    // demosaic(), so the deferred full resolution demosaic would be thrown
+    // away anyway
+    demosaic_discard();
+
     { // recompute the pre multipliers with the chosen wb
         float tmp_scale_mul[4];
         float tmp_black[4];
@@ -1795,6 +1897,12 @@ void RawImageSource::preprocess(const RAWParams &raw,
 
     bool hasFlatField = (rif != nullptr);
 
+    rawDataIsScaledRaw = !rid && !raw.enable_flatfield &&
+                         !(numFrames == 2 && currFrame == 2) &&
+                         !(ri->getSensorType() == ST_BAYER &&
+                           raw.bayersensor.enable_preproc &&
+                           raw.bayersensor.dynamicRowNoiseFilter);
+
     if (hasFlatField && settings->verbose) {
         printf("Flat Field Correction:%s\n", rif->get_filename().c_str());
     }
@@ -1911,6 +2019,7 @@ void RawImageSource::preprocess(const RAWParams &raw,
     // Correct vignetting of lens profile
     if (!hasFlatField && lensProf.useVign &&
         lensProf.lcMode != LensProfParams::LcMode::NONE) {
+        rawDataIsScaledRaw = false;
         std::unique_ptr<LensCorrection> pmap;
         if (lensProf.useLensfun()) {
             pmap = LFDatabase::getInstance()->findModifier(lensProf, idata, W,
@@ -2021,6 +2130,7 @@ void RawImageSource::preprocess(const RAWParams &raw,
          (globalGreenEq() &&
           raw.bayersensor.method != RAWParams::BayerSensor::Method::VNG4)) &&
         raw.bayersensor.enable_preproc) {
+        rawDataIsScaledRaw = false;
         if (settings->verbose) {
             printf("Performing global green equilibration...\n");
         }
@@ -2041,6 +2151,7 @@ void RawImageSource::preprocess(const RAWParams &raw,
             plistener->setProgress(0.0);
         }
 
+        rawDataIsScaledRaw = false;
         GreenEqulibrateThreshold thresh(0.01 * raw.bayersensor.greenthresh);
 
         if (numFrames == 4) {
@@ -2053,6 +2164,8 @@ void RawImageSource::preprocess(const RAWParams &raw,
     }
 
     if (totBP) {
+        // also covers the PDAF lines filter
+        rawDataIsScaledRaw = false;
         if (ri->getSensorType() == ST_BAYER) {
             if (numFrames == 4) {
                 for (int i = 0; i < 4; ++i) {
@@ -2071,6 +2184,7 @@ void RawImageSource::preprocess(const RAWParams &raw,
 
     if (ri->getSensorType() == ST_BAYER && raw.bayersensor.enable_preproc &&
         raw.bayersensor.linenoise > 0) {
+        rawDataIsScaledRaw = false;
         if (plistener) {
             plistener->setProgressStr("Line Denoise...");
             plistener->setProgress(0.0);
@@ -2098,6 +2212,7 @@ void RawImageSource::preprocess(const RAWParams &raw,
          fabs(raw.cablue) > 0.001) &&
         ri->getSensorType() == ST_BAYER &&
         raw.enable_ca) { // Auto CA correction disabled for X-Trans, for now...
+        rawDataIsScaledRaw = false;
         if (plistener) {
             plistener->setProgressStr("CA Auto Correction...");
             plistener->setProgress(0.0);
@@ -2142,6 +2257,8 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast,
     MyTime t1, t2;
     t1.set();
 
+    demosaic_discard();
+
     double raw_expos = raw.enable_whitepoint ? raw.expos : 1.0;
 
     if (ri->getSensorType() == ST_BAYER) {
@@ -2192,7 +2309,11 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast,
                                   raw.bayersensor.lmmse_iterations);
             break;
         case RAWParams::BayerSensor::Method::FAST:
-            fast_demosaic();
+            if (lazy_demosaic && rcd_supported()) {
+                bin_demosaic();
+            } else {
+                fast_demosaic();
+            }
             break;
         case RAWParams::BayerSensor::Method::MONO:
             nodemosaic(true);
@@ -2206,7 +2327,11 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast,
     } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
         switch (raw.xtranssensor.method) {
         case RAWParams::XTransSensor::Method::FAST:
-            fast_xtrans_interpolate(rawData, red, green, blue);
+            if (lazy_demosaic) {
+                bin_demosaic();
+            } else {
+                fast_xtrans_interpolate(rawData, red, green, blue);
+            }
             break;
         case RAWParams::XTransSensor::Method::ONE_PASS:
             xtrans_interpolate(1, false);
@@ -2260,6 +2385,8 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast,
 
 void RawImageSource::flushRawData()
 {
+    demosaic_finish();
+
     if (rawData) {
         rawData(0, 0);
     }
@@ -2267,6 +2394,14 @@ void RawImageSource::flushRawData()
 
 void RawImageSource::flushRGB()
 {
+    demosaic_discard();
+
+    if (bin_red) {
+        bin_red(0, 0);
+        bin_green(0, 0);
+        bin_blue(0, 0);
+    }
+
     if (green) {
         green(0, 0);
     }
@@ -2280,6 +2415,34 @@ void RawImageSource::flushRGB()
     }
 }
 
+void RawImageSource::demosaic_full()
+{
+    MyMutex::MyLock lock(lazyDemosaicMutex);
+    if (bin_pending) {
+        // the binned data can't serve this request, run the full resolution
+        // method that was deferred by bin_demosaic()
+        if (ri->getSensorType() == ST_FUJI_XTRANS) {
+            fast_xtrans_interpolate(rawData, red, green, blue);
+        } else {
+            fast_demosaic();
+        }
+        bin_pending = false;
+    }
+}
+
+void RawImageSource::demosaic_finish()
+{
+    demosaic_full();
+    demosaic_discard();
+}
+
+void RawImageSource::demosaic_discard()
+{
+    MyMutex::MyLock lock(lazyDemosaicMutex);
+    bin_pending = false;
+    bin_factor = 0;
+}
+
 void RawImageSource::HLRecovery_Global(const ExposureParams &hrp)
 {
     // if (hrp.enabled && (hrp.hrmode == procparams::ExposureParams::HR_COLOR ||
@@ -2304,7 +2467,7 @@ void RawImageSource::processFlatField(const RAWParams &raw,
                                       unsigned short black[4])
 {
     //    BENCHFUN
-    float *cfablur = (float(*))malloc(H * W * sizeof *cfablur);
+    std::shared_ptr<const std::vector<float>> cfablurbuf;
     int BS = raw.ff_BlurRadius;
     BS += BS & 1;
 
@@ -2320,20 +2483,21 @@ void RawImageSource::processFlatField(const RAWParams &raw,
     // function call to cfabloxblur
     if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
                                RAWParams::FlatFieldBlurType::V)) {
-        cfaboxblur(riFlatFile, cfablur, 2 * BS, 0);
+        cfablurbuf = getFlatFieldBlur(riFlatFile, 2 * BS, 0);
     } else if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
                                       RAWParams::FlatFieldBlurType::H)) {
-        cfaboxblur(riFlatFile, cfablur, 0, 2 * BS);
+        cfablurbuf = getFlatFieldBlur(riFlatFile, 0, 2 * BS);
     } else if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
                                       RAWParams::FlatFieldBlurType::VH)) {
         // slightly more complicated blur if trying to correct both vertical and
         // horizontal anomalies
-        cfaboxblur(riFlatFile, cfablur, BS,
-                   BS); // first do area blur to correct vignette
-    } else {            //(raw.ff_BlurType ==
-             //RAWParams::getFlatFieldBlurTypeString(RAWParams::area_ff))
-        cfaboxblur(riFlatFile, cfablur, BS, BS);
+        cfablurbuf = getFlatFieldBlur(
+            riFlatFile, BS, BS); // first do area blur to correct vignette
+    } else {                     //(raw.ff_BlurType ==
+        // RAWParams::getFlatFieldBlurTypeString(RAWParams::area_ff))
+        cfablurbuf = getFlatFieldBlur(riFlatFile, BS, BS);
     }
+    const float *cfablur = cfablurbuf->data();
 
     if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
         float refcolor[2][2];
@@ -2581,12 +2745,14 @@ void RawImageSource::processFlatField(const RAWParams &raw,
 
     if (raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(
                                RAWParams::FlatFieldBlurType::VH)) {
-        float *cfablur1 = (float(*))malloc(H * W * sizeof *cfablur1);
-        float *cfablur2 = (float(*))malloc(H * W * sizeof *cfablur2);
         // slightly more complicated blur if trying to correct both vertical and
         // horizontal anomalies
-        cfaboxblur(riFlatFile, cfablur1, 0, 2 * BS); // now do horizontal blur
-        cfaboxblur(riFlatFile, cfablur2, 2 * BS, 0); // now do vertical blur
+        const auto cfablurbuf1 =
+            getFlatFieldBlur(riFlatFile, 0, 2 * BS); // now do horizontal blur
+        const auto cfablurbuf2 =
+            getFlatFieldBlur(riFlatFile, 2 * BS, 0); // now do vertical blur
+        const float *cfablur1 = cfablurbuf1->data();
+        const float *cfablur2 = cfablurbuf2->data();
 
         if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
             unsigned int c[2][2]{};
@@ -2669,12 +2835,21 @@ void RawImageSource::processFlatField(const RAWParams &raw,
                 }
             }
         }
-
-        free(cfablur1);
-        free(cfablur2);
     }
+}
 
-    free(cfablur);
+std::shared_ptr<const std::vector<float>>
+RawImageSource::getFlatFieldBlur(RawImage *riFlatFile, int boxH, int boxW)
+{
+    const FlatFieldBlurKey key(flat_field_id(riFlatFile), W, H, boxH, boxW);
+    std::shared_ptr<const std::vector<float>> ret;
+    if (!flatFieldBlurCache.get(key, ret)) {
+        auto buf = std::make_shared<std::vector<float>>(size_t(W) * H);
+        cfaboxblur(riFlatFile, buf->data(), boxH, boxW);
+        flatFieldBlurCache.set(key, buf, buf->size() * sizeof(float));
+        ret = buf;
+    }
+    return ret;
 }
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -2714,6 +2889,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
             H == riDark->get_height()) { // This works also for xtrans-sensors,
                                          // because black[0] to black[4] are
                                          // equal for these
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     int c = FC(row, col);
@@ -2747,6 +2925,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
         }
 
         if (riDark && W == riDark->get_width() && H == riDark->get_height()) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     rawData[row][col] = max(src->data[row][col] + black[0] -
@@ -2755,6 +2936,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
                 }
             }
         } else {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     rawData[row][col] = src->data[row][col];
@@ -2773,6 +2957,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
         }
 
         if (riDark && W == riDark->get_width() && H == riDark->get_height()) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     int c = FC(row, col);
@@ -2792,6 +2979,9 @@ void RawImageSource::copyOriginalPixels(const RAWParams &raw, RawImage *src,
                 }
             }
         } else {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int row = 0; row < H; row++) {
                 for (int col = 0; col < W; col++) {
                     rawData[row][3 * col + 0] = src->data[row][3 * col + 0];
@@ -3869,7 +4059,7 @@ void RawImageSource::colorSpaceConversion_(
         }
 
         // Initialize transform
-        cmsHTRANSFORM hTransform;
+        LCMSTransform hTransform;
         cmsHPROFILE prophoto = ICCStore::getInstance()->workingSpace(
             "ProPhoto"); // We always use Prophoto to apply the ICC profile to
                          // minimize problems with clipping in LUT conversion.
@@ -3910,8 +4100,6 @@ void RawImageSource::colorSpaceConversion_(
             }
         }
 
-        lcmsMutex->lock();
-
         switch (camera_icc_type) {
         case CAMERA_ICC_TYPE_PHASE_ONE:
         case CAMERA_ICC_TYPE_LEAF: {
@@ -3922,10 +4110,9 @@ void RawImageSource::colorSpaceConversion_(
             // We transform to Lab because we can and that we avoid getting an
             // unnecessary unmatched gamma conversion which we would need to
             // revert.
-            hTransform =
-                cmsCreateTransform(in, TYPE_RGB_FLT, nullptr, TYPE_Lab_FLT,
-                                   INTENT_RELATIVE_COLORIMETRIC,
-                                   cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
+            hTransform = LCMSTransform::create(
+                in, TYPE_RGB_FLT, nullptr, TYPE_Lab_FLT,
+                INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
 
             for (int i = 0; i < 3; i++) {
                 for (int j = 0; j < 3; j++) {
@@ -3944,25 +4131,18 @@ void RawImageSource::colorSpaceConversion_(
         case CAMERA_ICC_TYPE_NIKON:
         case CAMERA_ICC_TYPE_GENERIC:
         default:
-            hTransform = cmsCreateTransform(
+            hTransform = LCMSTransform::create(
                 in, TYPE_RGB_FLT, prophoto, TYPE_RGB_FLT,
-                INTENT_RELATIVE_COLORIMETRIC,
-                cmsFLAGS_NOOPTIMIZE |
-                    cmsFLAGS_NOCACHE); // NOCACHE is important for thread safety
+                INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
             break;
         }
 
-        lcmsMutex->unlock();
-
-        if (hTransform == nullptr) {
+        if (!hTransform) {
             // Fallback: create transform from camera profile. Should not happen
             // normally.
-            lcmsMutex->lock();
-            hTransform =
-                cmsCreateTransform(camprofile, TYPE_RGB_FLT, prophoto,
-                                   TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC,
-                                   cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            lcmsMutex->unlock();
+            hTransform = LCMSTransform::create(
+                camprofile, TYPE_RGB_FLT, prophoto, TYPE_RGB_FLT,
+                INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
         }
 
         TMatrix toxyz = {}, torgb = {};
@@ -4075,12 +4255,10 @@ void RawImageSource::colorSpaceConversion_(
                 }
 
                 // Run icc transform
-                cmsDoTransform(hTransform, buffer.data, buffer.data,
-                               im->getWidth());
+                hTransform(buffer.data, buffer.data, im->getWidth());
 
                 if (separate_pcs_lab_highlights) {
-                    cmsDoTransform(hTransform, hl_buffer.data, hl_buffer.data,
-                                   im->getWidth());
+                    hTransform(hl_buffer.data, hl_buffer.data, im->getWidth());
                 }
 
                 // Apply post-processing
@@ -4198,7 +4376,6 @@ void RawImageSource::colorSpaceConversion_(
                 }
             }
         } // End of parallelization
-        cmsDeleteTransform(hTransform);
     }
 
     // t3.set ();
@@ -4667,75 +4844,96 @@ void RawImageSource::getRAWHistogram(LUTu &histRedRaw, LUTu &histGreenRaw,
         return int(std::max((val - cblacksom[c]) * scale, 0.f));
     };
 
+    const RawStatistics *stats = getRawStatistics();
+
+    if (stats) {
+        // the histograms of the raw values are collected only once, here they
+        // are just shifted by the black levels in effect
+        const int nc = ri->getSensorType() == ST_BAYER ? 4
+                       : ri->get_colors() == 1         ? 1
+                                                       : 3;
+        for (int k = 0; k < nc; ++k) {
+            LUTu &h = hist[k == 3 ? 1 : k];
+            const uint32_t *inner = stats->inner(k);
+            const uint32_t *outer = stats->outer(k);
+            for (int v = 0; v < RawStatistics::NUM_BINS; ++v) {
+                const uint32_t n = inner[v] + outer[v];
+                if (n) {
+                    h[to_idx(stats->value(v), k)] += n;
+                }
+            }
+        }
+    } else {
 #ifdef _OPENMP
-    int numThreads;
-    // reduce the number of threads under certain conditions to avoid overhead
-    // of too many critical regions
-    numThreads = sqrt((((H - 2 * border) * (W - 2 * border)) / 262144.f));
-    numThreads = std::min(std::max(numThreads, 1), omp_get_num_procs());
+        int numThreads;
+        // reduce the number of threads under certain conditions to avoid
+        // overhead of too many critical regions
+        numThreads =
+            sqrt((((H - 2 * border) * (W - 2 * border)) / 262144.f));
+        numThreads = std::min(std::max(numThreads, 1), omp_get_num_procs());
 
 #pragma omp parallel num_threads(numThreads)
 #endif
-    {
-        // we need one LUT per color and thread, which corresponds to 1 MB per
-        // thread
-        LUTu tmphist[3];
-        tmphist[0](histsize[0]);
-        tmphist[0].clear();
+        {
+            // we need one LUT per color and thread, which corresponds to 1 MB
+            // per thread
+            LUTu tmphist[3];
+            tmphist[0](histsize[0]);
+            tmphist[0].clear();
 
-        if (ri->get_colors() > 1) {
-            tmphist[1](histsize[1]);
-            tmphist[1].clear();
-            tmphist[2](histsize[2]);
-            tmphist[2].clear();
-        }
+            if (ri->get_colors() > 1) {
+                tmphist[1](histsize[1]);
+                tmphist[1].clear();
+                tmphist[2](histsize[2]);
+                tmphist[2].clear();
+            }
 
 #ifdef _OPENMP
 #pragma omp for nowait
 #endif
 
-        for (int i = border; i < H - border; i++) {
-            int start, end;
-            getRowStartEnd(i, start, end);
+            for (int i = border; i < H - border; i++) {
+                int start, end;
+                getRowStartEnd(i, start, end);
 
-            if (ri->getSensorType() == ST_BAYER) {
-                for (int j = start; j < end; ++j) {
-                    int c = ri->FC(i, j);
-                    int c4 = (c == 1 && !(i & 1))
-                                 ? 3
-                                 : c; // four  colors,  0=R, 1=G1, 2=B, 3=G2
-                    tmphist[c][to_idx(ri->data[i][j], c4)]++;
-                }
-            } else if (ri->get_colors() == 1) {
-                for (int j = start; j < end; j++) {
-                    tmphist[0][to_idx(ri->data[i][j], 0)]++;
-                }
-            } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
-                for (int j = start; j < end; ++j) {
-                    int c = ri->XTRANSFC(i, j);
-                    tmphist[c][to_idx(ri->data[i][j], c)]++;
-                }
-            } else {
-                for (int j = start; j < end; j++) {
-                    for (int c = 0; c < 3; c++) {
-                        tmphist[c][to_idx(ri->data[i][3 * j + c], c)]++;
+                if (ri->getSensorType() == ST_BAYER) {
+                    for (int j = start; j < end; ++j) {
+                        int c = ri->FC(i, j);
+                        // four  colors,  0=R, 1=G1, 2=B, 3=G2
+                        int c4 = (c == 1 && !(i & 1)) ? 3 : c;
+                        tmphist[c][to_idx(ri->data[i][j], c4)]++;
+                    }
+                } else if (ri->get_colors() == 1) {
+                    for (int j = start; j < end; j++) {
+                        tmphist[0][to_idx(ri->data[i][j], 0)]++;
+                    }
+                } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
+                    for (int j = start; j < end; ++j) {
+                        int c = ri->XTRANSFC(i, j);
+                        tmphist[c][to_idx(ri->data[i][j], c)]++;
+                    }
+                } else {
+                    for (int j = start; j < end; j++) {
+                        for (int c = 0; c < 3; c++) {
+                            tmphist[c][to_idx(ri->data[i][3 * j + c], c)]++;
+                        }
                     }
                 }
             }
-        }
 
 #ifdef _OPENMP
 #pragma omp critical
 #endif
-        {
-            hist[0] += tmphist[0];
+            {
+                hist[0] += tmphist[0];
 
-            if (ri->get_colors() > 1) {
-                hist[1] += tmphist[1];
-                hist[2] += tmphist[2];
-            }
-        } // end of critical region
-    } // end of parallel region
+                if (ri->get_colors() > 1) {
+                    hist[1] += tmphist[1];
+                    hist[2] += tmphist[2];
+                }
+            } // end of critical region
+        } // end of parallel region
+    }
 
     histRedRaw = hist[0];
     histGreenRaw = hist[1];
@@ -4765,6 +4963,20 @@ void RawImageSource::getRowStartEnd(int x, int &start, int &end)
     }
 }
 
+const RawStatistics *RawImageSource::getRawStatistics()
+{
+    // float raw data (including HDR DNGs with values above 65535) can't be
+    // binned exactly, so it takes the full scans
+    if (!ri || fuji || ri->isFloat()) {
+        return nullptr;
+    }
+
+    if (!rawStats || rawStats->source() != ri) {
+        rawStats.reset(new RawStatistics(ri, border, AWB_MARGIN, true));
+    }
+    return rawStats.get();
+}
+
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 void RawImageSource::getAutoWBMultipliers(double &rm, double &gm, double &bm)
 {
@@ -4795,7 +5007,41 @@ void RawImageSource::getAutoWBMultipliers(double &rm, double &gm, double &bm)
     double avg_b = 0;
     int rn = 0, gn = 0, bn = 0;
 
-    if (fuji) {
+    const bool bayer = ri->getSensorType() == ST_BAYER;
+    const RawStatistics *stats =
+        rawDataIsScaledRaw && border <= AWB_MARGIN &&
+                (bayer || ri->getSensorType() == ST_FUJI_XTRANS)
+            ? getRawStatistics()
+            : nullptr;
+
+    if (stats) {
+        // each sample of rawData is max(0, raw - black) * scale_mul, so the
+        // sums of the unclipped ones can be computed from the histograms of
+        // the raw values, in increasing order until the clip level
+        const double compval = clipHigh / initialGain;
+        double sum[4] = {0.0};
+        int cnt[4] = {0};
+
+        for (int k = 0; k < (bayer ? 4 : 3); ++k) {
+            const uint32_t *inner = stats->inner(k);
+            for (int v = 0; v < RawStatistics::NUM_BINS; ++v) {
+                const float d =
+                    max(0.f, stats->value(v) - cblacksom[k]) * scale_mul[k];
+                if (d > compval) {
+                    break;
+                }
+                sum[k] += double(d) * inner[v];
+                cnt[k] += inner[v];
+            }
+        }
+
+        avg_r = sum[0] * initialGain;
+        avg_g = (sum[1] + sum[3]) * initialGain;
+        avg_b = sum[2] * initialGain;
+        rn = cnt[0];
+        gn = cnt[1] + cnt[3];
+        bn = cnt[2];
+    } else if (fuji) {
         for (int i = 32; i < H - 32; i++) {
             int fw = ri->get_FujiWidth();
             int start = ABS(fw - i) + 32;
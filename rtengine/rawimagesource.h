@@ -26,7 +26,9 @@
 #include "iimage.h"
 #include "imagesource.h"
 #include "pixelsmap.h"
+#include "rawstatistics.h"
 #include <iostream>
+#include <memory>
 #define HR_SCALE 2
 
 namespace rtengine {
@@ -75,6 +77,15 @@ protected:
     cmsHPROFILE camProfile;
     bool rgbSourceModified;
 
+    bool lazy_demosaic;
+    // binned RGB data, used by getImage for previews whose skip is a
+    // multiple of bin_factor (0 if not available). When bin_pending is set,
+    // the full resolution demosaic has not been done yet.
+    array2D<float> bin_red, bin_green, bin_blue;
+    int bin_factor;
+    bool bin_pending;
+    MyMutex lazyDemosaicMutex; // guards bin_factor and bin_pending
+
     RawImage *ri; // Copy of raw pixels, NOT corrected for initial gain,
                   // blackpoint etc.
     RawImage *riFrames[6] = {nullptr};
@@ -93,6 +104,13 @@ protected:
     // the interpolated blue plane:
     array2D<float> blue;
     bool rawDirty;
+    // histograms of the raw values of ri, see getRawStatistics()
+    std::unique_ptr<RawStatistics> rawStats;
+    // true if rawData is ri minus the black levels, times scale_mul, i.e.
+    // preprocess() ran none of the steps that change individual samples
+    // (dark frame, flat field, frame averaging, bad pixels, green
+    // equilibration, line and row noise filters, CA and vignetting)
+    bool rawDataIsScaledRaw;
     float psRedBrightness[4];
     float psGreenBrightness[4];
     float psBlueBrightness[4];
@@ -113,6 +131,7 @@ protected:
 
     unsigned FC(int row, int col) const { return ri->FC(row, col); }
     inline void getRowStartEnd(int x, int &start, int &end);
+    const RawStatistics *getRawStatistics();
     static void getProfilePreprocParams(cmsHPROFILE in, float &gammafac,
                                         float &lineFac, float &lineSum);
 
@@ -134,6 +153,7 @@ public:
     void flushRawData() override;
     void flushRGB() override;
     void HLRecovery_Global(const ExposureParams &hrp) override;
+    void setLazyDemosaic(bool yes) override { lazy_demosaic = yes; }
     void refinement(int PassCount);
     void setBorder(unsigned int rawBorder) override { border = rawBorder; }
     bool isRGBSourceModified() const override
@@ -148,6 +168,8 @@ public:
                             RawImage *riDark, RawImage *riFlatFile,
                             array2D<float> &rawData);
     void cfaboxblur(RawImage *riFlatFile, float *cfablur, int boxH, int boxW);
+    std::shared_ptr<const std::vector<float>>
+    getFlatFieldBlur(RawImage *riFlatFile, int boxH, int boxW);
     void scaleColors(int winx, int winy, int winw, int winh,
                      const RAWParams &raw,
                      array2D<float> &rawData); // raw for cblack
@@ -286,6 +308,10 @@ protected:
     void hphd_demosaic();
     void vng4_demosaic(const array2D<float> &rawData, array2D<float> &red,
                        array2D<float> &green, array2D<float> &blue);
+    void vng4_demosaic_blend(const float *const *blend,
+                             const array2D<float> &rawData,
+                             array2D<float> &red, array2D<float> &green,
+                             array2D<float> &blue);
     void ppg_demosaic();
     void jdl_interpolate_omp();
     void igv_interpolate(int winw, int winh);
@@ -306,6 +332,11 @@ protected:
     void dcb_demosaic(int iterations, bool dcb_enhance);
     void ahd_demosaic();
     void rcd_demosaic();
+    bool rcd_supported();
+    void bin_demosaic();
+    void demosaic_full();
+    void demosaic_finish();
+    void demosaic_discard();
     void border_interpolate(unsigned int border, float (*image)[4],
                             unsigned int start = 0, unsigned int end = 0);
     void border_interpolate2(int winw, int winh, int lborders,
@@ -0,0 +1,97 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rawstatistics.h"
+#include "rawimage.h"
+#include "rt_math.h"
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace rtengine {
+
+RawStatistics::RawStatistics(const RawImage *ri, int border, int margin,
+                             bool multithread)
+    : src_(ri), margin_(margin),
+      inner_(NUM_CHANNELS * NUM_BINS), outer_(NUM_CHANNELS * NUM_BINS)
+{
+    const int W = ri->get_width();
+    const int H = ri->get_height();
+    const bool bayer = ri->getSensorType() == ST_BAYER;
+    const bool xtrans = ri->getSensorType() == ST_FUJI_XTRANS;
+    const bool mono = ri->get_colors() == 1;
+
+    const auto bin = [](float val) -> int {
+        return LIM<int>(val, 0, NUM_BINS - 1);
+    };
+
+#ifdef _OPENMP
+    // every thread needs its own histograms (2 MB), so use fewer threads for
+    // smaller images
+    int numThreads =
+        std::sqrt(((H - 2 * border) * (W - 2 * border)) / 262144.f);
+    numThreads = std::min(std::max(numThreads, 1), omp_get_num_procs());
+
+#pragma omp parallel num_threads(numThreads) if (multithread)
+#endif
+    {
+        std::vector<uint32_t> inner(NUM_CHANNELS * NUM_BINS);
+        std::vector<uint32_t> outer(NUM_CHANNELS * NUM_BINS);
+
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+        for (int i = border; i < H - border; ++i) {
+            const float *row = ri->data[i];
+            const bool inner_row = i >= margin && i < H - margin;
+
+            for (int j = border; j < W - border; ++j) {
+                uint32_t *hist = inner_row && j >= margin && j < W - margin
+                                     ? inner.data()
+                                     : outer.data();
+                if (bayer) {
+                    const int c = ri->FC(i, j);
+                    const int c4 = (c == 1 && !(i & 1)) ? 3 : c;
+                    ++hist[c4 * NUM_BINS + bin(row[j])];
+                } else if (mono) {
+                    ++hist[bin(row[j])];
+                } else if (xtrans) {
+                    const int c = ri->XTRANSFC(i, j);
+                    ++hist[c * NUM_BINS + bin(row[j])];
+                } else {
+                    for (int c = 0; c < 3; ++c) {
+                        ++hist[c * NUM_BINS + bin(row[3 * j + c])];
+                    }
+                }
+            }
+        }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        {
+            for (size_t k = 0; k < inner_.size(); ++k) {
+                inner_[k] += inner[k];
+                outer_[k] += outer[k];
+            }
+        }
+    }
+}
+
+} // namespace rtengine
@@ -0,0 +1,70 @@
+/* -*- C++ -*-
+ *
+ *  This file is part of ART.
+ *
+ *  ART is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ART is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with ART.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include <cstdint>
+#include <vector>
+
+namespace rtengine {
+
+class RawImage;
+
+/**
+ * Per-channel histograms of the unprocessed raw values of an image, collected
+ * in a single pass, so that statistics that depend on the black and white
+ * levels or on the clip thresholds in effect (the raw histogram, the auto
+ * white balance) can be computed by walking the bins instead of the whole
+ * sensor. There is one bin per integer value, so only integer raw data is
+ * supported (float raw data would be truncated).
+ *
+ * The samples inside the rectangle at distance margin from the edges are
+ * counted separately from those of the frame between border and margin, as
+ * the auto white balance ignores the latter.
+ *
+ * Channels are 0=R, 1=G, 2=B, 3=G2 (the green on the even rows of a Bayer
+ * sensor) for Bayer and X-Trans sensors and for linear raw data, 0 for
+ * monochrome sensors. SuperCCD layouts are not supported.
+ */
+class RawStatistics: public NonCopyable {
+public:
+    static constexpr int NUM_BINS = 65536;
+    static constexpr int NUM_CHANNELS = 4;
+
+    RawStatistics(const RawImage *ri, int border, int margin, bool multithread);
+
+    const RawImage *source() const { return src_; }
+    int margin() const { return margin_; }
+
+    /** raw value corresponding to the given bin */
+    float value(int bin) const { return bin; }
+
+    /** counts of the samples inside the margin */
+    const uint32_t *inner(int c) const { return &inner_[c * NUM_BINS]; }
+    /** counts of the samples between the border and the margin */
+    const uint32_t *outer(int c) const { return &outer_[c * NUM_BINS]; }
+
+private:
+    const RawImage *src_;
+    int margin_;
+    std::vector<uint32_t> inner_;
+    std::vector<uint32_t> outer_;
+};
+
+} // namespace rtengine
@@ -17,6 +17,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cmath>
 
 #include "../rtgui/multilangmgr.h"
@@ -54,18 +55,13 @@ void RawImageSource::rcd_demosaic()
     constexpr size_t chunkSize = 2;
     constexpr bool measure = false;
 
-    // Test for RGB cfa
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) {
-            if (FC(i, j) == 3) {
-                // avoid crash
-                std::cout << "rcd_demosaic supports only RGB Colour filter "
-                             "arrays. Falling back to igv_interpolate"
-                          << std::endl;
-                igv_interpolate(W, H);
-                return;
-            }
-        }
+    if (!rcd_supported()) {
+        // avoid crash
+        std::cout << "rcd_demosaic supports only RGB Colour filter "
+                     "arrays. Falling back to igv_interpolate"
+                  << std::endl;
+        igv_interpolate(W, H);
+        return;
     }
 
     std::unique_ptr<StopWatch> stop;
@@ -135,6 +131,16 @@ void RawImageSource::rcd_demosaic()
                 const int tileRows = std::min(rowEnd - rowStart, tileSize);
                 const int tilecols = std::min(colEnd - colStart, tileSize);
 
+                if (tileRows < tileSize || tilecols < tileSize) {
+                    // the refinement steps read the direction maps one row
+                    // and one column past the computed area: in the smaller
+                    // tiles at the bottom and right edges that area would
+                    // still hold the data of the tile previously processed
+                    // by this thread, making the result depend on the
+                    // processing order
+                    std::fill(VH_Dir, VH_Dir + tileSize * tileSize, 0.f);
+                }
+
                 for (int row = rowStart; row < rowEnd; row++) {
                     const int c0 = fc(cfarray, row, colStart);
                     const int c1 = fc(cfarray, row, colStart + 1);
@@ -517,4 +523,17 @@ void RawImageSource::rcd_demosaic()
     }
 }
 
+bool RawImageSource::rcd_supported()
+{
+    // Test for RGB cfa
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            if (FC(i, j) == 3) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 } // namespace rtengine
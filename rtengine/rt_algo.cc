@@ -912,6 +912,170 @@ struct ConvolutionData {
     }
 };
 
+
+// kernels up to this size are applied directly by TiledConvolution
+constexpr int TILED_CONV_DIRECT_MAX = 9;
+constexpr int TILED_CONV_MIN_TILE = 256;
+
+struct TiledConvolutionData {
+    array2D<float> kernel;
+    int K;
+    int pT;
+    fftwf_complex *kernel_fft;
+    fftwf_plan fwd_plan;
+    fftwf_plan inv_plan;
+
+    explicit TiledConvolutionData(const array2D<float> &k);
+    ~TiledConvolutionData();
+
+    void direct(float **src, float **dst, int W, int H, bool multithread);
+    void tiled(float **src, float **dst, int W, int H, bool multithread);
+};
+
+
+TiledConvolutionData::TiledConvolutionData(const array2D<float> &k)
+    : K(k.width()), pT(0), kernel_fft(nullptr), fwd_plan(nullptr),
+      inv_plan(nullptr)
+{
+    assert(K == k.height() && (K & 1));
+
+    kernel(K, K);
+    for (int y = 0; y < K; ++y) {
+        for (int x = 0; x < K; ++x) {
+            kernel[y][x] = k[y][x];
+        }
+    }
+
+    if (K > TILED_CONV_DIRECT_MAX) {
+        pT = find_fast_fftw_dim(std::max(TILED_CONV_MIN_TILE, 4 * K));
+
+        float *buf = static_cast<float *>(fftwf_malloc(sizeof(float) * pT * pT));
+        fftwf_complex *buf_fft = fftwf_alloc_complex(pT * (pT / 2 + 1));
+
+        MyMutex::MyLock lock(*fftwMutex);
+#ifdef RT_FFTW3F_OMP
+        // the parallelism is over the tiles
+        fftwf_plan_with_nthreads(1);
+#endif
+        kernel_fft = prepare_kernel(kernel, buf, pT, pT, false);
+        fwd_plan = fftwf_plan_dft_r2c_2d(pT, pT, buf, buf_fft, FFTW_ESTIMATE);
+        inv_plan = fftwf_plan_dft_c2r_2d(pT, pT, buf_fft, buf, FFTW_ESTIMATE);
+
+        fftwf_free(buf_fft);
+        fftwf_free(buf);
+    }
+}
+
+
+TiledConvolutionData::~TiledConvolutionData()
+{
+    if (kernel_fft) {
+        MyMutex::MyLock lock(*fftwMutex);
+        fftwf_destroy_plan(inv_plan);
+        fftwf_destroy_plan(fwd_plan);
+        fftwf_free(kernel_fft);
+    }
+}
+
+
+void TiledConvolutionData::direct(float **src, float **dst, int W, int H,
+                                  bool multithread)
+{
+    const int r = K / 2;
+
+#ifdef _OPENMP
+#pragma omp parallel if (multithread)
+#endif
+    {
+        std::vector<float> acc(W);
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int y = 0; y < H; ++y) {
+            std::fill(acc.begin(), acc.end(), 0.f);
+            for (int ky = 0; ky < K; ++ky) {
+                const float *row = src[LIM(y + r - ky, 0, H - 1)];
+                for (int kx = 0; kx < K; ++kx) {
+                    const float w = kernel[ky][kx];
+                    const int dx = r - kx;
+                    const int start = LIM(-dx, 0, W);
+                    const int end = LIM(W - dx, start, W);
+                    for (int x = 0; x < start; ++x) {
+                        acc[x] += w * row[0];
+                    }
+                    for (int x = start; x < end; ++x) {
+                        acc[x] += w * row[x + dx];
+                    }
+                    for (int x = end; x < W; ++x) {
+                        acc[x] += w * row[W - 1];
+                    }
+                }
+            }
+            std::copy(acc.begin(), acc.end(), dst[y]);
+        }
+    }
+}
+
+
+void TiledConvolutionData::tiled(float **src, float **dst, int W, int H,
+                                 bool multithread)
+{
+    const int r = K / 2;
+    const int T = pT - 2 * r;
+    const int tiles_x = (W + T - 1) / T;
+    const int tiles_y = (H + T - 1) / T;
+    const int cW = pT / 2 + 1;
+    const float norm = float(pT) * float(pT);
+
+#ifdef _OPENMP
+#pragma omp parallel if (multithread)
+#endif
+    {
+        float *buf = static_cast<float *>(fftwf_malloc(sizeof(float) * pT * pT));
+        fftwf_complex *buf_fft = fftwf_alloc_complex(pT * cW);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (int t = 0; t < tiles_x * tiles_y; ++t) {
+            const int ty = (t / tiles_x) * T;
+            const int tx = (t % tiles_x) * T;
+
+            for (int y = 0; y < pT; ++y) {
+                const float *row = src[LIM(ty - r + y, 0, H - 1)];
+                for (int x = 0; x < pT; ++x) {
+                    buf[y * pT + x] = row[LIM(tx - r + x, 0, W - 1)];
+                }
+            }
+
+            // new-array execution is thread-safe, no need for fftwMutex
+            fftwf_execute_dft_r2c(fwd_plan, buf, buf_fft);
+
+            for (int i = 0; i < pT * cW; ++i) {
+                float p = buf_fft[i][0], q = buf_fft[i][1];
+                float a = kernel_fft[i][0], b = kernel_fft[i][1];
+                buf_fft[i][0] = p * a - q * b;
+                buf_fft[i][1] = p * b + q * a;
+            }
+
+            fftwf_execute_dft_c2r(inv_plan, buf_fft, buf);
+
+            const int th = std::min(T, H - ty);
+            const int tw = std::min(T, W - tx);
+            for (int y = 0; y < th; ++y) {
+                const float *row = buf + (y + 2 * r) * pT + 2 * r;
+                for (int x = 0; x < tw; ++x) {
+                    dst[ty + y][tx + x] = row[x] / norm;
+                }
+            }
+        }
+
+        fftwf_free(buf_fft);
+        fftwf_free(buf);
+    }
+}
+
 } // namespace
 
 
@@ -974,6 +1138,47 @@ void Convolution::operator()(const array2D<float> &src, array2D<float> &dst)
                static_cast<float **>(dst));
 }
 
+TiledConvolution::TiledConvolution(const array2D<float> &kernel)
+    : data_(new TiledConvolutionData(kernel))
+{
+}
+
+TiledConvolution::~TiledConvolution()
+{
+    delete static_cast<TiledConvolutionData *>(data_);
+}
+
+void TiledConvolution::operator()(float **src, float **dst, int W, int H,
+                                  bool multithread)
+{
+    assert(src != dst);
+    TiledConvolutionData *d = static_cast<TiledConvolutionData *>(data_);
+    if (d->kernel_fft) {
+        d->tiled(src, dst, W, H, multithread);
+    } else {
+        d->direct(src, dst, W, H, multithread);
+    }
+}
+
+void TiledConvolution::operator()(const array2D<float> &src,
+                                  array2D<float> &dst, bool multithread)
+{
+    operator()(static_cast<float **>(const_cast<array2D<float> &>(src)),
+               static_cast<float **>(dst), src.width(), src.height(),
+               multithread);
+}
+
+std::size_t TiledConvolution::getMemoryUsage() const
+{
+    const TiledConvolutionData *d =
+        static_cast<const TiledConvolutionData *>(data_);
+    std::size_t ret = std::size_t(d->K) * d->K * sizeof(float);
+    if (d->kernel_fft) {
+        ret += std::size_t(d->pT) * (d->pT / 2 + 1) * sizeof(fftwf_complex);
+    }
+    return ret;
+}
+
 void build_gaussian_kernel(float sigma, array2D<float> &res)
 {
     static constexpr float threshold = 0.005f;
@@ -62,6 +62,30 @@ private:
     void *data_;
 };
 
+/**
+ * Convolution with clamped borders, like Convolution, but independent of the
+ * image size. Small kernels are applied directly in the spatial domain;
+ * larger ones use overlap-save on fixed-size FFT tiles, so that the kernel
+ * spectrum can be computed once and reused for images of any size, and tiles
+ * can be processed in parallel without holding the global FFTW lock.
+ * src and dst must not alias.
+ */
+class TiledConvolution {
+public:
+    explicit TiledConvolution(const array2D<float> &kernel);
+    ~TiledConvolution();
+
+    void operator()(float **src, float **dst, int W, int H, bool multithread);
+    void operator()(const array2D<float> &src, array2D<float> &dst,
+                    bool multithread);
+
+    /** size of the kernel and of its spectrum, in bytes */
+    std::size_t getMemoryUsage() const;
+
+private:
+    void *data_;
+};
+
 void get_luminance(const Imagefloat *src, array2D<float> &out,
                    const float ws[3][3], bool multithread);
 
@@ -667,6 +667,18 @@ public:
     virtual ProcessingJob *imageReady(IImagefloat *img) = 0;
 
     virtual const procparams::PartialProfile *getBatchProfile() = 0;
+
+    /** Called from the batch processing thread while the current job is
+     * running, to find out which image is likely to be processed next, so
+     * that it can be decoded in advance. The default implementation disables
+     * prefetching.
+     * @param fname is set to the file name of the next image
+     * @param isRaw is set to true if the next image is a raw file
+     * @return true if there is a next image */
+    virtual bool getNextJobSource(Glib::ustring &fname, bool &isRaw)
+    {
+        return false;
+    }
 };
 /** This function performs all the image processing steps corresponding to the
  *given ProcessingJob. It runs in the background, thus it returns immediately,
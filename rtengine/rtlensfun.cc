@@ -21,6 +21,7 @@
 #include "rtlensfun.h"
 #include "settings.h"
 #include <iostream>
+#include <sstream>
 
 #if LF_VERSION < ((3 << 16) | (99 << 8))
 #define ART_LENSFUN_LEGACY
@@ -299,35 +300,63 @@ bool LFLens::hasCACorrection() const
 
 LFDatabase LFDatabase::instance_;
 
-bool LFDatabase::init(const Glib::ustring &dbdir)
+bool LFDatabase::init(const std::vector<Glib::ustring> &dbdirs, bool lazy)
 {
+    instance_.dbdirs_ = dbdirs;
+    instance_.loaded_ = false;
+
+    if (lazy) {
+        return true;
+    }
+
+    MyMutex::MyLock lock(instance_.lfDBMutex);
+    return instance_.load();
+}
+
+bool LFDatabase::load()
+{
+    bool ok = false;
+
+    for (const auto &dbdir : dbdirs_) {
+        if (data_) {
 #ifdef ART_LENSFUN_LEGACY
-    instance_.data_ = lfDatabase::Create();
+            data_->Destroy();
 #else
-    instance_.data_ = new lfDatabase();
+            delete data_;
+#endif // ART_LENSFUN_LEGACY
+        }
+#ifdef ART_LENSFUN_LEGACY
+        data_ = lfDatabase::Create();
+#else
+        data_ = new lfDatabase();
 #endif // ART_LENSFUN_LEGACY
 
-    if (settings->verbose) {
-        std::cout << "Loading lensfun database from ";
+        if (settings->verbose) {
+            std::cout << "Loading lensfun database from ";
+            if (dbdir.empty()) {
+                std::cout << "the default directories";
+            } else {
+                std::cout << "'" << dbdir << "'";
+            }
+            std::cout << "..." << std::flush;
+        }
+
         if (dbdir.empty()) {
-            std::cout << "the default directories";
+            ok = (data_->Load() == LF_NO_ERROR);
         } else {
-            std::cout << "'" << dbdir << "'";
+            ok = LoadDirectory(dbdir.c_str());
         }
-        std::cout << "..." << std::flush;
-    }
 
-    bool ok = false;
-    if (dbdir.empty()) {
-        ok = (instance_.data_->Load() == LF_NO_ERROR);
-    } else {
-        ok = instance_.LoadDirectory(dbdir.c_str());
-    }
+        if (settings->verbose) {
+            std::cout << (ok ? "OK" : "FAIL") << std::endl;
+        }
 
-    if (settings->verbose) {
-        std::cout << (ok ? "OK" : "FAIL") << std::endl;
+        if (ok) {
+            break;
+        }
     }
 
+    loaded_ = true;
     return ok;
 }
 
@@ -363,7 +392,7 @@ bool LFDatabase::LoadDirectory(const char *dirname)
 #endif
 }
 
-LFDatabase::LFDatabase(): data_(nullptr) {}
+LFDatabase::LFDatabase(): data_(nullptr), loaded_(true) {}
 
 LFDatabase::~LFDatabase()
 {
@@ -377,7 +406,16 @@ LFDatabase::~LFDatabase()
     }
 }
 
-const LFDatabase *LFDatabase::getInstance() { return &instance_; }
+const LFDatabase *LFDatabase::getInstance()
+{
+    if (!instance_.loaded_) {
+        MyMutex::MyLock lock(instance_.lfDBMutex);
+        if (!instance_.loaded_) {
+            instance_.load();
+        }
+    }
+    return &instance_;
+}
 
 std::vector<LFCamera> LFDatabase::getCameras() const
 {
@@ -495,6 +533,15 @@ LFDatabase::getModifier(const LFCamera &camera, const LFLens &lens,
             flags = mod->GetModFlags();
 #endif // ART_LENSFUN_LEGACY
             ret.reset(new LFModifier(mod, swap_xy, flags));
+
+            std::ostringstream key;
+            key << "lensfun/" << camera.getMake().raw() << "/"
+                << camera.getModel().raw() << "/" << lens.getMake().raw()
+                << "/" << lens.getLens().raw() << "/"
+                << camera.getCropFactor() << "/" << focalLen << "/"
+                << aperture << "/" << focusDist << "/" << width << "x"
+                << height << "/" << swap_xy << "/" << flags;
+            ret->key_ = key.str();
         }
     }
     return ret;
@@ -20,8 +20,10 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <glibmm.h>
@@ -48,6 +50,7 @@ public:
     void processVignette(int width, int height, float **rawData) const override;
     void processVignette3Channels(int width, int height,
                                   float **rawData) const override;
+    std::string getCacheKey() const override { return key_; }
 
     Glib::ustring getDisplayString() const;
 
@@ -58,6 +61,7 @@ private:
     lfModifier *data_;
     bool swap_xy_;
     int flags_;
+    std::string key_;
 };
 
 class LFCamera final {
@@ -99,7 +103,12 @@ private:
 
 class LFDatabase final: public NonCopyable {
 public:
-    static bool init(const Glib::ustring &dbdir);
+    /**
+     * Loads the database from the first of dbdirs that works (an empty
+     * string stands for the default lensfun locations). If lazy is true, the
+     * loading is deferred until the database is first used.
+     */
+    static bool init(const std::vector<Glib::ustring> &dbdirs, bool lazy);
     static const LFDatabase *getInstance();
 
     ~LFDatabase();
@@ -123,10 +132,13 @@ private:
                                             bool swap_xy) const;
     LFDatabase();
     bool LoadDirectory(const char *dirname);
+    bool load();
 
     mutable MyMutex lfDBMutex;
     static LFDatabase instance_;
     lfDatabase *data_;
+    std::vector<Glib::ustring> dbdirs_;
+    std::atomic<bool> loaded_;
     mutable std::set<std::string> notFound;
 };
 
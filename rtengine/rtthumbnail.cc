@@ -1182,7 +1182,7 @@ IImage8 *Thumbnail::processImage(const procparams::ProcParams &params,
 
     myscale = 1.0 / myscale;
 
-    ipf.setMonitorTransform(nullptr);
+    ipf.setMonitorTransform(LCMSTransform());
 
     return readyImg;
 }
@@ -96,6 +96,12 @@ public:
     static ColorManagementMode color_mgmt_mode;
 
     int imgio_raw_cache_size;
+
+    bool batch_queue_prefetch;
+    bool fattal_multigrid;
+    int pipeline_checkpoints_budget; // in MB, 0 = disabled
+    bool lens_exact_apply; // no sampled grids for the lens corrections
+    bool proofing_exact_apply; // no device link tables for soft-proofing
 };
 
 } // namespace rtengine
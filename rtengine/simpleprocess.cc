@@ -31,6 +31,7 @@
 #include "rescale.h"
 #include "rtengine.h"
 #include "threadpool.h"
+#include <future>
 #include <glibmm.h>
 
 #undef THREAD_PRIORITY_NORMAL
@@ -620,10 +621,92 @@ IImagefloat *processImage(ProcessingJob *pjob, int &errorCode,
     return proc();
 }
 
+namespace {
+
+/**
+ * Decodes the image of the next job of the queue in the background while the
+ * current one is being processed and saved. At most one image is kept in
+ * flight, so the extra memory is bounded by a single decoded raw.
+ */
+class BatchPrefetcher {
+public:
+    ~BatchPrefetcher() { discard(); }
+
+    void start(BatchProcessingListener *bpl)
+    {
+        if (!settings->batch_queue_prefetch || pending_.valid()) {
+            return;
+        }
+
+        if (!bpl->getNextJobSource(fname_, isRaw_)) {
+            return;
+        }
+
+        const Glib::ustring fname = fname_;
+        const bool isRaw = isRaw_;
+        // use a dedicated thread rather than the ThreadPool: we block on the
+        // result from a pool worker, and the pool can have a single worker
+        pending_ = std::async(std::launch::async, [fname, isRaw]() {
+            MyTime t1, t2;
+            t1.set();
+            int err = 0;
+            InitialImage *ii = InitialImage::load(fname, isRaw, &err);
+            t2.set();
+            if (settings->verbose) {
+                std::cout << "Batch queue: prefetched " << fname << " in "
+                          << t2.etime(t1) / 1000 << " ms" << std::endl;
+            }
+            return err ? nullptr : ii;
+        });
+    }
+
+    /** Hands the prefetched image over to job if it is the one that was
+     * prefetched, otherwise drops it. Returns true on a hit. */
+    bool attach(ProcessingJob *pjob)
+    {
+        if (!pending_.valid()) {
+            return false;
+        }
+
+        ProcessingJobImpl *job = static_cast<ProcessingJobImpl *>(pjob);
+        if (job && !job->initialImage && job->fname == fname_ &&
+            job->isRaw == isRaw_) {
+            InitialImage *ii = pending_.get();
+            if (ii) {
+                // the job takes over the reference returned by load()
+                job->initialImage = ii;
+                return true;
+            }
+            return false;
+        }
+
+        discard();
+        return false;
+    }
+
+    void discard()
+    {
+        if (pending_.valid()) {
+            InitialImage *ii = pending_.get();
+            if (ii) {
+                ii->decreaseRef();
+            }
+        }
+    }
+
+private:
+    std::future<InitialImage *> pending_;
+    Glib::ustring fname_;
+    bool isRaw_;
+};
+
+} // namespace
+
 void batchProcessingThread(ProcessingJob *job, BatchProcessingListener *bpl)
 {
 
     ProcessingJob *currentJob = job;
+    BatchPrefetcher prefetcher;
 
     while (currentJob) {
         auto p = bpl->getBatchProfile();
@@ -632,9 +715,17 @@ void batchProcessingThread(ProcessingJob *job, BatchProcessingListener *bpl)
             p->applyTo(static_cast<ProcessingJobImpl *>(currentJob)->pparams);
         }
 
+        // decode the next image while this one is processed and saved
+        prefetcher.start(bpl);
+
+        MyTime t1, t2, t3;
+        t1.set();
+
         int errorCode;
         IImagefloat *img = processImage(currentJob, errorCode, bpl, true);
 
+        t2.set();
+
         if (errorCode) {
             bpl->error(M("MAIN_MSG_CANNOTLOAD"));
             currentJob = nullptr;
@@ -646,6 +737,16 @@ void batchProcessingThread(ProcessingJob *job, BatchProcessingListener *bpl)
                 currentJob = nullptr;
             }
         }
+
+        t3.set();
+
+        const bool hit = prefetcher.attach(currentJob);
+
+        if (settings->verbose) {
+            std::cout << "Batch queue: processed in " << t2.etime(t1) / 1000
+                      << " ms, saved in " << t3.etime(t2) / 1000 << " ms"
+                      << (hit ? ", next image prefetched" : "") << std::endl;
+        }
     }
 }
 
@@ -23,6 +23,7 @@
 #include "iccstore.h"
 #include "imageio.h"
 #include "imgiomanager.h"
+#include "lcmstransform.h"
 #include "mytime.h"
 #ifdef _OPENMP
 #include <omp.h>
@@ -457,14 +458,13 @@ void StdImageSource::colorSpaceConversion(
 
         lcmsMutex->lock();
         ARTInputProfile artprof(in, cmp);
-        cmsHTRANSFORM hTransform = nullptr;
+        lcmsMutex->unlock();
+        LCMSTransform hTransform;
         if (!artprof) {
-            hTransform =
-                cmsCreateTransform(in, TYPE_RGB_FLT, out, TYPE_RGB_FLT,
-                                   INTENT_RELATIVE_COLORIMETRIC,
-                                   cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
+            hTransform = LCMSTransform::create(
+                in, TYPE_RGB_FLT_PLANAR, out, TYPE_RGB_FLT_PLANAR,
+                INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
         }
-        lcmsMutex->unlock();
 
         if (artprof) {
             if (settings->verbose) {
@@ -476,12 +476,10 @@ void StdImageSource::colorSpaceConversion(
             // Convert to the [0.0 ; 1.0] range
             im->normalizeFloatTo1();
 
-            im->ExecCMSTransform(hTransform, multithread);
+            hTransform.apply(im, multithread);
 
             // Converting back to the [0.0 ; 65535.0] range
             im->normalizeFloatTo65535();
-
-            cmsDeleteTransform(hTransform);
         } else {
             printf("Could not convert from %s to %s\n",
                    in == embedded ? "embedded profile"
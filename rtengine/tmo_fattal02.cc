@@ -54,6 +54,7 @@
 #include <omp.h>
 #endif
 #include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <iostream>
 #include <iterator>
@@ -129,7 +130,7 @@ void rescale_bilinear(const Array2Df &src, Array2Df &dst, bool multithread);
  * Luminance HDR code (modifications are marked with an RT comment)
  ******************************************************************************/
 
-void downSample(const Array2Df &A, Array2Df &B)
+void downSample(const Array2Df &A, Array2Df &B, bool multithread)
 {
     const int width = B.getCols();
     const int height = B.getRows();
@@ -138,7 +139,10 @@ void downSample(const Array2Df &A, Array2Df &B)
     // applied to too small problems and in total don't lead to noticeable
     // speed improvements. The main issue is the pde solver and in case of the
     // fft solver uses optimised threaded fftw routines.
-    // #pragma omp parallel for
+    // RT - the first levels are full size, so this is worth it here
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread)
+#endif
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
             float p = A(2 * x, 2 * y);
@@ -237,7 +241,7 @@ void createGaussianPyramids(Array2Df **pyramids, int nlevels, bool multithread)
             width /= 2;
             height /= 2;
             pyramids[k] = new Array2Df(width, height);
-            downSample(*L, *pyramids[k]);
+            downSample(*L, *pyramids[k], multithread);
         } else {
             // RT - now nlevels is fixed in tmo_fattal02 (see the comment in
             // there), so it might happen that we have to add some padding to
@@ -399,10 +403,11 @@ void calculateFiMatrix(Array2Df *FI, Array2Df *gradients[], float avgGrad[],
 }
 
 void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread);
+void solve_pde_multigrid(Array2Df *F, Array2Df *U, bool multithread);
 
 void tmo_fattal02(size_t width, size_t height, const Array2Df &Y, Array2Df &L,
                   float alfa, float beta, float noise, int detail_level,
-                  bool multithread)
+                  bool multigrid, bool multithread)
 {
     // #ifdef TIMER_PROFILING
     //     msec_timer stop_watch;
@@ -577,12 +582,16 @@ void tmo_fattal02(size_t width, size_t height, const Array2Df &Y, Array2Df &L,
 #endif
 
     for (size_t y = 0; y < height; y++) {
-        // sets index+1 based on the boundary assumption H(N+1)=H(N-1)
-        unsigned int yp1 = (y + 1 >= height ? height - 2 : y + 1);
+        // sets index+1 based on the boundary assumption H(N+1)=H(N-1) for
+        // the fft solver, H(N+1)=H(N) for the multigrid one
+        unsigned int yp1 =
+            (y + 1 >= height ? height - (multigrid ? 1 : 2) : y + 1);
 
         for (size_t x = 0; x < width; x++) {
             // sets index+1 based on the boundary assumption H(N+1)=H(N-1)
-            unsigned int xp1 = (x + 1 >= width ? width - 2 : x + 1);
+            // (fft) or H(N+1)=H(N) (multigrid)
+            unsigned int xp1 =
+                (x + 1 >= width ? width - (multigrid ? 1 : 2) : x + 1);
             // forward differences in H, so need to use between-points approx of
             // FI
             (*Gx)(x, y) = ((*H)(xp1, y) - (*H)(x, y)) * 0.5 *
@@ -611,24 +620,29 @@ void tmo_fattal02(size_t width, size_t height, const Array2Df &Y, Array2Df &L,
                 (*FI)(x, y) -= (*Gy)(x, y - 1);
             }
 
-            if (x == 0) {
-                (*FI)(x, y) += (*Gx)(x, y);
-            }
+            if (!multigrid) {
+                if (x == 0) {
+                    (*FI)(x, y) += (*Gx)(x, y);
+                }
 
-            if (y == 0) {
-                (*FI)(x, y) += (*Gy)(x, y);
+                if (y == 0) {
+                    (*FI)(x, y) += (*Gy)(x, y);
+                }
             }
         }
     }
 
-    // delete Gx; // RT - reused as temp buffer in solve_pde_fft, deleted later
+    // RT - Gx is reused as temp buffer in solve_pde_fft, deleted later
 
     // solve pde and exponentiate (ie recover compressed image)
-    {
+    if (multigrid) {
+        delete Gx;
+        solve_pde_multigrid(FI, &L, multithread);
+    } else {
         MyMutex::MyLock lock(*fftwMutex);
         solve_pde_fft(FI, &L, Gx, multithread);
+        delete Gx;
     }
-    delete Gx;
     delete FI;
 
 #ifdef _OPENMP
@@ -975,6 +989,352 @@ void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf,
  * RT code from here on
  *****************************************************************************/
 
+/*
+ * Multigrid solver for the Poisson pde with zero Neumann boundary conditions,
+ * U(-1)=U(0), ie for the system assembled by tmo_fattal02() when multigrid is
+ * true. Unlike solve_pde_fft() it is fully parallel without needing to hold
+ * fftwMutex, and it only needs about 2/3 of an image worth of extra memory
+ * for the coarse levels. It works at any size, but it converges faster when
+ * the dimensions stay even for most of the levels. It is a full multigrid
+ * scheme (the initial guess at each level is the interpolated solution of the
+ * coarser one) with V-cycles and red-black Gauss-Seidel smoothing on a
+ * cell-centered grid hierarchy. Its solution is close to, but not the same as,
+ * the one of solve_pde_fft(), so it is opt-in
+ * (Performance/FattalMultigridSolver) to keep the rendering of existing edits
+ * unchanged.
+ */
+namespace pde_multigrid {
+
+constexpr int PRE_SMOOTH = 2;
+constexpr int POST_SMOOTH = 2;
+constexpr int CYCLES = 3;
+constexpr int COARSEST_SIZE = 8;
+constexpr int MT_MIN_SIZE = 128 * 128;
+
+struct Level {
+    int W;
+    int H;
+    float *u; // solution
+    float *f; // right hand side
+    std::vector<float> ubuf;
+    std::vector<float> fbuf;
+};
+
+
+// sum of the neighbours of u(x,y) that are inside the grid (the missing ones
+// are the mirrored u(x,y) and cancel out in the Neumann stencil); n is set to
+// their number
+inline float neighbours(const float *row, const float *up, const float *down,
+                        int x, int W, int &n)
+{
+    float s = 0.f;
+    n = 0;
+    if (x > 0) {
+        s += row[x - 1];
+        ++n;
+    }
+    if (x < W - 1) {
+        s += row[x + 1];
+        ++n;
+    }
+    if (up) {
+        s += up[x];
+        ++n;
+    }
+    if (down) {
+        s += down[x];
+        ++n;
+    }
+    return s;
+}
+
+
+void smooth(Level &l, int iterations, bool multithread)
+{
+    const int W = l.W;
+    const int H = l.H;
+
+    const auto update =
+        [W](float *row, const float *up, const float *down, float f, int x) {
+            int n;
+            const float s = neighbours(row, up, down, x, W, n);
+            if (n) {
+                row[x] = (s - f) / n;
+            }
+        };
+
+    for (int i = 0; i < iterations; ++i) {
+        for (int color = 0; color < 2; ++color) {
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread && W * H >= MT_MIN_SIZE)
+#endif
+            for (int y = 0; y < H; ++y) {
+                float *row = l.u + size_t(y) * W;
+                const float *up = y > 0 ? row - W : nullptr;
+                const float *down = y < H - 1 ? row + W : nullptr;
+                const float *f = l.f + size_t(y) * W;
+                int x = (y + color) & 1;
+                if (up && down) {
+                    if (x == 0) {
+                        update(row, up, down, f[0], 0);
+                        x = 2;
+                    }
+                    for (; x < W - 1; x += 2) {
+                        row[x] = (row[x - 1] + row[x + 1] + up[x] + down[x] -
+                                  f[x]) *
+                                 0.25f;
+                    }
+                    if (x == W - 1) {
+                        update(row, up, down, f[x], x);
+                    }
+                } else {
+                    for (; x < W; x += 2) {
+                        update(row, up, down, f[x], x);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+// r = f - A u for row y
+void residual_row(const Level &l, int y, float *r)
+{
+    const int W = l.W;
+    const float *row = l.u + size_t(y) * W;
+    const float *up = y > 0 ? row - W : nullptr;
+    const float *down = y < l.H - 1 ? row + W : nullptr;
+    const float *f = l.f + size_t(y) * W;
+
+    const auto generic = [&](int x) {
+        int n;
+        const float s = neighbours(row, up, down, x, W, n);
+        r[x] = f[x] - (s - n * row[x]);
+    };
+
+    if (up && down && W > 2) {
+        generic(0);
+        for (int x = 1; x < W - 1; ++x) {
+            r[x] = f[x] - (row[x - 1] + row[x + 1] + up[x] + down[x] -
+                           4.f * row[x]);
+        }
+        generic(W - 1);
+    } else {
+        for (int x = 0; x < W; ++x) {
+            generic(x);
+        }
+    }
+}
+
+
+// coarse.f = restriction of the residual of fine (or of fine.f if
+// use_residual is false). The 2x2 blocks are summed, not averaged, because
+// the stencil is not scaled by the grid spacing; this also keeps the sum of
+// the right hand side (which must be zero for the system to be solvable)
+// exactly the same for blocks that are cut by the border
+void restrict_residual(const Level &fine, Level &coarse, bool use_residual,
+                       bool multithread)
+{
+    const int W = fine.W;
+    const int H = fine.H;
+
+#ifdef _OPENMP
+#pragma omp parallel if (multithread && W * H >= MT_MIN_SIZE)
+#endif
+    {
+        std::vector<float> buf(use_residual ? 2 * W : 0);
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int y = 0; y < coarse.H; ++y) {
+            const int y0 = 2 * y;
+            const int y1 = std::min(y0 + 1, H - 1);
+            const float *r0, *r1;
+            if (use_residual) {
+                residual_row(fine, y0, &buf[0]);
+                if (y1 != y0) {
+                    residual_row(fine, y1, &buf[W]);
+                }
+                r0 = &buf[0];
+                r1 = y1 != y0 ? &buf[W] : nullptr;
+            } else {
+                r0 = fine.f + size_t(y0) * W;
+                r1 = y1 != y0 ? fine.f + size_t(y1) * W : nullptr;
+            }
+            float *dst = coarse.f + size_t(y) * coarse.W;
+            for (int x = 0; x < coarse.W; ++x) {
+                const int x0 = 2 * x;
+                float s = r0[x0];
+                if (r1) {
+                    s += r1[x0];
+                }
+                if (x0 + 1 < W) {
+                    s += r0[x0 + 1];
+                    if (r1) {
+                        s += r1[x0 + 1];
+                    }
+                }
+                dst[x] = s;
+            }
+        }
+    }
+}
+
+
+// bilinear interpolation of coarse.u into fine.u (added to it if add is true)
+void prolongate(const Level &coarse, Level &fine, bool add, bool multithread)
+{
+    const int W = fine.W;
+    const int H = fine.H;
+    const int cW = coarse.W;
+    const int cH = coarse.H;
+
+    const auto coords = [](int i, int cn, int &i0, int &i1, float &w) {
+        // fine cell i has its center at coarse coordinate i/2 - 1/4
+        const float c = i * 0.5f - 0.25f;
+        i0 = LIM(int(std::floor(c)), 0, cn - 1);
+        i1 = std::min(i0 + 1, cn - 1);
+        w = LIM(c - i0, 0.f, 1.f);
+    };
+
+    std::vector<int> xi0(W), xi1(W);
+    std::vector<float> xw(W);
+    for (int x = 0; x < W; ++x) {
+        coords(x, cW, xi0[x], xi1[x], xw[x]);
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread && W * H >= MT_MIN_SIZE)
+#endif
+    for (int y = 0; y < H; ++y) {
+        int y0, y1;
+        float wy;
+        coords(y, cH, y0, y1, wy);
+        const float *c0 = coarse.u + size_t(y0) * cW;
+        const float *c1 = coarse.u + size_t(y1) * cW;
+        float *dst = fine.u + size_t(y) * W;
+        for (int x = 0; x < W; ++x) {
+            const float v0 = intp(xw[x], c0[xi1[x]], c0[xi0[x]]);
+            const float v1 = intp(xw[x], c1[xi1[x]], c1[xi0[x]]);
+            const float v = intp(wy, v1, v0);
+            dst[x] = add ? dst[x] + v : v;
+        }
+    }
+}
+
+
+double mean(const float *data, size_t n, bool multithread)
+{
+    double sum = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+ : sum) if (multithread && n >= MT_MIN_SIZE)
+#endif
+    for (size_t i = 0; i < n; ++i) {
+        sum += data[i];
+    }
+    return n ? sum / n : 0.0;
+}
+
+
+void subtract(float *data, size_t n, float v, bool multithread)
+{
+#ifdef _OPENMP
+#pragma omp parallel for if (multithread && n >= MT_MIN_SIZE)
+#endif
+    for (size_t i = 0; i < n; ++i) {
+        data[i] -= v;
+    }
+}
+
+
+void solve_coarsest(Level &l)
+{
+    // the pure Neumann problem is solvable only if the right hand side sums
+    // to zero, so remove the rounding errors accumulated by the restrictions
+    const size_t n = size_t(l.W) * l.H;
+    subtract(l.f, n, mean(l.f, n, false), false);
+    const int sz = std::max(l.W, l.H);
+    smooth(l, 2 * sz * sz + 10, false);
+    subtract(l.u, n, mean(l.u, n, false), false);
+}
+
+
+void vcycle(std::vector<Level> &levels, size_t i, bool multithread)
+{
+    if (i + 1 == levels.size()) {
+        solve_coarsest(levels[i]);
+        return;
+    }
+
+    Level &fine = levels[i];
+    Level &coarse = levels[i + 1];
+
+    smooth(fine, PRE_SMOOTH, multithread);
+    restrict_residual(fine, coarse, true, multithread);
+    std::fill(coarse.ubuf.begin(), coarse.ubuf.end(), 0.f);
+    vcycle(levels, i + 1, multithread);
+    prolongate(coarse, fine, true, multithread);
+    smooth(fine, POST_SMOOTH, multithread);
+}
+
+} // namespace pde_multigrid
+
+
+void solve_pde_multigrid(Array2Df *F, Array2Df *U, bool multithread)
+{
+    BENCHFUN
+
+    using namespace pde_multigrid;
+
+    const int width = U->getCols();
+    const int height = U->getRows();
+    assert(F->getCols() == width && F->getRows() == height);
+
+    std::vector<Level> levels;
+    levels.reserve(32);
+    levels.emplace_back();
+    levels[0].W = width;
+    levels[0].H = height;
+    levels[0].u = U->data();
+    levels[0].f = F->data();
+
+    while (std::max(levels.back().W, levels.back().H) > COARSEST_SIZE) {
+        const int W = (levels.back().W + 1) / 2;
+        const int H = (levels.back().H + 1) / 2;
+        levels.emplace_back();
+        Level &l = levels.back();
+        l.W = W;
+        l.H = H;
+        l.ubuf.resize(size_t(W) * H);
+        l.fbuf.resize(size_t(W) * H);
+        l.u = l.ubuf.data();
+        l.f = l.fbuf.data();
+    }
+
+    // full multigrid: restrict the right hand side down to the coarsest
+    // level, solve there, and then use the interpolated solution as the
+    // initial guess for a few V-cycles at each finer level
+    for (size_t i = 1; i < levels.size(); ++i) {
+        restrict_residual(levels[i - 1], levels[i], false, multithread);
+    }
+
+    solve_coarsest(levels.back());
+
+    for (size_t i = levels.size() - 1; i-- > 0;) {
+        prolongate(levels[i + 1], levels[i], false, multithread);
+        for (int c = 0; c < CYCLES; ++c) {
+            vcycle(levels, i, multithread);
+        }
+    }
+
+    // fix the arbitrary constant like solve_pde_fft() does
+    const size_t n = size_t(width) * height;
+    subtract(U->data(), n, mean(U->data(), n, multithread), multithread);
+}
+
+
 inline void rescale_bilinear(const Array2Df &src, Array2Df &dst,
                              bool multithread)
 {
@@ -1051,11 +1411,16 @@ void ToneMapFattal02(Imagefloat *rgb, ImProcFunctions *ipf,
         }
     }
 
+    // the fft solver needs dimensions with only small prime factors, the
+    // multigrid one converges best if they stay even for most of its levels
+    const bool multigrid = settings->fattal_multigrid;
+    const auto multigrid_dim = [](int d) { return (d + 31) / 32 * 32; };
+
     // median filter on the deep shadows, to avoid boosting noise
     // because w2 >= w and h2 >= h, we can use the L buffer as temporary buffer
     // for Median_Denoise()
-    int w2 = find_fast_fftw_dim(w);
-    int h2 = find_fast_fftw_dim(h);
+    int w2 = multigrid ? multigrid_dim(w) : find_fast_fftw_dim(w);
+    int h2 = multigrid ? multigrid_dim(h) : find_fast_fftw_dim(h);
     Array2Df L(w2, h2);
     float scale_ratio = float(std::max(w, h)) / float(RT_dimension_cap);
     {
@@ -1089,7 +1454,8 @@ void ToneMapFattal02(Imagefloat *rgb, ImProcFunctions *ipf,
     }
 
     rescale_nearest(Yr, L, multiThread);
-    tmo_fattal02(w2, h2, L, L, alpha, beta, noise, detail_level, multiThread);
+    tmo_fattal02(w2, h2, L, L, alpha, beta, noise, detail_level, multigrid,
+                 multiThread);
 
     const float hr = float(h2) / float(h);
     const float wr = float(w2) / float(w);
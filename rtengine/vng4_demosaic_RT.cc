@@ -23,6 +23,8 @@
 #include "../rtgui/multilangmgr.h"
 #include "rawimagesource.h"
 #include "rtengine.h"
+#include <functional>
+#include <vector>
 // #define BENCHMARK
 #include "StopWatch.h"
 
@@ -30,53 +32,107 @@ namespace {
 
 using namespace rtengine;
 
+// ar, ab, pg, cg and ng are indexed by j - off
 inline void vng4interpolate_row_redblue(const RawImage *ri,
                                         const array2D<float> &rawData,
                                         float *ar, float *ab,
                                         const float *const pg,
                                         const float *const cg,
-                                        const float *const ng, int i, int width)
+                                        const float *const ng, int i,
+                                        int jstart, int jend, int off)
 {
     if (ri->ISBLUE(i, 0) || ri->ISBLUE(i, 1)) {
         std::swap(ar, ab);
     }
 
     // RGRGR or GRGRGR line
-    for (int j = 3; j < width - 3; ++j) {
+    for (int j = jstart; j < jend; ++j) {
+        const int k = j - off;
         if (!ri->ISGREEN(i, j)) {
             // keep original value
-            ar[j] = rawData[i][j];
+            ar[k] = rawData[i][j];
             // cross interpolation of red/blue
-            float rb = (rawData[i - 1][j - 1] - pg[j - 1] +
-                        rawData[i + 1][j - 1] - ng[j - 1]);
-            rb += (rawData[i - 1][j + 1] - pg[j + 1] + rawData[i + 1][j + 1] -
-                   ng[j + 1]);
-            ab[j] = std::max(0.f, cg[j] + rb * 0.25f);
+            float rb = (rawData[i - 1][j - 1] - pg[k - 1] +
+                        rawData[i + 1][j - 1] - ng[k - 1]);
+            rb += (rawData[i - 1][j + 1] - pg[k + 1] + rawData[i + 1][j + 1] -
+                   ng[k + 1]);
+            ab[k] = std::max(0.f, cg[k] + rb * 0.25f);
         } else {
             // linear R/B-G interpolation horizontally
-            ar[j] = std::max(0.f, cg[j] + (rawData[i][j - 1] - cg[j - 1] +
-                                           rawData[i][j + 1] - cg[j + 1]) /
+            ar[k] = std::max(0.f, cg[k] + (rawData[i][j - 1] - cg[k - 1] +
+                                           rawData[i][j + 1] - cg[k + 1]) /
                                               2);
             // linear B/R-G interpolation vertically
-            ab[j] = std::max(0.f, cg[j] + (rawData[i - 1][j] - pg[j] +
-                                           rawData[i + 1][j] - ng[j]) /
+            ab[k] = std::max(0.f, cg[k] + (rawData[i - 1][j] - pg[k] +
+                                           rawData[i + 1][j] - ng[k]) /
                                               2);
         }
     }
 }
-} // namespace
 
-namespace rtengine
+constexpr unsigned int colors = 4;
 
-{
 #define fc(row, col)                                                           \
     (prefilters >> ((((row) << 1 & 14) + ((col) & 1)) << 1) & 3)
 
-void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
-                                   array2D<float> &red, array2D<float> &green,
-                                   array2D<float> &blue)
+// tables for the linear interpolation step, for an image with rows of width
+// pixels (4 floats per pixel)
+void vng4_linear_tables(unsigned prefilters, int width,
+                        int lcode[16][16][32], float mul[16][16][8],
+                        float csum[16][16][3])
+{
+    for (int row = 0; row < 16; row++)
+        for (int col = 0; col < 16; col++) {
+            int *ip = lcode[row][col];
+            int mulcount = 0;
+            float sum[4] = {};
+
+            for (int y = -1; y <= 1; y++)
+                for (int x = -1; x <= 1; x++) {
+                    int shift = (y == 0) + (x == 0);
+
+                    if (shift == 2) {
+                        continue;
+                    }
+
+                    int color = fc(row + y, col + x);
+                    *ip++ = (width * y + x) * 4 + color;
+
+                    mul[row][col][mulcount] = (1 << shift);
+                    *ip++ = color;
+                    sum[color] += (1 << shift);
+                    mulcount++;
+                }
+
+            int colcount = 0;
+
+            for (unsigned int c = 0; c < colors; c++)
+                if (c != fc(row, col)) {
+                    *ip++ = c;
+                    csum[row][col][colcount] = 1.f / sum[c];
+                    colcount++;
+                }
+        }
+}
+
+inline void vng4_linear_pixel(float *pix, const int *ip, const float *mul,
+                              const float *csum)
+{
+    float sum[4] = {};
+
+    for (int i = 0; i < 8; i++, ip += 2) {
+        sum[ip[1]] += pix[ip[0]] * mul[i];
+    }
+
+    for (unsigned int i = 0; i < colors - 1; i++, ip++) {
+        pix[ip[0]] = sum[ip[0]] * csum[i];
+    }
+}
+
+// tables for the VNG step, same layout as above. The returned buffer must be
+// released with free()
+int32_t *vng4_vng_tables(unsigned prefilters, int width, int32_t *code[8][2])
 {
-    BENCHFUN
     const signed short int *cp,
         terms[] = {-2, -2, +0, -1, 0, 0x01, -2, -2, +0, +0, 1, 0x01,
                    -2, -1, -1, +0, 0, 0x01, -2, -1, +0, -1, 0, 0x02,
@@ -112,6 +168,147 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
                    +1, +0, +2, -1, 0, 0x40, +1, +0, +2, +1, 0, 0x10},
         chood[] = {-1, -1, -1, 0, -1, +1, 0, +1, +1, +1, +1, 0, +1, -1, 0, -1};
 
+    constexpr int prow = 7, pcol = 1;
+    int32_t *ip = (int32_t *)calloc((prow + 1) * (pcol + 1), 1280);
+    int32_t *ret = ip;
+
+    for (int row = 0; row <= prow; row++) /* Precalculate for VNG */
+        for (int col = 0; col <= pcol; col++) {
+            code[row][col] = ip;
+            cp = terms;
+            for (int t = 0; t < 64; t++) {
+                int y1 = *cp++;
+                int x1 = *cp++;
+                int y2 = *cp++;
+                int x2 = *cp++;
+                int weight = *cp++;
+                int grads = *cp++;
+                unsigned int color = fc(row + y1, col + x1);
+
+                if (fc(row + y2, col + x2) != color) {
+                    continue;
+                }
+
+                int diag =
+                    (fc(row, col + 1) == color && fc(row + 1, col) == color)
+                        ? 2
+                        : 1;
+
+                if (abs(y1 - y2) == diag && abs(x1 - x2) == diag) {
+                    continue;
+                }
+
+                *ip++ = (y1 * width + x1) * 4 + color;
+                *ip++ = (y2 * width + x2) * 4 + color;
+#ifdef ART_SIMD
+                // at least on machines with SSE2 feature this cast is save
+                *reinterpret_cast<float *>(ip++) = 1 << weight;
+#else
+                *ip++ = 1 << weight;
+#endif
+                for (int g = 0; g < 8; g++)
+                    if (grads & (1 << g)) {
+                        *ip++ = g;
+                    }
+
+                *ip++ = -1;
+            }
+
+            *ip++ = INT_MAX;
+
+            cp = chood;
+            for (int g = 0; g < 8; g++) {
+                int y = *cp++;
+                int x = *cp++;
+                *ip++ = (y * width + x) * 4;
+                unsigned int color = fc(row, col);
+
+                if (fc(row + y, col + x) != color &&
+                    fc(row + y * 2, col + x * 2) == color) {
+                    *ip++ = (y * width + x) * 8 + color;
+                } else {
+                    *ip++ = 0;
+                }
+            }
+        }
+
+    return ret;
+}
+
+// VNG interpolation of the green channel of one pixel
+inline float vng4_green(const float *pix, int color, const int32_t *ip)
+{
+    float gval[8] = {};
+
+    while (ip[0] != INT_MAX) { /* Calculate gradients */
+#ifdef ART_SIMD
+        // at least on machines with SSE2 feature this cast is save
+        // and saves a lot of int => float conversions
+        const float diff = std::fabs(pix[ip[0]] - pix[ip[1]]) *
+                           reinterpret_cast<const float *>(ip)[2];
+#else
+        const float diff = std::fabs(pix[ip[0]] - pix[ip[1]]) * ip[2];
+#endif
+        gval[ip[3]] += diff;
+        ip += 5;
+        if (UNLIKELY(ip[-1] != -1)) {
+            gval[ip[-1]] += diff;
+            ip++;
+        }
+    }
+    ip++;
+
+    const float thold =
+        rtengine::min(gval[0], gval[1], gval[2], gval[3], gval[4], gval[5],
+                      gval[6], gval[7]) +
+        rtengine::max(gval[0], gval[1], gval[2], gval[3], gval[4], gval[5],
+                      gval[6], gval[7]) *
+            0.5f;
+
+    float sum0 = 0.f;
+    float sum1 = 0.f;
+    const float greenval = pix[color];
+    int num = 0;
+
+    if (color & 1) {
+        color ^= 2;
+        for (int g = 0; g < 8; g++, ip += 2) { /* Average the neighbors */
+            if (gval[g] <= thold) {
+                if (ip[1]) {
+                    sum0 += greenval + pix[ip[1]];
+                }
+
+                sum1 += pix[ip[0] + color];
+                num++;
+            }
+        }
+        sum0 *= 0.5f;
+    } else {
+        for (int g = 0; g < 8; g++, ip += 2) { /* Average the neighbors */
+            if (gval[g] <= thold) {
+                if (ip[1]) {
+                    sum0 += greenval + pix[ip[1]];
+                }
+
+                sum1 += pix[ip[0] + 1] + pix[ip[0] + 3];
+                num++;
+            }
+        }
+    }
+    return std::max(0.f, greenval + (sum1 - sum0) / (2 * num));
+}
+
+} // namespace
+
+namespace rtengine
+
+{
+
+void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
+                                   array2D<float> &red, array2D<float> &green,
+                                   array2D<float> &blue)
+{
+    BENCHFUN
     double progress = 0.0;
     const bool plistenerActive = plistener;
 
@@ -125,7 +322,6 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
 
     const unsigned prefilters = ri->prefilters;
     const int width = W, height = H;
-    constexpr unsigned int colors = 4;
 
     float(*image)[4] = (float(*)[4])calloc(height * width, sizeof *image);
 
@@ -134,38 +330,7 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
     float csum[16][16][3];
 
     // first linear interpolation
-    for (int row = 0; row < 16; row++)
-        for (int col = 0; col < 16; col++) {
-            int *ip = lcode[row][col];
-            int mulcount = 0;
-            float sum[4] = {};
-
-            for (int y = -1; y <= 1; y++)
-                for (int x = -1; x <= 1; x++) {
-                    int shift = (y == 0) + (x == 0);
-
-                    if (shift == 2) {
-                        continue;
-                    }
-
-                    int color = fc(row + y, col + x);
-                    *ip++ = (width * y + x) * 4 + color;
-
-                    mul[row][col][mulcount] = (1 << shift);
-                    *ip++ = color;
-                    sum[color] += (1 << shift);
-                    mulcount++;
-                }
-
-            int colcount = 0;
-
-            for (unsigned int c = 0; c < colors; c++)
-                if (c != fc(row, col)) {
-                    *ip++ = c;
-                    csum[row][col][colcount] = 1.f / sum[c];
-                    colcount++;
-                }
-        }
+    vng4_linear_tables(prefilters, width, lcode, mul, csum);
 
 #ifdef _OPENMP
 #pragma omp parallel
@@ -189,17 +354,10 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
             if (ii - 1 > firstRow) {
                 int row = ii - 1;
                 for (int col = 1; col < width - 1; col++) {
-                    float *pix = image[row * width + col];
-                    int *ip = lcode[row & 15][col & 15];
-                    float sum[4] = {};
-
-                    for (int i = 0; i < 8; i++, ip += 2) {
-                        sum[ip[1]] += pix[ip[0]] * mul[row & 15][col & 15][i];
-                    }
-
-                    for (unsigned int i = 0; i < colors - 1; i++, ip++) {
-                        pix[ip[0]] = sum[ip[0]] * csum[row & 15][col & 15][i];
-                    }
+                    vng4_linear_pixel(image[row * width + col],
+                                      lcode[row & 15][col & 15],
+                                      mul[row & 15][col & 15],
+                                      csum[row & 15][col & 15]);
                 }
             }
         }
@@ -209,101 +367,27 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
         if (firstRow > 0 && firstRow < H - 1) {
             const int row = firstRow;
             for (int col = 1; col < width - 1; col++) {
-                float *pix = image[row * width + col];
-                int *ip = lcode[row & 15][col & 15];
-                float sum[4] = {};
-
-                for (int i = 0; i < 8; i++, ip += 2) {
-                    sum[ip[1]] += pix[ip[0]] * mul[row & 15][col & 15][i];
-                }
-
-                for (unsigned int i = 0; i < colors - 1; i++, ip++) {
-                    pix[ip[0]] = sum[ip[0]] * csum[row & 15][col & 15][i];
-                }
+                vng4_linear_pixel(image[row * width + col],
+                                  lcode[row & 15][col & 15],
+                                  mul[row & 15][col & 15],
+                                  csum[row & 15][col & 15]);
             }
         }
 
         if (lastRow > 0 && lastRow < H - 1) {
             const int row = lastRow;
             for (int col = 1; col < width - 1; col++) {
-                float *pix = image[row * width + col];
-                int *ip = lcode[row & 15][col & 15];
-                float sum[4] = {};
-
-                for (int i = 0; i < 8; i++, ip += 2) {
-                    sum[ip[1]] += pix[ip[0]] * mul[row & 15][col & 15][i];
-                }
-
-                for (unsigned int i = 0; i < colors - 1; i++, ip++) {
-                    pix[ip[0]] = sum[ip[0]] * csum[row & 15][col & 15][i];
-                }
+                vng4_linear_pixel(image[row * width + col],
+                                  lcode[row & 15][col & 15],
+                                  mul[row & 15][col & 15],
+                                  csum[row & 15][col & 15]);
             }
         }
     }
 
     constexpr int prow = 7, pcol = 1;
     int32_t *code[8][2];
-    int32_t *ip = (int32_t *)calloc((prow + 1) * (pcol + 1), 1280);
-
-    for (int row = 0; row <= prow; row++) /* Precalculate for VNG */
-        for (int col = 0; col <= pcol; col++) {
-            code[row][col] = ip;
-            cp = terms;
-            for (int t = 0; t < 64; t++) {
-                int y1 = *cp++;
-                int x1 = *cp++;
-                int y2 = *cp++;
-                int x2 = *cp++;
-                int weight = *cp++;
-                int grads = *cp++;
-                unsigned int color = fc(row + y1, col + x1);
-
-                if (fc(row + y2, col + x2) != color) {
-                    continue;
-                }
-
-                int diag =
-                    (fc(row, col + 1) == color && fc(row + 1, col) == color)
-                        ? 2
-                        : 1;
-
-                if (abs(y1 - y2) == diag && abs(x1 - x2) == diag) {
-                    continue;
-                }
-
-                *ip++ = (y1 * width + x1) * 4 + color;
-                *ip++ = (y2 * width + x2) * 4 + color;
-#ifdef ART_SIMD
-                // at least on machines with SSE2 feature this cast is save
-                *reinterpret_cast<float *>(ip++) = 1 << weight;
-#else
-                *ip++ = 1 << weight;
-#endif
-                for (int g = 0; g < 8; g++)
-                    if (grads & (1 << g)) {
-                        *ip++ = g;
-                    }
-
-                *ip++ = -1;
-            }
-
-            *ip++ = INT_MAX;
-
-            cp = chood;
-            for (int g = 0; g < 8; g++) {
-                int y = *cp++;
-                int x = *cp++;
-                *ip++ = (y * width + x) * 4;
-                unsigned int color = fc(row, col);
-
-                if (fc(row + y, col + x) != color &&
-                    fc(row + y * 2, col + x * 2) == color) {
-                    *ip++ = (y * width + x) * 8 + color;
-                } else {
-                    *ip++ = 0;
-                }
-            }
-        }
+    int32_t *codebuf = vng4_vng_tables(prefilters, width, code);
 
     if (plistenerActive) {
         progress = 0.2;
@@ -330,78 +414,15 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
             }
             lastRow = row;
             for (int col = 2; col < width - 2; col++) {
-                float *pix = image[row * width + col];
-                int color = fc(row, col);
-                int32_t *ip = code[row & prow][col & pcol];
-                float gval[8] = {};
-
-                while (ip[0] != INT_MAX) { /* Calculate gradients */
-#ifdef ART_SIMD
-                    // at least on machines with SSE2 feature this cast is save
-                    // and saves a lot of int => float conversions
-                    const float diff = std::fabs(pix[ip[0]] - pix[ip[1]]) *
-                                       reinterpret_cast<float *>(ip)[2];
-#else
-                    const float diff =
-                        std::fabs(pix[ip[0]] - pix[ip[1]]) * ip[2];
-#endif
-                    gval[ip[3]] += diff;
-                    ip += 5;
-                    if (UNLIKELY(ip[-1] != -1)) {
-                        gval[ip[-1]] += diff;
-                        ip++;
-                    }
-                }
-                ip++;
-
-                const float thold =
-                    rtengine::min(gval[0], gval[1], gval[2], gval[3], gval[4],
-                                  gval[5], gval[6], gval[7]) +
-                    rtengine::max(gval[0], gval[1], gval[2], gval[3], gval[4],
-                                  gval[5], gval[6], gval[7]) *
-                        0.5f;
-
-                float sum0 = 0.f;
-                float sum1 = 0.f;
-                const float greenval = pix[color];
-                int num = 0;
-
-                if (color & 1) {
-                    color ^= 2;
-                    for (int g = 0; g < 8;
-                         g++, ip += 2) { /* Average the neighbors */
-                        if (gval[g] <= thold) {
-                            if (ip[1]) {
-                                sum0 += greenval + pix[ip[1]];
-                            }
-
-                            sum1 += pix[ip[0] + color];
-                            num++;
-                        }
-                    }
-                    sum0 *= 0.5f;
-                } else {
-                    for (int g = 0; g < 8;
-                         g++, ip += 2) { /* Average the neighbors */
-                        if (gval[g] <= thold) {
-                            if (ip[1]) {
-                                sum0 += greenval + pix[ip[1]];
-                            }
-
-                            sum1 += pix[ip[0] + 1] + pix[ip[0] + 3];
-                            num++;
-                        }
-                    }
-                }
                 green[row][col] =
-                    std::max(0.f, greenval + (sum1 - sum0) / (2 * num));
+                    vng4_green(image[row * width + col], fc(row, col),
+                               code[row & prow][col & pcol]);
             }
             if (row - 1 > firstRow) {
                 vng4interpolate_row_redblue(
                     ri, rawData, red[row - 1], blue[row - 1], green[row - 2],
-                    green[row - 1], green[row], row - 1, W);
+                    green[row - 1], green[row], row - 1, 3, W - 3, 0);
             }
-
             if (plistenerActive) {
                 if ((row % progressStep) == 0)
 #ifdef _OPENMP
@@ -417,13 +438,13 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
         if (firstRow > 2 && firstRow < H - 3) {
             vng4interpolate_row_redblue(
                 ri, rawData, red[firstRow], blue[firstRow], green[firstRow - 1],
-                green[firstRow], green[firstRow + 1], firstRow, W);
+                green[firstRow], green[firstRow + 1], firstRow, 3, W - 3, 0);
         }
 
         if (lastRow > 2 && lastRow < H - 3) {
             vng4interpolate_row_redblue(
                 ri, rawData, red[lastRow], blue[lastRow], green[lastRow - 1],
-                green[lastRow], green[lastRow + 1], lastRow, W);
+                green[lastRow], green[lastRow + 1], lastRow, 3, W - 3, 0);
         }
 #ifdef _OPENMP
 #pragma omp single
@@ -435,11 +456,194 @@ void RawImageSource::vng4_demosaic(const array2D<float> &rawData,
         }
     }
 
-    free(code[0][0]);
+    free(codebuf);
     free(image);
 
     if (plistenerActive) {
         plistener->setProgress(1.0);
     }
 }
+
+
+// VNG4 blended into the output of another demosaicer, as done by
+// dual_demosaic_RT(). This works in tiles, so that neither the full-size
+// linear interpolation buffer of vng4_demosaic() nor full-size temporary
+// planes for the VNG4 result are needed, and tiles in which the blend factor
+// is 1 everywhere (i.e. the first demosaicer is kept as is) are skipped
+void RawImageSource::vng4_demosaic_blend(const float *const *blend,
+                                         const array2D<float> &rawData,
+                                         array2D<float> &red,
+                                         array2D<float> &green,
+                                         array2D<float> &blue)
+{
+    BENCHFUN
+
+    if (plistener) {
+        plistener->setProgressStr(
+            Glib::ustring::compose(M("TP_RAW_DMETHOD_PROGRESSBAR"),
+                                   RAWParams::BayerSensor::getMethodString(
+                                       RAWParams::BayerSensor::Method::VNG4)));
+        plistener->setProgress(0.0);
+    }
+
+    const unsigned prefilters = ri->prefilters;
+
+    // size of the output tiles, and margin needed around them by the linear
+    // interpolation (1 pixel) and the VNG step (2 pixels). The outer border
+    // of the image is handled separately, by border_interpolate2() as in
+    // vng4_demosaic()
+    constexpr int TS = 128;
+    constexpr int MARGIN = 3;
+    constexpr int TSM = TS + 2 * MARGIN;
+    // green is needed also on a 1 pixel border around the tile
+    constexpr int GS = TS + 2;
+
+    int lcode[16][16][32];
+    float mul[16][16][8];
+    float csum[16][16][3];
+    vng4_linear_tables(prefilters, TSM, lcode, mul, csum);
+
+    constexpr int prow = 7, pcol = 1;
+    int32_t *code[8][2];
+    int32_t *codebuf = vng4_vng_tables(prefilters, TSM, code);
+
+    const int numTilesW = std::max(W - 2 * MARGIN + TS - 1, 0) / TS;
+    const int numTilesH = std::max(H - 2 * MARGIN + TS - 1, 0) / TS;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> imagebuf(TSM * TSM * 4);
+        float(*image)[4] = reinterpret_cast<float(*)[4]>(imagebuf.data());
+        std::vector<float> gbuf(GS * GS);
+        std::vector<float> rbuf(TS * TS);
+        std::vector<float> bbuf(TS * TS);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic) collapse(2)
+#endif
+        for (int tr = 0; tr < numTilesH; ++tr) {
+            for (int tc = 0; tc < numTilesW; ++tc) {
+                const int y0 = MARGIN + tr * TS;
+                const int y1 = std::min(y0 + TS, H - MARGIN);
+                const int x0 = MARGIN + tc * TS;
+                const int x1 = std::min(x0 + TS, W - MARGIN);
+
+                bool needed = false;
+                for (int y = y0; y < y1 && !needed; ++y) {
+                    for (int x = x0; x < x1; ++x) {
+                        if (blend[y][x] < 1.f) {
+                            needed = true;
+                            break;
+                        }
+                    }
+                }
+                if (!needed) {
+                    continue;
+                }
+
+                const int oy = y0 - MARGIN;
+                const int ox = x0 - MARGIN;
+                const int th = y1 - y0 + 2 * MARGIN;
+                const int tw = x1 - x0 + 2 * MARGIN;
+
+                for (int i = 0; i < th; ++i) {
+                    for (int j = 0; j < tw; ++j) {
+                        image[i * TSM + j][fc(oy + i, ox + j)] =
+                            rawData[oy + i][ox + j];
+                    }
+                }
+
+                for (int i = 1; i < th - 1; ++i) {
+                    const int row = oy + i;
+                    for (int j = 1; j < tw - 1; ++j) {
+                        const int col = ox + j;
+                        vng4_linear_pixel(image[i * TSM + j],
+                                          lcode[row & 15][col & 15],
+                                          mul[row & 15][col & 15],
+                                          csum[row & 15][col & 15]);
+                    }
+                }
+
+                for (int i = MARGIN - 1; i <= th - MARGIN; ++i) {
+                    const int row = oy + i;
+                    float *g = &gbuf[(i - MARGIN + 1) * GS];
+                    for (int j = MARGIN - 1; j <= tw - MARGIN; ++j) {
+                        const int col = ox + j;
+                        g[j - MARGIN + 1] =
+                            vng4_green(image[i * TSM + j], fc(row, col),
+                                       code[row & prow][col & pcol]);
+                    }
+                }
+
+                for (int row = y0; row < y1; ++row) {
+                    // index 0 of the green rows is column x0
+                    const float *g = &gbuf[(row - y0 + 1) * GS + 1];
+                    vng4interpolate_row_redblue(
+                        ri, rawData, &rbuf[(row - y0) * TS],
+                        &bbuf[(row - y0) * TS], g - GS, g, g + GS, row, x0, x1,
+                        x0);
+                }
+
+                for (int row = y0; row < y1; ++row) {
+                    const float *r = &rbuf[(row - y0) * TS];
+                    const float *g = &gbuf[(row - y0 + 1) * GS + 1];
+                    const float *b = &bbuf[(row - y0) * TS];
+                    for (int col = x0; col < x1; ++col) {
+                        const float f = blend[row][col];
+                        const int k = col - x0;
+                        red[row][col] = intp(f, red[row][col], r[k]);
+                        green[row][col] = intp(f, green[row][col], g[k]);
+                        blue[row][col] = intp(f, blue[row][col], b[k]);
+                    }
+                }
+            }
+        }
+    }
+
+    free(codebuf);
+
+    // border: keep the values of the first demosaicer, and blend them with
+    // those of border_interpolate2()
+    const auto for_border = [&](const std::function<void(int, int)> &f) {
+        for (int row = 0; row < H; ++row) {
+            if (row < MARGIN || row >= H - MARGIN) {
+                for (int col = 0; col < W; ++col) {
+                    f(row, col);
+                }
+            } else {
+                for (int col = 0; col < std::min(MARGIN, W); ++col) {
+                    f(row, col);
+                }
+                for (int col = std::max(W - MARGIN, MARGIN); col < W; ++col) {
+                    f(row, col);
+                }
+            }
+        }
+    };
+
+    std::vector<float> border;
+    for_border([&](int row, int col) {
+        border.push_back(red[row][col]);
+        border.push_back(green[row][col]);
+        border.push_back(blue[row][col]);
+    });
+
+    border_interpolate2(W, H, MARGIN, rawData, red, green, blue);
+
+    size_t k = 0;
+    for_border([&](int row, int col) {
+        const float f = blend[row][col];
+        red[row][col] = intp(f, border[k], red[row][col]);
+        green[row][col] = intp(f, border[k + 1], green[row][col]);
+        blue[row][col] = intp(f, border[k + 2], blue[row][col]);
+        k += 3;
+    });
+
+    if (plistener) {
+        plistener->setProgress(1.0);
+    }
+}
+
 } // namespace rtengine
@@ -271,11 +271,20 @@ void BatchQueue::addEntries(const std::vector<BatchQueueEntry *> &entries,
             // batch queue might have smaller, restricted size
             entry->resize(getThumbnailHeight());
 
-            // recovery save
+            // recovery save. This file is only read back by the queue
+            // itself, so use the binary format, which is faster to write and
+            // to load
             const auto tempFile = getTempFilenameForParams(entry->filename);
+            const std::string data = entry->params.to_binary();
 
-            if (!entry->params.save(this, tempFile)) {
-                entry->savedParamsFile = tempFile;
+            try {
+                if (!data.empty()) {
+                    Glib::file_set_contents(tempFile, data);
+                    entry->savedParamsFile = tempFile;
+                }
+            } catch (Glib::FileError &exc) {
+                std::cerr << "ERROR saving " << tempFile << ": " << exc.what()
+                          << std::endl;
             }
 
             entry->selected = false;
@@ -1167,6 +1176,26 @@ rtengine::ProcessingJob *BatchQueue::imageReady(rtengine::IImagefloat *img)
     return processing ? processing->job : nullptr;
 }
 
+bool BatchQueue::getNextJobSource(Glib::ustring &fname, bool &isRaw)
+{
+    // called from the batch processing thread: fd[0] is the entry being
+    // processed, so the next job is the one right after it
+    MYREADERLOCK(l, entryRW);
+
+    if (fd.size() < 2 || !listener || !listener->canStartNext()) {
+        return false;
+    }
+
+    const BatchQueueEntry *next = static_cast<BatchQueueEntry *>(fd[1]);
+    if (!next->thumbnail) {
+        return false;
+    }
+
+    fname = next->filename;
+    isRaw = next->thumbnail->getType() == FT_Raw;
+    return true;
+}
+
 Glib::ustring BatchQueue::autoCompleteFileName(const Glib::ustring &fileName,
                                                const Glib::ustring &format)
 {
@@ -81,6 +81,7 @@ public:
     void setProgressState(bool inProcessing) override;
     void error(const Glib::ustring &descr) override;
     rtengine::ProcessingJob *imageReady(rtengine::IImagefloat *img) override;
+    bool getNextJobSource(Glib::ustring &fname, bool &isRaw) override;
 
     void rightClicked(ThumbBrowserEntryBase *entry) override;
     void doubleClicked(ThumbBrowserEntryBase *entry) override;
@@ -691,6 +691,11 @@ void Options::setDefaults()
     rtSettings.thread_pool_size = 0;
     rtSettings.ctl_scripts_fast_preview = true;
     rtSettings.imgio_raw_cache_size = 10;
+    rtSettings.batch_queue_prefetch = true;
+    rtSettings.fattal_multigrid = false;
+    rtSettings.pipeline_checkpoints_budget = 256;
+    rtSettings.lens_exact_apply = false;
+    rtSettings.proofing_exact_apply = false;
 
     show_exiftool_makernotes = false;
 
@@ -1393,6 +1398,33 @@ void Options::readFromFile(Glib::ustring fname)
                         "Performance", "RAWImageIOCacheSize");
                 }
 
+                if (keyFile.has_key("Performance", "BatchQueuePrefetch")) {
+                    rtSettings.batch_queue_prefetch = keyFile.get_boolean(
+                        "Performance", "BatchQueuePrefetch");
+                }
+
+                if (keyFile.has_key("Performance", "FattalMultigridSolver")) {
+                    rtSettings.fattal_multigrid = keyFile.get_boolean(
+                        "Performance", "FattalMultigridSolver");
+                }
+
+                if (keyFile.has_key("Performance",
+                                    "PipelineCheckpointsBudget")) {
+                    rtSettings.pipeline_checkpoints_budget =
+                        keyFile.get_integer("Performance",
+                                            "PipelineCheckpointsBudget");
+                }
+
+                if (keyFile.has_key("Performance", "LensExactApply")) {
+                    rtSettings.lens_exact_apply =
+                        keyFile.get_boolean("Performance", "LensExactApply");
+                }
+
+                if (keyFile.has_key("Performance", "ProofingExactApply")) {
+                    rtSettings.proofing_exact_apply = keyFile.get_boolean(
+                        "Performance", "ProofingExactApply");
+                }
+
                 if (keyFile.has_key("Performance",
                                     "PreviewResamplingQuality")) {
                     preview_resampling_quality =
@@ -2332,6 +2364,16 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_integer("Performance", "WBPreviewMode", wb_preview_mode);
         keyFile.set_integer("Performance", "RAWImageIOCacheSize",
                             rtSettings.imgio_raw_cache_size);
+        keyFile.set_boolean("Performance", "BatchQueuePrefetch",
+                            rtSettings.batch_queue_prefetch);
+        keyFile.set_boolean("Performance", "FattalMultigridSolver",
+                            rtSettings.fattal_multigrid);
+        keyFile.set_integer("Performance", "PipelineCheckpointsBudget",
+                            rtSettings.pipeline_checkpoints_budget);
+        keyFile.set_boolean("Performance", "LensExactApply",
+                            rtSettings.lens_exact_apply);
+        keyFile.set_boolean("Performance", "ProofingExactApply",
+                            rtSettings.proofing_exact_apply);
         keyFile.set_integer("Performance", "PreviewResamplingQuality",
                             int(preview_resampling_quality));
 
@@ -662,6 +662,15 @@ Gtk::Widget *Preferences::getPerformancePanel()
     }
     vbPerformance->pack_start(*fe_frame, Gtk::PACK_SHRINK, 4);
 
+    Gtk::Frame *fattal_frame =
+        Gtk::manage(new Gtk::Frame(M("TP_TM_FATTAL_LABEL")));
+    fattal_multigrid_ = Gtk::manage(
+        new Gtk::CheckButton(M("PREFERENCES_FATTAL_MULTIGRID")));
+    fattal_multigrid_->set_tooltip_text(
+        M("PREFERENCES_FATTAL_MULTIGRID_TOOLTIP"));
+    fattal_frame->add(*fattal_multigrid_);
+    vbPerformance->pack_start(*fattal_frame, Gtk::PACK_SHRINK, 4);
+
     swPerformance->add(*vbPerformance);
 
     return swPerformance;
@@ -2313,6 +2322,7 @@ void Preferences::storePreferences()
         thumbUpdateThreadLimit->get_value_as_int();
     moptions.thumb_delay_update = thumbDelayUpdate->get_active();
     moptions.thumb_lazy_caching = thumbLazyCaching->get_active();
+    moptions.rtSettings.fattal_multigrid = fattal_multigrid_->get_active();
     moptions.thumb_cache_processed = thumb_cache_processed_->get_active();
     moptions.rtSettings.ctl_scripts_fast_preview =
         ctl_scripts_fast_preview_->get_active();
@@ -2622,6 +2632,7 @@ void Preferences::fillPreferences()
     thumbUpdateThreadLimit->set_value(moptions.rtSettings.thread_pool_size);
     thumbDelayUpdate->set_active(moptions.thumb_delay_update);
     thumbLazyCaching->set_active(moptions.thumb_lazy_caching);
+    fattal_multigrid_->set_active(moptions.rtSettings.fattal_multigrid);
     thumb_cache_processed_->set_active(moptions.thumb_cache_processed);
     ctl_scripts_fast_preview_->set_active(
         moptions.rtSettings.ctl_scripts_fast_preview);
@@ -156,6 +156,7 @@ class Preferences: public Gtk::Dialog, public ProfileStoreListener {
     Gtk::SpinButton *thumbUpdateThreadLimit;
     Gtk::CheckButton *thumbDelayUpdate;
     Gtk::CheckButton *thumbLazyCaching;
+    Gtk::CheckButton *fattal_multigrid_;
     Gtk::CheckButton *thumb_cache_processed_;
     Gtk::CheckButton *ctl_scripts_fast_preview_;
     Gtk::SpinButton *qinspect_size_;
@@ -32,10 +32,10 @@ namespace thumbimgcache {
 /******************************************************************************
  * file format:
  *
- * "ART\n" header
+ * "ARB\n" header
  * monitor hash
  * size of the procparams
- * compressed procparams
+ * procparams in binary form (see KeyFile::to_binary())
  * width
  * height
  * image data
@@ -61,8 +61,8 @@ rtengine::IImage8 *load(const Glib::ustring &cache_fname,
 
     // header
     char buffer[64];
-    fgets(buffer, 5, f);
-    if (strcmp(buffer, "ART\n") != 0) {
+    if (!fgets(buffer, 5, f) || strcmp(buffer, "ARB\n") != 0) {
+        fclose(f);
         return nullptr;
     }
 
@@ -85,22 +85,24 @@ rtengine::IImage8 *load(const Glib::ustring &cache_fname,
         return nullptr;
     }
 
-    rtengine::procparams::ProcParams imgparams;
+    // compare the stored params with the current ones without parsing them:
+    // the binary representation is canonical, so comparing the bytes is
+    // enough
     {
-        std::vector<uint8_t> profzdata(profsz);
-        if (fread(&profzdata[0], sizeof(uint8_t), profsz, f) < profsz) {
+        const std::string curdata = pparams.to_binary();
+        if (curdata.empty() || curdata.size() != profsz) {
             fclose(f);
             return nullptr;
         }
-        std::string profdata = rtengine::decompress(profzdata);
-        if (!imgparams.from_data(profdata.c_str())) {
+        std::string profdata(profsz, '\0');
+        if (fread(&profdata[0], sizeof(char), profsz, f) < profsz) {
+            fclose(f);
+            return nullptr;
+        }
+        if (profdata != curdata) {
             fclose(f);
             return nullptr;
         }
-    }
-    if (imgparams != pparams) {
-        fclose(f);
-        return nullptr;
     }
 
     guint32 width = 0, height = 0;
@@ -160,13 +162,13 @@ bool store(const Glib::ustring &cache_fname,
         return false;
     }
 
-    fputs("ART\n", f);
+    fputs("ARB\n", f);
     fputs(rtengine::ICCStore::getInstance()->getThumbnailMonitorHash().c_str(),
           f);
-    std::vector<uint8_t> profzdata = rtengine::compress(pparams.to_data(), 1);
-    guint32 profsz = guint32(profzdata.size());
+    const std::string profdata = pparams.to_binary();
+    guint32 profsz = guint32(profdata.size());
     fwrite(&profsz, sizeof(guint32), 1, f);
-    fwrite(&profzdata[0], sizeof(uint8_t), profsz, f);
+    fwrite(profdata.data(), sizeof(char), profsz, f);
 
     guint32 w = guint32(img->getWidth());
     guint32 h = guint32(img->getHeight());
@@ -33,10 +33,10 @@ namespace thumbimgcache {
 /******************************************************************************
  * file format:
  *
- * "ART\n" header
+ * "ARB\n" header
  * monitor hash
  * size of the procparams
- * compressed procparams
+ * procparams in binary form (see KeyFile::to_binary())
  * width
  * height
  * image data